@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <bsd/sys/tree.h>
+#endif							/* __linux__ */
+
+#include "bookmark.h"
+#include "replay.h"
+
+struct bookmark_result
+{
+	RB_ENTRY(bookmark_result) entry;
+	char	   *query;
+	PGresult   *res;
+	unsigned int gen;			/* bookmark the result belongs to */
+	struct timespec taken;		/* wall clock, or time in the recording */
+};
+
+int			bookmark_result_cmp(struct bookmark_result *,
+								struct bookmark_result *);
+
+RB_HEAD(bookmark_results, bookmark_result) head_bookmark_results =
+RB_INITIALIZER(&head_bookmark_results);
+RB_PROTOTYPE(bookmark_results, bookmark_result, entry, bookmark_result_cmp)
+RB_GENERATE(bookmark_results, bookmark_result, entry, bookmark_result_cmp)
+
+int			since_bookmark = 0;
+int			reading_bookmark = 0;
+
+/* results of earlier bookmarks are reused for the current one */
+static unsigned int bm_gen = 0;
+static time_t bm_time;
+static struct timespec bm_taken;
+
+int
+bookmark_result_cmp(struct bookmark_result *e1, struct bookmark_result *e2)
+{
+	return strcmp(e1->query, e2->query);
+}
+
+static struct bookmark_result *
+bookmark_find(const char *query)
+{
+	struct bookmark_result key,
+			   *b;
+
+	key.query = (char *) query;
+	b = RB_FIND(bookmark_results, &head_bookmark_results, &key);
+	return b != NULL && b->gen == bm_gen ? b : NULL;
+}
+
+/*
+ * Start a new bookmark, filled with the next result of every query.
+ */
+void
+bookmark_set(void)
+{
+	bm_gen++;
+	bm_time = 0;
+}
+
+int
+bookmark_isset(void)
+{
+	return bm_gen > 0;
+}
+
+/*
+ * When the first result of the bookmark was taken, or 0 if none was yet.
+ */
+time_t
+bookmark_time(void)
+{
+	return bm_time;
+}
+
+/*
+ * Keep a result for the bookmark, unless the query already has one.
+ */
+void
+bookmark_add(const char *query, const PGresult *res)
+{
+	struct bookmark_result key,
+			   *b;
+	PGresult   *copy;
+
+	if (bm_gen == 0 || bookmark_find(query) != NULL)
+		return;
+
+	copy = PQcopyResult(res, PG_COPYRES_ATTRS | PG_COPYRES_TUPLES);
+	if (copy == NULL)
+		return;
+
+	key.query = (char *) query;
+	b = RB_FIND(bookmark_results, &head_bookmark_results, &key);
+	if (b == NULL)
+	{
+		b = calloc(1, sizeof(struct bookmark_result));
+		if (b == NULL || (b->query = strdup(query)) == NULL)
+		{
+			free(b);
+			PQclear(copy);
+			return;
+		}
+		RB_INSERT(bookmark_results, &head_bookmark_results, b);
+	}
+	else
+		PQclear(b->res);
+
+	b->res = copy;
+	b->gen = bm_gen;
+	if (replaying)
+		replay_taken(&b->taken);
+	else
+		clock_gettime(CLOCK_REALTIME, &b->taken);
+	if (bm_time == 0)
+		bm_time = b->taken.tv_sec;
+}
+
+static void
+bookmark_replayed(const char *query)
+{
+	PGresult   *res = replay_exec(query);
+
+	if (PQresultStatus(res) == PGRES_TUPLES_OK)
+		bookmark_add(query, res);
+	PQclear(res);
+}
+
+/*
+ * Bookmark what a recording holds at a time, given as "file@time" in any form
+ * replay_seek() takes, or at its end, and show the changes since then.  This
+ * compares two recordings, or a recording with the server now.
+ */
+int
+bookmark_load(const char *arg)
+{
+	char	   *path,
+			   *at;
+	int			rc = -1;
+
+	if ((path = strdup(arg)) == NULL)
+		return -1;
+	if ((at = strrchr(path, '@')) != NULL)
+		*at++ = '\0';
+
+	if (replay_open(path) == 0)
+	{
+		if (replay_seek(at != NULL ? at : "end") == 0)
+		{
+			bookmark_set();
+			replay_foreach(bookmark_replayed);
+			since_bookmark = 1;
+			rc = 0;
+		}
+		else
+			errno = EINVAL;
+		replay_close();
+	}
+
+	free(path);
+	return rc;
+}
+
+/*
+ * Answer a query with the result kept for the bookmark, or with an error if
+ * there is none.
+ */
+PGresult *
+bookmark_exec(const char *query)
+{
+	struct bookmark_result *b = bookmark_find(query);
+
+	if (b == NULL)
+		return PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+
+	bm_taken = b->taken;
+	return PQcopyResult(b->res, PG_COPYRES_ATTRS | PG_COPYRES_TUPLES);
+}
+
+/*
+ * When the result last returned by bookmark_exec() was taken, on the clock
+ * pg_taken() uses.  Outside of replay that is the monotonic clock, which the
+ * wall clock time of the result is converted to.
+ */
+void
+bookmark_taken(struct timespec *ts)
+{
+	struct timespec mono,
+				wall;
+	double		t;
+
+	if (replaying)
+	{
+		*ts = bm_taken;
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	clock_gettime(CLOCK_REALTIME, &wall);
+	t = mono.tv_sec + mono.tv_nsec / 1e9 -
+		(wall.tv_sec - bm_taken.tv_sec) -
+		(wall.tv_nsec - bm_taken.tv_nsec) / 1e9;
+	ts->tv_sec = (time_t) t;
+	ts->tv_nsec = (long) ((t - ts->tv_sec) * 1e9);
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#ifndef _BOOKMARK_H_
+#define _BOOKMARK_H_
+
+#include <time.h>
+#include <libpq-fe.h>
+
+/*
+ * A bookmark keeps a copy of the result of every statistics query taken at
+ * one point in time.  In "since bookmark" mode each view is read twice per
+ * refresh, first from the bookmark and then as usual, so that its counters
+ * show the changes and rates over the whole time since the bookmark, without
+ * a single extra query.  A view visited for the first time after the bookmark
+ * was set is bookmarked on its first refresh.
+ */
+extern int	since_bookmark;
+extern int	reading_bookmark;
+
+void		bookmark_set(void);
+int			bookmark_load(const char *);
+int			bookmark_isset(void);
+time_t		bookmark_time(void);
+void		bookmark_add(const char *, const PGresult *);
+PGresult   *bookmark_exec(const char *);
+void		bookmark_taken(struct timespec *);
+
+#endif							/* _BOOKMARK_H_ */
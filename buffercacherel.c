@@ -14,6 +14,7 @@
 
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_BUFFERCACHEREL \
 		"SELECT bufferid, relfilenode, reltablespace, reldatabase, relforknumber,\n" \
@@ -23,6 +24,7 @@
 struct buffercacherel_t
 {
 	RB_ENTRY(buffercacherel_t) entry;
+	row_order	order;
 
 	char		bufferid[NAMEDATALEN + 1];
 	int64_t		relfilenode;
@@ -101,7 +103,7 @@ order_type	buffercacherel_order_list[] = {
 struct view_manager buffercacherel_mgr = {
 	"buffercacherel", select_buffercacherel, read_buffercacherel, sort_buffercacherel,
 	print_header, print_buffercacherel, keyboard_callback, buffercacherel_order_list,
-	buffercacherel_order_list
+	buffercacherel_order_list, NULL, NULL, NULL, TIER_EXPENSIVE
 };
 
 field_view	views_buffercacherel[] = {
@@ -122,14 +124,20 @@ buffercacherel_info(void)
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_BUFFERCACHEREL);
+		pgresult = pg_exec(QUERY_BUFFERCACHEREL);
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = buffercacherel_count;
 			buffercacherel_count = PQntuples(pgresult);
 		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
+		}
 	}
 	else
 	{
@@ -164,6 +172,8 @@ buffercacherel_info(void)
 			return;
 		}
 		strncpy(n->bufferid, PQgetvalue(pgresult, i, 0), NAMEDATALEN);
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(buffercacherel, &head_buffercacherels, n);
 		if (p != NULL)
 		{
@@ -212,6 +222,8 @@ initbuffercacherel(void)
 	buffercacherels = NULL;
 	buffercacherel_count = 0;
 
+	serve_allow(QUERY_BUFFERCACHEREL);
+
 	for (v = views_buffercacherel; v->name != NULL; v++)
 		add_view(v);
 	read_buffercacherel();
@@ -281,8 +293,9 @@ sort_buffercacherel(void)
 	if (buffercacherel_count <= 0)
 		return;
 
-	mergesort(buffercacherels, buffercacherel_count, sizeof(struct buffercacherel_t),
-			  ordering->func);
+	sort_rows(buffercacherels, buffercacherel_count,
+			  sizeof(struct buffercacherel_t),
+			  offsetof(struct buffercacherel_t, order), ordering->func);
 }
 
 int
@@ -14,6 +14,7 @@
 
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_BUFFERCACHESTAT \
 		"SELECT bufferid, isdirty, usagecount, pinning_backends\n" \
@@ -22,6 +23,7 @@
 struct buffercachestat_t
 {
 	RB_ENTRY(buffercachestat_t) entry;
+	row_order	order;
 
 	char		bufferid[NAMEDATALEN + 1];
 	int64_t		isdirty;
@@ -85,7 +87,7 @@ order_type	buffercachestat_order_list[] = {
 struct view_manager buffercachestat_mgr = {
 	"buffercachestat", select_buffercachestat, read_buffercachestat, sort_buffercachestat,
 	print_header, print_buffercachestat, keyboard_callback, buffercachestat_order_list,
-	buffercachestat_order_list
+	buffercachestat_order_list, NULL, NULL, NULL, TIER_EXPENSIVE
 };
 
 field_view	views_buffercachestat[] = {
@@ -106,14 +108,20 @@ buffercachestat_info(void)
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_BUFFERCACHESTAT);
+		pgresult = pg_exec(QUERY_BUFFERCACHESTAT);
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = buffercachestat_count;
 			buffercachestat_count = PQntuples(pgresult);
 		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
+		}
 	}
 	else
 	{
@@ -148,6 +156,8 @@ buffercachestat_info(void)
 			return;
 		}
 		strncpy(n->bufferid, PQgetvalue(pgresult, i, 0), NAMEDATALEN);
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(buffercachestat, &head_buffercachestats, n);
 		if (p != NULL)
 		{
@@ -194,6 +204,8 @@ initbuffercachestat(void)
 	buffercachestats = NULL;
 	buffercachestat_count = 0;
 
+	serve_allow(QUERY_BUFFERCACHESTAT);
+
 	for (v = views_buffercachestat; v->name != NULL; v++)
 		add_view(v);
 	read_buffercachestat();
@@ -259,8 +271,9 @@ sort_buffercachestat(void)
 	if (buffercachestat_count <= 0)
 		return;
 
-	mergesort(buffercachestats, buffercachestat_count, sizeof(struct buffercachestat_t),
-			  ordering->func);
+	sort_rows(buffercachestats, buffercachestat_count,
+			  sizeof(struct buffercachestat_t),
+			  offsetof(struct buffercachestat_t, order), ordering->func);
 }
 
 int
@@ -13,6 +13,7 @@
 
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_COPY_PROCESS \
 		"SELECT pid, relid, command, type, bytes_processed,\n" \
@@ -22,6 +23,7 @@
 struct copyprogress_t
 {
 	RB_ENTRY(copyprogress_t) entry;
+	row_order	order;
 
 	int64_t		pid;
 	int64_t		relid;
@@ -109,7 +111,7 @@ order_type	copyprogress_order_list[] = {
 struct view_manager copyprogress_mgr = {
 	"copyprogress", select_copyprogress, read_copyprogress, sort_copyprogress,
 	print_header, print_copyprogress, keyboard_callback, copyprogress_order_list,
-	copyprogress_order_list
+	copyprogress_order_list, NULL, NULL, NULL, TIER_PROGRESS
 };
 
 field_view	views_copyprogress[] = {
@@ -131,20 +133,26 @@ copyprogress_info(void)
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		if (PQserverVersion(options.connection) / 100 < 1300)
+		if (pg_server_version() / 100 < 1300)
 		{
 			copyprogress_exist = 0;
 			return;
 		}
 
-		pgresult = PQexec(options.connection, QUERY_STAT_COPY_PROCESS);
+		pgresult = pg_exec(QUERY_STAT_COPY_PROCESS);
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = copyprogress_count;
 			copyprogress_count = PQntuples(pgresult);
 		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
+		}
 	}
 	else
 	{
@@ -179,6 +187,8 @@ copyprogress_info(void)
 			return;
 		}
 		n->pid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(copyprogress, &head_copyprogresses, n);
 		if (p != NULL)
 		{
@@ -234,6 +244,8 @@ initcopyprogress(void)
 	copyprogresses = NULL;
 	copyprogress_count = 0;
 
+	serve_allow(QUERY_STAT_COPY_PROCESS);
+
 	read_copyprogress();
 	if (copyprogress_exist == 0)
 	{
@@ -305,8 +317,9 @@ sort_copyprogress(void)
 	if (copyprogress_count <= 0)
 		return;
 
-	mergesort(copyprogresses, copyprogress_count, sizeof(struct copyprogress_t),
-			  ordering->func);
+	sort_rows(copyprogresses, copyprogress_count,
+			  sizeof(struct copyprogress_t),
+			  offsetof(struct copyprogress_t, order), ordering->func);
 }
 
 int
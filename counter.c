@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bookmark.h"
+#include "counter.h"
+#include "pg.h"
+
+/*
+ * Grow every column of the set to hold "size" slots.  Columns are laid out
+ * back to back in one allocation, so each one has to be moved to its new
+ * offset.
+ */
+static int
+counter_grow(struct counter_set *cs, int size)
+{
+	int64_t    *arrays[3] = {cs->curr, cs->prev, cs->diff};
+	int64_t    *grown[3];
+	int			a,
+				col;
+
+	for (a = 0; a < 3; a++)
+	{
+		grown[a] = calloc((size_t) cs->ncols * size, sizeof(int64_t));
+		if (grown[a] == NULL)
+		{
+			while (--a >= 0)
+				free(grown[a]);
+			return -1;
+		}
+		if (arrays[a] == NULL)
+			continue;
+		for (col = 0; col < cs->ncols; col++)
+			memcpy(&grown[a][(size_t) col * size],
+				   &arrays[a][(size_t) col * cs->size],
+				   cs->nslots * sizeof(int64_t));
+	}
+
+	for (a = 0; a < 3; a++)
+		free(arrays[a]);
+	cs->curr = grown[0];
+	cs->prev = grown[1];
+	cs->diff = grown[2];
+	cs->size = size;
+
+	return 0;
+}
+
+/*
+ * Hand out the slot for a newly seen entity.  Returns -1 if the columns could
+ * not be grown.
+ */
+int
+counter_slot(struct counter_set *cs)
+{
+	if (cs->nslots >= cs->size &&
+		counter_grow(cs, cs->size > 0 ? cs->size * 2 : 64) == -1)
+		return -1;
+
+	return cs->nslots++;
+}
+
+/*
+ * Make the current snapshot the previous one before a new one is stored.  The
+ * current snapshot is copied rather than swapped in, so that the slot of an
+ * entity that is not seen this time, e.g. one filtered out, keeps its last
+ * values and shows no change instead of the one from two snapshots ago.
+ */
+void
+counter_advance(struct counter_set *cs)
+{
+	memcpy(cs->prev, cs->curr, (size_t) cs->ncols * cs->size *
+		   sizeof(int64_t));
+}
+
+/*
+ * Use the current snapshot of "slot", or of every slot if it is -1, as the
+ * baseline of the next difference, so that a new or reset entity shows no
+ * activity rather than its whole history.
+ */
+void
+counter_rebase(struct counter_set *cs, int slot)
+{
+	int			col;
+
+	if (slot == -1)
+	{
+		memcpy(cs->prev, cs->curr, (size_t) cs->ncols * cs->size *
+			   sizeof(int64_t));
+		return;
+	}
+
+	for (col = 0; col < cs->ncols; col++)
+		cs->prev[COUNTER_INDEX(cs, col, slot)] =
+			cs->curr[COUNTER_INDEX(cs, col, slot)];
+}
+
+/*
+ * Compute the difference between the current and previous snapshot of every
+ * counter in one pass over the contiguous columns.  A counter that went
+ * backwards was reset since the previous snapshot and counts as unchanged.
+ */
+void
+counter_diff(struct counter_set *cs)
+{
+	const int64_t *restrict curr = cs->curr;
+	const int64_t *restrict prev = cs->prev;
+	int64_t    *restrict diff = cs->diff;
+	size_t		i,
+				n = (size_t) cs->ncols * cs->size;
+
+	for (i = 0; i < n; i++)
+		diff[i] = curr[i] < prev[i] ? 0 : curr[i] - prev[i];
+}
+
+/*
+ * Stamp a snapshot that has just been fetched.
+ */
+void
+snapshot_clock_tick(struct snapshot_clock *clock)
+{
+	struct timespec now;
+
+	pg_taken(&now);
+
+	if (clock->taken.tv_sec == 0 && clock->taken.tv_nsec == 0)
+		clock->interval = 0;
+	else
+		clock->interval = (now.tv_sec - clock->taken.tv_sec) +
+			(now.tv_nsec - clock->taken.tv_nsec) / 1000000000.0;
+
+	clock->taken = now;
+}
+
+/*
+ * Per second rate of a counter difference over the last snapshot interval.
+ */
+double
+snapshot_rate(const struct snapshot_clock *clock, int64_t diff)
+{
+	if (clock->interval <= 0)
+		return 0;
+
+	return diff / clock->interval;
+}
+
+/*
+ * Compute how much of each moving average survives the last snapshot
+ * interval.
+ */
+void
+ewma_decay(const struct snapshot_clock *clock, double *decay)
+{
+	static const double window[EWMA_NAVG] = {60, 300, 900};
+	int			i;
+
+	for (i = 0; i < EWMA_NAVG; i++)
+		decay[i] = clock->interval > 0 ? exp(-clock->interval / window[i]) : 1;
+}
+
+void
+ewma_init(struct ewma *e)
+{
+	memset(e, 0, sizeof(struct ewma));
+	e->primed = -1;
+}
+
+/*
+ * Fold the rate of the last interval into the moving averages.  Nothing is
+ * folded in while "rebase" is set, or for a row's first snapshot, since their
+ * rate does not reflect any activity, nor while rates are shown since the
+ * bookmark, which are not rates of the last interval.
+ */
+void
+ewma_update(struct ewma *e, double rate, const double *decay, int rebase)
+{
+	int			i;
+
+	if (since_bookmark)
+		return;
+
+	if (rebase || e->primed == -1)
+	{
+		if (e->primed == -1)
+			e->primed = 0;
+		return;
+	}
+
+	for (i = 0; i < EWMA_NAVG; i++)
+		e->avg[i] = e->primed ? e->avg[i] * decay[i] + rate * (1 - decay[i]) :
+			rate;
+	e->primed = 1;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#ifndef _COUNTER_H_
+#define _COUNTER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Cumulative statistics counters kept column by column rather than scattered
+ * across each row's structure.  Every tracked entity owns a slot that indexes
+ * into each column; the current and previous snapshots as well as the
+ * computed differences are stored as separate contiguous arrays so that the
+ * per refresh arithmetic runs as a handful of tight, vectorizable loops.
+ */
+struct counter_set
+{
+	int			ncols;			/* number of counters per slot */
+	int			nslots;			/* slots handed out so far */
+	int			size;			/* slots allocated in each column */
+	int64_t    *curr;
+	int64_t    *prev;
+	int64_t    *diff;
+};
+
+#define COUNTER_SET_INITIALIZER(ncols) { (ncols), 0, 0, NULL, NULL, NULL }
+
+#define COUNTER_INDEX(cs, col, slot) ((size_t) (col) * (cs)->size + (slot))
+#define COUNTER_CURR(cs, col, slot) ((cs)->curr[COUNTER_INDEX(cs, col, slot)])
+#define COUNTER_DIFF(cs, col, slot) ((cs)->diff[COUNTER_INDEX(cs, col, slot)])
+
+/*
+ * Difference of a cumulative counter since the previous snapshot, or 0 when
+ * there is no comparable previous value: the row was just seen for the first
+ * time, its statistics were reset, or the counter went backwards.
+ */
+#define COUNTER_DELTA(curr, old, rebase) \
+	((rebase) || (curr) < (old) ? 0 : (curr) - (old))
+
+/*
+ * When a statistics snapshot was taken, by our own monotonic clock, and how
+ * many seconds passed since the previous snapshot.
+ * Rates are computed from this measured interval rather than the configured
+ * refresh delay, which a slow query or an early refresh would make wrong.
+ */
+struct snapshot_clock
+{
+	struct timespec taken;
+	double		interval;
+};
+
+/*
+ * Exponentially weighted moving averages of a per second rate over one, five
+ * and fifteen minutes, as in the load average.  The decay of each average
+ * depends only on the snapshot interval, so it is computed once per refresh
+ * and every row then costs three multiply-adds.  "primed" is -1 until the row
+ * has a first rate to start the averages from.
+ */
+#define EWMA_1M		0
+#define EWMA_5M		1
+#define EWMA_15M	2
+#define EWMA_NAVG	3
+
+struct ewma
+{
+	double		avg[EWMA_NAVG];
+	int			primed;
+};
+
+int			counter_slot(struct counter_set *);
+void		counter_advance(struct counter_set *);
+void		counter_rebase(struct counter_set *, int);
+void		counter_diff(struct counter_set *);
+
+void		snapshot_clock_tick(struct snapshot_clock *);
+double		snapshot_rate(const struct snapshot_clock *, int64_t);
+
+void		ewma_decay(const struct snapshot_clock *, double *);
+void		ewma_init(struct ewma *);
+void		ewma_update(struct ewma *, double, const double *, int);
+
+#endif							/* _COUNTER_H_ */
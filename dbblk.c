@@ -11,42 +11,54 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "exporter.h"
+#include "filter.h"
+#include "history.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_DBBLK \
 		"SELECT datid, coalesce(datname, '<shared relation objects>'),\n" \
 		"       blks_read, blks_hit, temp_files, temp_bytes,\n" \
-		"       blk_read_time, blk_write_time\n" \
-		"FROM pg_stat_database;"
+		"       blk_read_time, blk_write_time,\n" \
+		"       " STATS_EPOCH_DATABASE "\n" \
+		"FROM pg_stat_database"
+
+/* Columns of the dbblk counter set. */
+enum
+{
+	DBBLK_BLKS_READ,
+	DBBLK_BLKS_HIT,
+	DBBLK_TEMP_FILES,
+	DBBLK_TEMP_BYTES,
+	DBBLK_BLK_READ_TIME,
+	DBBLK_BLK_WRITE_TIME,
+	DBBLK_NCOUNTERS
+};
 
 struct dbblk_t
 {
 	RB_ENTRY(dbblk_t) entry;
+	row_order	order;
 	long long	datid;
 	char		datname[NAMEDATALEN + 1];
-	int64_t		blks_read;
-	int64_t		blks_read_diff;
-	int64_t		blks_read_old;
-	int64_t		blks_hit;
-	int64_t		blks_hit_diff;
-	int64_t		blks_hit_old;
-	int64_t		temp_files;
-	int64_t		temp_files_diff;
-	int64_t		temp_files_old;
-	int64_t		temp_bytes;
-	int64_t		temp_bytes_diff;
-	int64_t		temp_bytes_old;
-	int64_t		blk_read_time;
-	int64_t		blk_read_time_diff;
-	int64_t		blk_read_time_old;
-	int64_t		blk_write_time;
-	int64_t		blk_write_time_diff;
-	int64_t		blk_write_time_old;
+	int			slot;
+
+	/* share of the blocks found in the buffer cache, in percent */
+	int64_t		hit_per;
+
+	/* moving averages of blocks read per second */
+	struct ewma	read_avg;
+
+	/* recent blocks read per refresh, for the sparkline */
+	int			hist;
 };
 
 int			dbblkcmp(struct dbblk_t *, struct dbblk_t *);
 static void dbblk_info(void);
+void		export_dbblk(void);
 void		print_dbblk(void);
 int			read_dbblk(void);
 int			select_dbblk(void);
@@ -58,6 +70,9 @@ int			sort_dbblk_read_time_callback(const void *, const void *);
 int			sort_dbblk_temp_files_callback(const void *, const void *);
 int			sort_dbblk_temp_bytes_callback(const void *, const void *);
 int			sort_dbblk_write_time_callback(const void *, const void *);
+int			sort_dbblk_blks_read_1m_callback(const void *, const void *);
+int			sort_dbblk_blks_read_5m_callback(const void *, const void *);
+int			sort_dbblk_blks_read_15m_callback(const void *, const void *);
 
 RB_HEAD(dbblk, dbblk_t) head_dbblks = RB_INITIALIZER(&head_dbblks);
 RB_PROTOTYPE(dbblk, dbblk_t, entry, dbblkcmp)
@@ -92,6 +107,18 @@ field_def fields_dbblk[] =
 	{
 		"TMP_BYTES", 10, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
 	},
+	{
+		"READ_1M", 8, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"READ_5M", 8, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"READ_15M", 9, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"TREND", HISTORY_LEN, HISTORY_LEN, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
 };
 
 #define FLD_DB_DATNAME        FIELD_ADDR(fields_dbblk, 0)
@@ -103,12 +130,17 @@ field_def fields_dbblk[] =
 #define FLD_DB_BLK_WRITE_TIME FIELD_ADDR(fields_dbblk, 6)
 #define FLD_DB_TEMP_FILES     FIELD_ADDR(fields_dbblk, 7)
 #define FLD_DB_TEMP_BYTES     FIELD_ADDR(fields_dbblk, 8)
+#define FLD_DB_READ_1M        FIELD_ADDR(fields_dbblk, 9)
+#define FLD_DB_READ_5M        FIELD_ADDR(fields_dbblk, 10)
+#define FLD_DB_READ_15M       FIELD_ADDR(fields_dbblk, 11)
+#define FLD_DB_TREND          FIELD_ADDR(fields_dbblk, 12)
 
 /* Define views */
 field_def  *view_dbblk_0[] = {
-	FLD_DB_DATNAME, FLD_DB_BLKS_READ, FLD_DB_BLKS_READ_RATE, FLD_DB_BLKS_HIT,
-	FLD_DB_BLKS_HIT_PER, FLD_DB_BLK_READ_TIME, FLD_DB_BLK_WRITE_TIME,
-	FLD_DB_TEMP_FILES, FLD_DB_TEMP_BYTES, NULL
+	FLD_DB_DATNAME, FLD_DB_BLKS_READ, FLD_DB_BLKS_READ_RATE, FLD_DB_TREND,
+	FLD_DB_BLKS_HIT, FLD_DB_BLKS_HIT_PER, FLD_DB_BLK_READ_TIME,
+	FLD_DB_BLK_WRITE_TIME, FLD_DB_TEMP_FILES, FLD_DB_TEMP_BYTES,
+	FLD_DB_READ_1M, FLD_DB_READ_5M, FLD_DB_READ_15M, NULL
 };
 
 order_type	dbblk_order_list[] = {
@@ -119,13 +151,17 @@ order_type	dbblk_order_list[] = {
 	{"temp_bytes", "temp_bytes", 'b', sort_dbblk_temp_bytes_callback},
 	{"blk_read_time", "blk_read_time", 'R', sort_dbblk_read_time_callback},
 	{"blk_write_time", "blk_write_time", 'W', sort_dbblk_write_time_callback},
+	{"blks_read_1m", "blks_read_1m", '1', sort_dbblk_blks_read_1m_callback},
+	{"blks_read_5m", "blks_read_5m", '5', sort_dbblk_blks_read_5m_callback},
+	{"blks_read_15m", "blks_read_15m", 'F', sort_dbblk_blks_read_15m_callback},
 	{NULL, NULL, 0, NULL}
 };
 
 /* Define view managers */
 struct view_manager dbblk_mgr = {
 	"dbblk", select_dbblk, read_dbblk, sort_dbblk, print_header,
-	print_dbblk, keyboard_callback, dbblk_order_list, dbblk_order_list
+	print_dbblk, keyboard_callback, dbblk_order_list, dbblk_order_list,
+	NULL, export_dbblk, NULL, TIER_DATABASE
 };
 
 field_view	views_dbblk[] = {
@@ -135,24 +171,44 @@ field_view	views_dbblk[] = {
 
 int			dbblk_count;
 struct dbblk_t *dbblks;
+struct snapshot_clock dbblk_clock;
+struct stats_epoch dbblk_epoch;
+struct counter_set dbblk_counters = COUNTER_SET_INITIALIZER(DBBLK_NCOUNTERS);
+struct history dbblk_history = HISTORY_INITIALIZER;
+
+#define DBBLK_CURR(n, col) COUNTER_CURR(&dbblk_counters, col, (n)->slot)
+#define DBBLK_DIFF(n, col) COUNTER_DIFF(&dbblk_counters, col, (n)->slot)
 
 static void
 dbblk_info(void)
 {
 	int			i;
+	int			reset = 0;
+	double		decay[EWMA_NAVG];
 	PGresult   *pgresult = NULL;
 
 	struct dbblk_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_DBBLK);
+		pgresult = pg_exec(filter_query(QUERY_STAT_DBBLK, FILTER_DATABASES,
+										"datid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = dbblk_count;
 			dbblk_count = PQntuples(pgresult);
+			reset = stats_reset(&dbblk_epoch, pgresult, 8);
+			snapshot_clock_tick(&dbblk_clock);
+			ewma_decay(&dbblk_clock, decay);
+			history_advance(&dbblk_history);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -175,6 +231,7 @@ dbblk_info(void)
 		dbblks = p;
 	}
 
+	counter_advance(&dbblk_counters);
 	for (i = 0; i < dbblk_count; i++)
 	{
 		n = malloc(sizeof(struct dbblk_t));
@@ -187,41 +244,64 @@ dbblk_info(void)
 			return;
 		}
 		n->datid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(dbblk, &head_dbblks, n);
 		if (p == NULL)
+		{
 			strncpy(n->datname, PQgetvalue(pgresult, i, 1), NAMEDATALEN);
+			n->slot = counter_slot(&dbblk_counters);
+			if (n->slot == -1)
+			{
+				error("malloc error");
+				RB_REMOVE(dbblk, &head_dbblks, n);
+				free(n);
+				dbblk_count = i;
+				break;
+			}
+			n->hist = history_slot(&dbblk_history);
+		}
 		else
 		{
 			free(n);
 			n = p;
 		}
 
-		n->blks_read_old = n->blks_read;
-		n->blks_read = atoll(PQgetvalue(pgresult, i, 2));
-		n->blks_read_diff = n->blks_read - n->blks_read_old;
-
-		n->blks_hit_old = n->blks_hit;
-		n->blks_hit = atoll(PQgetvalue(pgresult, i, 3));
-		n->blks_hit_diff = n->blks_hit - n->blks_hit_old;
-
-		n->temp_files_old = n->temp_files;
-		n->temp_files = atoll(PQgetvalue(pgresult, i, 4));
-		n->temp_files_diff = n->temp_files - n->temp_files_old;
-
-		n->temp_bytes_old = n->temp_bytes;
-		n->temp_bytes = atoll(PQgetvalue(pgresult, i, 5));
-		n->temp_bytes_diff = n->temp_bytes - n->temp_bytes_old;
-
-		n->blk_read_time_old = n->blk_read_time;
-		n->blk_read_time = atoll(PQgetvalue(pgresult, i, 6));
-		n->blk_read_time_diff = n->blk_read_time - n->blk_read_time_old;
-
-		n->blk_write_time_old = n->blk_write_time;
-		n->blk_write_time = atoll(PQgetvalue(pgresult, i, 7));
-		n->blk_write_time_diff = n->blk_write_time - n->blk_write_time_old;
+		DBBLK_CURR(n, DBBLK_BLKS_READ) = atoll(PQgetvalue(pgresult, i, 2));
+		DBBLK_CURR(n, DBBLK_BLKS_HIT) = atoll(PQgetvalue(pgresult, i, 3));
+		DBBLK_CURR(n, DBBLK_TEMP_FILES) = atoll(PQgetvalue(pgresult, i, 4));
+		DBBLK_CURR(n, DBBLK_TEMP_BYTES) = atoll(PQgetvalue(pgresult, i, 5));
+		DBBLK_CURR(n, DBBLK_BLK_READ_TIME) = atoll(PQgetvalue(pgresult, i, 6));
+		DBBLK_CURR(n, DBBLK_BLK_WRITE_TIME) =
+			atoll(PQgetvalue(pgresult, i, 7));
+		if (p == NULL)
+		{
+			counter_rebase(&dbblk_counters, n->slot);
+			ewma_init(&n->read_avg);
+		}
 
 		memcpy(&dbblks[i], n, sizeof(struct dbblk_t));
 	}
+	if (reset)
+		counter_rebase(&dbblk_counters, -1);
+	counter_diff(&dbblk_counters);
+
+	for (i = 0; i < dbblk_count; i++)
+	{
+		int64_t		hit,
+					total;
+
+		n = dbblks[i].order.node;
+		hit = DBBLK_DIFF(n, DBBLK_BLKS_HIT);
+		total = hit + DBBLK_DIFF(n, DBBLK_BLKS_READ);
+		dbblks[i].hit_per = total > 0 ? 100 * hit / total : 0;
+		ewma_update(&n->read_avg,
+					snapshot_rate(&dbblk_clock,
+								  DBBLK_DIFF(n, DBBLK_BLKS_READ)),
+					decay, reset);
+		dbblks[i].read_avg = n->read_avg;
+		history_put(&dbblk_history, n->hist, DBBLK_DIFF(n, DBBLK_BLKS_READ));
+	}
 
 	if (pgresult != NULL)
 		PQclear(pgresult);
@@ -256,6 +336,8 @@ initdbblk(void)
 	dbblks = NULL;
 	dbblk_count = 0;
 
+	serve_allow_filtered(QUERY_STAT_DBBLK, FILTER_DATABASES, "datid");
+
 	for (v = views_dbblk; v->name != NULL; v++)
 		add_view(v);
 
@@ -270,7 +352,8 @@ print_dbblk(void)
 	int			cur = 0,
 				i;
 	int			end = dispstart + maxprint;
-	int			hit_per;
+	struct dbblk_t *n;
+	unsigned char levels[HISTORY_LEN];
 
 	if (end > num_disp)
 		end = num_disp;
@@ -279,26 +362,32 @@ print_dbblk(void)
 	{
 		do
 		{
-			if (dbblks[i].blks_read_diff + dbblks[i].blks_hit_diff > 0)
-				hit_per = 100 * dbblks[i].blks_hit_diff /
-					(dbblks[i].blks_read_diff + dbblks[i].blks_hit_diff);
-			else
-				hit_per = 0;
 			if (cur >= dispstart && cur < end)
 			{
-				print_fld_str(FLD_DB_DATNAME, dbblks[i].datname);
-				print_fld_uint(FLD_DB_BLKS_READ, dbblks[i].blks_read_diff);
-				print_fld_uint(FLD_DB_BLKS_READ_RATE,
-							   dbblks[i].blks_read_diff /
-							   ((int64_t) udelay / 1000000));
-				print_fld_ssize(FLD_DB_BLKS_HIT, dbblks[i].blks_hit_diff);
-				print_fld_ssize(FLD_DB_BLKS_HIT_PER, hit_per);
+				n = &dbblks[i];
+				print_fld_str(FLD_DB_DATNAME, n->datname);
+				print_fld_uint(FLD_DB_BLKS_READ,
+							   DBBLK_DIFF(n, DBBLK_BLKS_READ));
+				print_fld_rate(FLD_DB_BLKS_READ_RATE,
+							   snapshot_rate(&dbblk_clock,
+											 DBBLK_DIFF(n, DBBLK_BLKS_READ)));
+				print_fld_spark(FLD_DB_TREND, levels,
+								history_levels(&dbblk_history, n->hist,
+											   levels));
+				print_fld_ssize(FLD_DB_BLKS_HIT,
+								DBBLK_DIFF(n, DBBLK_BLKS_HIT));
+				print_fld_ssize(FLD_DB_BLKS_HIT_PER, n->hit_per);
 				print_fld_ssize(FLD_DB_BLK_READ_TIME,
-								dbblks[i].blk_read_time_diff);
+								DBBLK_DIFF(n, DBBLK_BLK_READ_TIME));
 				print_fld_ssize(FLD_DB_BLK_WRITE_TIME,
-								dbblks[i].blk_write_time_diff);
-				print_fld_ssize(FLD_DB_TEMP_FILES, dbblks[i].temp_files_diff);
-				print_fld_ssize(FLD_DB_TEMP_BYTES, dbblks[i].temp_bytes_diff);
+								DBBLK_DIFF(n, DBBLK_BLK_WRITE_TIME));
+				print_fld_ssize(FLD_DB_TEMP_FILES,
+								DBBLK_DIFF(n, DBBLK_TEMP_FILES));
+				print_fld_ssize(FLD_DB_TEMP_BYTES,
+								DBBLK_DIFF(n, DBBLK_TEMP_BYTES));
+				print_fld_rate(FLD_DB_READ_1M, n->read_avg.avg[EWMA_1M]);
+				print_fld_rate(FLD_DB_READ_5M, n->read_avg.avg[EWMA_5M]);
+				print_fld_rate(FLD_DB_READ_15M, n->read_avg.avg[EWMA_15M]);
 				end_line();
 			}
 			if (++cur >= end)
@@ -315,6 +404,54 @@ print_dbblk(void)
 	} while (0);
 }
 
+/* Columns of the dbblk counter set exported in listen mode. */
+static const struct
+{
+	const char *name;
+	const char *help;
+	int			col;
+}			dbblk_exports[] =
+{
+	{
+		"pg_stat_database_blks_read", "Disk blocks read.", DBBLK_BLKS_READ
+	},
+	{
+		"pg_stat_database_blks_hit", "Blocks found in the buffer cache.",
+		DBBLK_BLKS_HIT
+	},
+	{
+		"pg_stat_database_temp_files", "Temporary files created by queries.",
+		DBBLK_TEMP_FILES
+	},
+	{
+		"pg_stat_database_temp_bytes",
+		"Data written to temporary files by queries.", DBBLK_TEMP_BYTES
+	},
+	{
+		"pg_stat_database_blk_read_time_milliseconds",
+		"Time spent reading data file blocks.", DBBLK_BLK_READ_TIME
+	},
+	{
+		"pg_stat_database_blk_write_time_milliseconds",
+		"Time spent writing data file blocks.", DBBLK_BLK_WRITE_TIME
+	},
+};
+
+void
+export_dbblk(void)
+{
+	int			i,
+				j;
+
+	for (j = 0; j < sizeof(dbblk_exports) / sizeof(dbblk_exports[0]); j++)
+	{
+		export_family(dbblk_exports[j].name, "counter", dbblk_exports[j].help);
+		for (i = 0; i < dbblk_count; i++)
+			export_counter(dbblk_exports[j].name, "datname", dbblks[i].datname,
+						   DBBLK_CURR(&dbblks[i], dbblk_exports[j].col));
+	}
+}
+
 void
 sort_dbblk(void)
 {
@@ -334,7 +471,8 @@ sort_dbblk(void)
 	if (dbblk_count <= 0)
 		return;
 
-	mergesort(dbblks, dbblk_count, sizeof(struct dbblk_t), ordering->func);
+	sort_rows(dbblks, dbblk_count, sizeof(struct dbblk_t),
+			  offsetof(struct dbblk_t, order), ordering->func);
 }
 
 int
@@ -349,76 +487,58 @@ sort_dbblk_datname_callback(const void *v1, const void *v2)
 	return strcmp(n1->datname, n2->datname) * sortdir;
 }
 
-int
-sort_dbblk_hit_callback(const void *v1, const void *v2)
+static int
+sort_dbblk_counter(const void *v1, const void *v2, int col)
 {
-	struct dbblk_t *n1,
-			   *n2;
-
-	n1 = (struct dbblk_t *) v1;
-	n2 = (struct dbblk_t *) v2;
+	const struct dbblk_t *n1 = v1;
+	const struct dbblk_t *n2 = v2;
 
-	if (n1->blks_hit_diff < n2->blks_hit_diff)
+	if (DBBLK_DIFF(n1, col) < DBBLK_DIFF(n2, col))
 		return sortdir;
-	if (n1->blks_hit_diff > n2->blks_hit_diff)
+	if (DBBLK_DIFF(n1, col) > DBBLK_DIFF(n2, col))
 		return -sortdir;
 
 	return sort_dbblk_datname_callback(v1, v2);
 }
 
 int
-sort_dbblk_read_callback(const void *v1, const void *v2)
+sort_dbblk_hit_callback(const void *v1, const void *v2)
 {
-	struct dbblk_t *n1,
-			   *n2;
-
-	n1 = (struct dbblk_t *) v1;
-	n2 = (struct dbblk_t *) v2;
-
-	if (n1->blks_read_diff < n2->blks_read_diff)
-		return sortdir;
-	if (n1->blks_read_diff > n2->blks_read_diff)
-		return -sortdir;
+	return sort_dbblk_counter(v1, v2, DBBLK_BLKS_HIT);
+}
 
-	return sort_dbblk_datname_callback(v1, v2);
+int
+sort_dbblk_read_callback(const void *v1, const void *v2)
+{
+	return sort_dbblk_counter(v1, v2, DBBLK_BLKS_READ);
 }
 
 int
 sort_dbblk_read_time_callback(const void *v1, const void *v2)
 {
-	struct dbblk_t *n1,
-			   *n2;
-
-	n1 = (struct dbblk_t *) v1;
-	n2 = (struct dbblk_t *) v2;
-
-	if (n1->blk_read_time_diff < n2->blk_read_time_diff)
-		return sortdir;
-	if (n1->blk_read_time_diff > n2->blk_read_time_diff)
-		return -sortdir;
-
-	return sort_dbblk_datname_callback(v1, v2);
+	return sort_dbblk_counter(v1, v2, DBBLK_BLK_READ_TIME);
 }
 
 int
 sort_dbblk_temp_bytes_callback(const void *v1, const void *v2)
 {
-	struct dbblk_t *n1,
-			   *n2;
-
-	n1 = (struct dbblk_t *) v1;
-	n2 = (struct dbblk_t *) v2;
-
-	if (n1->temp_bytes_diff < n2->temp_bytes_diff)
-		return sortdir;
-	if (n1->temp_bytes_diff > n2->temp_bytes_diff)
-		return -sortdir;
-
-	return sort_dbblk_datname_callback(v1, v2);
+	return sort_dbblk_counter(v1, v2, DBBLK_TEMP_BYTES);
 }
 
 int
 sort_dbblk_temp_files_callback(const void *v1, const void *v2)
+{
+	return sort_dbblk_counter(v1, v2, DBBLK_TEMP_FILES);
+}
+
+int
+sort_dbblk_write_time_callback(const void *v1, const void *v2)
+{
+	return sort_dbblk_counter(v1, v2, DBBLK_BLK_WRITE_TIME);
+}
+
+static int
+sort_dbblk_blks_read(const void *v1, const void *v2, int avg)
 {
 	struct dbblk_t *n1,
 			   *n2;
@@ -426,27 +546,28 @@ sort_dbblk_temp_files_callback(const void *v1, const void *v2)
 	n1 = (struct dbblk_t *) v1;
 	n2 = (struct dbblk_t *) v2;
 
-	if (n1->temp_files < n2->temp_files)
+	if (n1->read_avg.avg[avg] < n2->read_avg.avg[avg])
 		return sortdir;
-	if (n1->temp_files > n2->temp_files)
+	if (n1->read_avg.avg[avg] > n2->read_avg.avg[avg])
 		return -sortdir;
 
 	return sort_dbblk_datname_callback(v1, v2);
 }
 
 int
-sort_dbblk_write_time_callback(const void *v1, const void *v2)
+sort_dbblk_blks_read_1m_callback(const void *v1, const void *v2)
 {
-	struct dbblk_t *n1,
-			   *n2;
-
-	n1 = (struct dbblk_t *) v1;
-	n2 = (struct dbblk_t *) v2;
+	return sort_dbblk_blks_read(v1, v2, EWMA_1M);
+}
 
-	if (n1->blk_write_time_diff < n2->blk_write_time_diff)
-		return sortdir;
-	if (n1->blk_write_time_diff > n2->blk_write_time_diff)
-		return -sortdir;
+int
+sort_dbblk_blks_read_5m_callback(const void *v1, const void *v2)
+{
+	return sort_dbblk_blks_read(v1, v2, EWMA_5M);
+}
 
-	return sort_dbblk_datname_callback(v1, v2);
+int
+sort_dbblk_blks_read_15m_callback(const void *v1, const void *v2)
+{
+	return sort_dbblk_blks_read(v1, v2, EWMA_15M);
 }
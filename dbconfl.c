@@ -11,19 +11,24 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "filter.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_DBCONFL \
 		"SELECT a.datid, a.datname, conflicts, confl_tablespace,\n" \
 		"       confl_lock, confl_snapshot, confl_bufferpin,\n" \
-		"       confl_deadlock\n" \
+		"       confl_deadlock,\n" \
+		"       " STATS_EPOCH_DATABASE "\n" \
 		"FROM pg_stat_database a, pg_stat_database_conflicts b\n" \
-		"WHERE a.datid = b.datid;"
+		"WHERE a.datid = b.datid"
 
 struct dbconfl_t
 {
 	RB_ENTRY(dbconfl_t) entry;
+	row_order	order;
 	long long	datid;
 	char		datname[NAMEDATALEN + 1];
 	int64_t		conflicts;
@@ -120,7 +125,8 @@ order_type	dbconfl_order_list[] = {
 /* Define view managers */
 struct view_manager dbconfl_mgr = {
 	"dbconfl", select_dbconfl, read_dbconfl, sort_dbconfl, print_header,
-	print_dbconfl, keyboard_callback, dbconfl_order_list, dbconfl_order_list
+	print_dbconfl, keyboard_callback, dbconfl_order_list, dbconfl_order_list,
+	NULL, NULL, NULL, TIER_DATABASE
 };
 
 field_view	views_dbconfl[] = {
@@ -130,24 +136,34 @@ field_view	views_dbconfl[] = {
 
 int			dbconfl_count;
 struct dbconfl_t *dbconfls;
+struct stats_epoch dbconfl_epoch;
 
 static void
 dbconfl_info(void)
 {
 	int			i;
+	int			reset = 0;
 	PGresult   *pgresult = NULL;
 
 	struct dbconfl_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_DBCONFL);
+		pgresult = pg_exec(filter_query(QUERY_STAT_DBCONFL, FILTER_DATABASES,
+										"a.datid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = dbconfl_count;
 			dbconfl_count = PQntuples(pgresult);
+			reset = stats_reset(&dbconfl_epoch, pgresult, 8);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -182,6 +198,8 @@ dbconfl_info(void)
 			return;
 		}
 		n->datid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(dbconfl, &head_dbconfls, n);
 		if (p == NULL)
 			strncpy(n->datname, PQgetvalue(pgresult, i, 1), NAMEDATALEN);
@@ -193,27 +211,37 @@ dbconfl_info(void)
 
 		n->conflicts_old = n->conflicts;
 		n->conflicts = atoll(PQgetvalue(pgresult, i, 2));
-		n->conflicts_diff = n->conflicts - n->conflicts_old;
+		n->conflicts_diff = COUNTER_DELTA(n->conflicts, n->conflicts_old,
+										  p == NULL || reset);
 
 		n->confl_tablespace_old = n->confl_tablespace;
 		n->confl_tablespace = atoll(PQgetvalue(pgresult, i, 3));
-		n->confl_tablespace_diff = n->confl_tablespace - n->confl_tablespace_old;
+		n->confl_tablespace_diff = COUNTER_DELTA(n->confl_tablespace,
+												 n->confl_tablespace_old,
+												 p == NULL || reset);
 
 		n->confl_lock_old = n->confl_lock;
 		n->confl_lock = atoll(PQgetvalue(pgresult, i, 4));
-		n->confl_lock_diff = n->confl_lock - n->confl_lock_old;
+		n->confl_lock_diff = COUNTER_DELTA(n->confl_lock, n->confl_lock_old,
+										   p == NULL || reset);
 
 		n->confl_snapshot_old = n->confl_snapshot;
 		n->confl_snapshot = atoll(PQgetvalue(pgresult, i, 5));
-		n->confl_snapshot_diff = n->confl_snapshot - n->confl_snapshot_old;
+		n->confl_snapshot_diff = COUNTER_DELTA(n->confl_snapshot,
+											   n->confl_snapshot_old,
+											   p == NULL || reset);
 
 		n->confl_bufferpin_old = n->confl_bufferpin;
 		n->confl_bufferpin = atoll(PQgetvalue(pgresult, i, 6));
-		n->confl_bufferpin_diff = n->confl_bufferpin - n->confl_bufferpin_old;
+		n->confl_bufferpin_diff = COUNTER_DELTA(n->confl_bufferpin,
+												n->confl_bufferpin_old,
+												p == NULL || reset);
 
 		n->confl_deadlock_old = n->confl_deadlock;
 		n->confl_deadlock = atoll(PQgetvalue(pgresult, i, 7));
-		n->confl_deadlock_diff = n->confl_deadlock - n->confl_deadlock_old;
+		n->confl_deadlock_diff = COUNTER_DELTA(n->confl_deadlock,
+											   n->confl_deadlock_old,
+											   p == NULL || reset);
 
 		memcpy(&dbconfls[i], n, sizeof(struct dbconfl_t));
 	}
@@ -251,6 +279,8 @@ initdbconfl(void)
 	dbconfls = NULL;
 	dbconfl_count = 0;
 
+	serve_allow_filtered(QUERY_STAT_DBCONFL, FILTER_DATABASES, "a.datid");
+
 	for (v = views_dbconfl; v->name != NULL; v++)
 		add_view(v);
 
@@ -322,7 +352,8 @@ sort_dbconfl(void)
 	if (dbconfl_count <= 0)
 		return;
 
-	mergesort(dbconfls, dbconfl_count, sizeof(struct dbconfl_t), ordering->func);
+	sort_rows(dbconfls, dbconfl_count, sizeof(struct dbconfl_t),
+			  offsetof(struct dbconfl_t, order), ordering->func);
 }
 
 int
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #ifdef __linux__
 #include <bsd/stdlib.h>
+#include <bsd/string.h>
 #include <bsd/sys/tree.h>
 #endif							/* __linux__ */
 #include <limits.h>
@@ -16,6 +17,7 @@
 
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_DBFS \
 		"SELECT spcname,\n" \
@@ -26,6 +28,7 @@
 struct dbfs_t
 {
 	RB_ENTRY(dbfs_t) entry;
+	row_order	order;
 	char		spcname[NAMEDATALEN + 1];
 	char		path[PATH_MAX];
 	struct statfs buf;
@@ -112,14 +115,20 @@ dbfs_info(void)
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_DBFS);
+		pgresult = pg_exec(QUERY_STAT_DBFS);
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = dbfs_count;
 			dbfs_count = PQntuples(pgresult);
 		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
+		}
 	}
 	else
 	{
@@ -154,13 +163,15 @@ dbfs_info(void)
 		}
 
 		strncpy(n->spcname, PQgetvalue(pgresult, i, 0), NAMEDATALEN);
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(dbfs, &head_dbfss, n);
 		if (p != NULL)
 		{
 			free(n);
 			n = p;
 		}
-		strncpy(n->path, PQgetvalue(pgresult, i, 1), PATH_MAX);
+		strlcpy(n->path, PQgetvalue(pgresult, i, 1), sizeof(n->path));
 
 		memcpy(&n->buf_prev, &n->buf, sizeof(struct statfs));
 		if (statfs(n->path, &n->buf) != 0)
@@ -202,6 +213,8 @@ initdbfs(void)
 	dbfss = NULL;
 	dbfs_count = 0;
 
+	serve_allow(QUERY_STAT_DBFS);
+
 	for (v = views_dbfs; v->name != NULL; v++)
 		add_view(v);
 
@@ -279,7 +292,8 @@ sort_dbfs(void)
 	if (dbfs_count <= 0)
 		return;
 
-	mergesort(dbfss, dbfs_count, sizeof(struct dbfs_t), ordering->func);
+	sort_rows(dbfss, dbfs_count, sizeof(struct dbfs_t),
+			  offsetof(struct dbfs_t, order), ordering->func);
 }
 
 int
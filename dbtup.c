@@ -11,18 +11,25 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "exporter.h"
+#include "filter.h"
+#include "history.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_DBTUP \
 		"SELECT datid, coalesce(datname, '<shared relation objects>'),\n" \
 		"       tup_returned, tup_fetched, tup_inserted, tup_updated,\n" \
-		"       tup_deleted\n" \
-		"FROM pg_stat_database;"
+		"       tup_deleted,\n" \
+		"       " STATS_EPOCH_DATABASE "\n" \
+		"FROM pg_stat_database"
 
 struct dbtup_t
 {
 	RB_ENTRY(dbtup_t) entry;
+	row_order	order;
 	long long	datid;
 	char		datname[NAMEDATALEN + 1];
 	int64_t		tup_returned;
@@ -40,6 +47,12 @@ struct dbtup_t
 	int64_t		tup_deleted;
 	int64_t		tup_deleted_diff;
 	int64_t		tup_deleted_old;
+
+	/* moving averages of rows written per second */
+	struct ewma	write_avg;
+
+	/* recent rows written per refresh, for the sparkline */
+	int			hist;
 };
 
 int			dbtupcmp(struct dbtup_t *, struct dbtup_t *);
@@ -47,6 +60,7 @@ void		print_dbtup(void);
 int			read_dbtup(void);
 int			select_dbtup(void);
 static void dbtup_info(void);
+void		export_dbtup(void);
 void		sort_dbtup(void);
 int			sort_dbtup_datname_callback(const void *, const void *);
 int			sort_dbtup_deleted_callback(const void *, const void *);
@@ -54,6 +68,9 @@ int			sort_dbtup_fetched_callback(const void *, const void *);
 int			sort_dbtup_inserted_callback(const void *, const void *);
 int			sort_dbtup_returned_callback(const void *, const void *);
 int			sort_dbtup_updated_callback(const void *, const void *);
+int			sort_dbtup_writes_1m_callback(const void *, const void *);
+int			sort_dbtup_writes_5m_callback(const void *, const void *);
+int			sort_dbtup_writes_15m_callback(const void *, const void *);
 
 RB_HEAD(dbtup, dbtup_t) head_dbtups = RB_INITIALIZER(&head_dbtups);
 RB_PROTOTYPE(dbtup, dbtup_t, entry, dbtupcmp)
@@ -85,6 +102,18 @@ field_def fields_dbtup[] =
 	{
 		"DELETED", 8, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
 	},
+	{
+		"W_1M", 5, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"W_5M", 5, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"W_15M", 6, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"TREND", HISTORY_LEN, HISTORY_LEN, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
 };
 
 #define FLD_DB_DATNAME       FIELD_ADDR(fields_dbtup, 0)
@@ -95,12 +124,17 @@ field_def fields_dbtup[] =
 #define FLD_DB_TUP_INSERTED  FIELD_ADDR(fields_dbtup, 5)
 #define FLD_DB_TUP_UPDATED   FIELD_ADDR(fields_dbtup, 6)
 #define FLD_DB_TUP_DELETED   FIELD_ADDR(fields_dbtup, 7)
+#define FLD_DB_TUP_W_1M      FIELD_ADDR(fields_dbtup, 8)
+#define FLD_DB_TUP_W_5M      FIELD_ADDR(fields_dbtup, 9)
+#define FLD_DB_TUP_W_15M     FIELD_ADDR(fields_dbtup, 10)
+#define FLD_DB_TUP_TREND     FIELD_ADDR(fields_dbtup, 11)
 
 /* Define views */
 field_def  *view_dbtup_0[] = {
-	FLD_DB_DATNAME, FLD_DB_TUP_R_S, FLD_DB_TUP_W_S, FLD_DB_TUP_RETURNED,
-	FLD_DB_TUP_FETCHED, FLD_DB_TUP_INSERTED, FLD_DB_TUP_UPDATED,
-	FLD_DB_TUP_DELETED, NULL
+	FLD_DB_DATNAME, FLD_DB_TUP_R_S, FLD_DB_TUP_W_S, FLD_DB_TUP_TREND,
+	FLD_DB_TUP_RETURNED, FLD_DB_TUP_FETCHED, FLD_DB_TUP_INSERTED,
+	FLD_DB_TUP_UPDATED, FLD_DB_TUP_DELETED, FLD_DB_TUP_W_1M, FLD_DB_TUP_W_5M,
+	FLD_DB_TUP_W_15M, NULL
 };
 
 order_type	dbtup_order_list[] = {
@@ -110,13 +144,17 @@ order_type	dbtup_order_list[] = {
 	{"tup_inserted", "tup_inserted", 'i', sort_dbtup_inserted_callback},
 	{"tup_updated", "tup_updated", 'u', sort_dbtup_updated_callback},
 	{"tup_deleted", "tup_deleted", 'd', sort_dbtup_deleted_callback},
+	{"writes_1m", "writes_1m", '1', sort_dbtup_writes_1m_callback},
+	{"writes_5m", "writes_5m", '5', sort_dbtup_writes_5m_callback},
+	{"writes_15m", "writes_15m", 'F', sort_dbtup_writes_15m_callback},
 	{NULL, NULL, 0, NULL}
 };
 
 /* Define view managers */
 struct view_manager dbtup_mgr = {
 	"dbtub", select_dbtup, read_dbtup, sort_dbtup, print_header, print_dbtup,
-	keyboard_callback, dbtup_order_list, dbtup_order_list
+	keyboard_callback, dbtup_order_list, dbtup_order_list, NULL, export_dbtup,
+	NULL, TIER_DATABASE
 };
 
 field_view	views_dbtup[] = {
@@ -126,24 +164,40 @@ field_view	views_dbtup[] = {
 
 int			dbtup_count;
 struct dbtup_t *dbtups;
+struct snapshot_clock dbtup_clock;
+struct stats_epoch dbtup_epoch;
+struct history dbtup_history = HISTORY_INITIALIZER;
 
 static void
 dbtup_info(void)
 {
 	int			i;
+	int			reset = 0;
+	double		decay[EWMA_NAVG];
 	PGresult   *pgresult = NULL;
 
 	struct dbtup_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_DBTUP);
+		pgresult = pg_exec(filter_query(QUERY_STAT_DBTUP, FILTER_DATABASES,
+										"datid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = dbtup_count;
 			dbtup_count = PQntuples(pgresult);
+			reset = stats_reset(&dbtup_epoch, pgresult, 7);
+			snapshot_clock_tick(&dbtup_clock);
+			ewma_decay(&dbtup_clock, decay);
+			history_advance(&dbtup_history);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -178,9 +232,14 @@ dbtup_info(void)
 			return;
 		}
 		n->datid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(dbtup, &head_dbtups, n);
 		if (p == NULL)
+		{
 			strncpy(n->datname, PQgetvalue(pgresult, i, 1), NAMEDATALEN);
+			n->hist = history_slot(&dbtup_history);
+		}
 		else
 		{
 			free(n);
@@ -188,23 +247,39 @@ dbtup_info(void)
 		}
 		n->tup_returned_old = n->tup_returned;
 		n->tup_returned = atoll(PQgetvalue(pgresult, i, 2));
-		n->tup_returned_diff = n->tup_returned - n->tup_returned_old;
+		n->tup_returned_diff = COUNTER_DELTA(n->tup_returned,
+											 n->tup_returned_old,
+											 p == NULL || reset);
 
 		n->tup_fetched_old = n->tup_fetched;
 		n->tup_fetched = atoll(PQgetvalue(pgresult, i, 3));
-		n->tup_fetched_diff = n->tup_fetched - n->tup_fetched_old;
+		n->tup_fetched_diff = COUNTER_DELTA(n->tup_fetched, n->tup_fetched_old,
+											p == NULL || reset);
 
 		n->tup_inserted_old = n->tup_inserted;
 		n->tup_inserted = atoll(PQgetvalue(pgresult, i, 4));
-		n->tup_inserted_diff = n->tup_inserted - n->tup_inserted_old;
+		n->tup_inserted_diff = COUNTER_DELTA(n->tup_inserted,
+											 n->tup_inserted_old,
+											 p == NULL || reset);
 
 		n->tup_updated_old = n->tup_updated;
 		n->tup_updated = atoll(PQgetvalue(pgresult, i, 5));
-		n->tup_updated_diff = n->tup_updated - n->tup_updated_old;
+		n->tup_updated_diff = COUNTER_DELTA(n->tup_updated, n->tup_updated_old,
+											p == NULL || reset);
 
 		n->tup_deleted_old = n->tup_deleted;
 		n->tup_deleted = atoll(PQgetvalue(pgresult, i, 6));
-		n->tup_deleted_diff = n->tup_deleted - n->tup_deleted_old;
+		n->tup_deleted_diff = COUNTER_DELTA(n->tup_deleted, n->tup_deleted_old,
+											p == NULL || reset);
+
+		if (p == NULL)
+			ewma_init(&n->write_avg);
+		ewma_update(&n->write_avg,
+					snapshot_rate(&dbtup_clock, n->tup_inserted_diff +
+								  n->tup_updated_diff + n->tup_deleted_diff),
+					decay, p == NULL || reset);
+		history_put(&dbtup_history, n->hist, n->tup_inserted_diff +
+					n->tup_updated_diff + n->tup_deleted_diff);
 
 		memcpy(&dbtups[i], n, sizeof(struct dbtup_t));
 	}
@@ -242,6 +317,8 @@ initdbtup(void)
 	dbtups = NULL;
 	dbtup_count = 0;
 
+	serve_allow_filtered(QUERY_STAT_DBTUP, FILTER_DATABASES, "datid");
+
 	for (v = views_dbtup; v->name != NULL; v++)
 		add_view(v);
 
@@ -256,6 +333,7 @@ print_dbtup(void)
 	int			cur = 0,
 				i;
 	int			end = dispstart + maxprint;
+	unsigned char levels[HISTORY_LEN];
 
 	if (end > num_disp)
 		end = num_disp;
@@ -267,14 +345,17 @@ print_dbtup(void)
 			if (cur >= dispstart && cur < end)
 			{
 				print_fld_str(FLD_DB_DATNAME, dbtups[i].datname);
-				print_fld_ssize(FLD_DB_TUP_R_S,
-								dbtups[i].tup_returned_diff /
-								((int64_t) udelay / 1000000));
-				print_fld_ssize(FLD_DB_TUP_W_S,
-								(dbtups[i].tup_inserted_diff +
-								 dbtups[i].tup_updated_diff +
-								 dbtups[i].tup_deleted_diff) /
-								((int64_t) udelay / 1000000));
+				print_fld_rate(FLD_DB_TUP_R_S,
+							   snapshot_rate(&dbtup_clock,
+											 dbtups[i].tup_returned_diff));
+				print_fld_rate(FLD_DB_TUP_W_S,
+							   snapshot_rate(&dbtup_clock,
+											 dbtups[i].tup_inserted_diff +
+											 dbtups[i].tup_updated_diff +
+											 dbtups[i].tup_deleted_diff));
+				print_fld_spark(FLD_DB_TUP_TREND, levels,
+								history_levels(&dbtup_history,
+											   dbtups[i].hist, levels));
 				print_fld_ssize(FLD_DB_TUP_RETURNED,
 								dbtups[i].tup_returned_diff);
 				print_fld_ssize(FLD_DB_TUP_FETCHED,
@@ -285,6 +366,12 @@ print_dbtup(void)
 								dbtups[i].tup_updated_diff);
 				print_fld_ssize(FLD_DB_TUP_DELETED,
 								dbtups[i].tup_deleted_diff);
+				print_fld_rate(FLD_DB_TUP_W_1M,
+							   dbtups[i].write_avg.avg[EWMA_1M]);
+				print_fld_rate(FLD_DB_TUP_W_5M,
+							   dbtups[i].write_avg.avg[EWMA_5M]);
+				print_fld_rate(FLD_DB_TUP_W_15M,
+							   dbtups[i].write_avg.avg[EWMA_15M]);
 				end_line();
 			}
 			if (++cur >= end)
@@ -301,6 +388,52 @@ print_dbtup(void)
 	} while (0);
 }
 
+/* Counters of struct dbtup_t exported in listen mode. */
+static const struct
+{
+	const char *name;
+	const char *help;
+	size_t		offset;
+}			dbtup_exports[] =
+{
+	{
+		"pg_stat_database_tup_returned", "Rows returned by queries.",
+		offsetof(struct dbtup_t, tup_returned)
+	},
+	{
+		"pg_stat_database_tup_fetched", "Rows fetched by queries.",
+		offsetof(struct dbtup_t, tup_fetched)
+	},
+	{
+		"pg_stat_database_tup_inserted", "Rows inserted by queries.",
+		offsetof(struct dbtup_t, tup_inserted)
+	},
+	{
+		"pg_stat_database_tup_updated", "Rows updated by queries.",
+		offsetof(struct dbtup_t, tup_updated)
+	},
+	{
+		"pg_stat_database_tup_deleted", "Rows deleted by queries.",
+		offsetof(struct dbtup_t, tup_deleted)
+	},
+};
+
+void
+export_dbtup(void)
+{
+	int			i,
+				j;
+
+	for (j = 0; j < sizeof(dbtup_exports) / sizeof(dbtup_exports[0]); j++)
+	{
+		export_family(dbtup_exports[j].name, "counter", dbtup_exports[j].help);
+		for (i = 0; i < dbtup_count; i++)
+			export_counter(dbtup_exports[j].name, "datname", dbtups[i].datname,
+						   *(int64_t *) ((char *) &dbtups[i] +
+										 dbtup_exports[j].offset));
+	}
+}
+
 void
 sort_dbtup(void)
 {
@@ -320,7 +453,8 @@ sort_dbtup(void)
 	if (dbtup_count <= 0)
 		return;
 
-	mergesort(dbtups, dbtup_count, sizeof(struct dbtup_t), ordering->func);
+	sort_rows(dbtups, dbtup_count, sizeof(struct dbtup_t),
+			  offsetof(struct dbtup_t, order), ordering->func);
 }
 int
 sort_dbtup_datname_callback(const void *v1, const void *v2)
@@ -418,3 +552,38 @@ sort_dbtup_updated_callback(const void *v1, const void *v2)
 
 	return sort_dbtup_datname_callback(v1, v2);
 }
+
+static int
+sort_dbtup_writes(const void *v1, const void *v2, int avg)
+{
+	struct dbtup_t *n1,
+			   *n2;
+
+	n1 = (struct dbtup_t *) v1;
+	n2 = (struct dbtup_t *) v2;
+
+	if (n1->write_avg.avg[avg] < n2->write_avg.avg[avg])
+		return sortdir;
+	if (n1->write_avg.avg[avg] > n2->write_avg.avg[avg])
+		return -sortdir;
+
+	return sort_dbtup_datname_callback(v1, v2);
+}
+
+int
+sort_dbtup_writes_1m_callback(const void *v1, const void *v2)
+{
+	return sort_dbtup_writes(v1, v2, EWMA_1M);
+}
+
+int
+sort_dbtup_writes_5m_callback(const void *v1, const void *v2)
+{
+	return sort_dbtup_writes(v1, v2, EWMA_5M);
+}
+
+int
+sort_dbtup_writes_15m_callback(const void *v1, const void *v2)
+{
+	return sort_dbtup_writes(v1, v2, EWMA_15M);
+}
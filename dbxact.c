@@ -11,17 +11,24 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "exporter.h"
+#include "filter.h"
+#include "history.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_DBXACT \
 		"SELECT datid, coalesce(datname, '<shared relation objects>'),\n" \
-		"       numbackends, xact_commit, xact_rollback, deadlocks\n" \
-		"FROM pg_stat_database;"
+		"       numbackends, xact_commit, xact_rollback, deadlocks,\n" \
+		"       " STATS_EPOCH_DATABASE "\n" \
+		"FROM pg_stat_database"
 
 struct dbxact_t
 {
 	RB_ENTRY(dbxact_t) entry;
+	row_order	order;
 	long long	datid;
 	char		datname[NAMEDATALEN + 1];
 	unsigned int numbackends;
@@ -34,10 +41,17 @@ struct dbxact_t
 	int64_t		deadlocks;
 	int64_t		deadlocks_diff;
 	int64_t		deadlocks_old;
+
+	/* moving averages of transactions per second */
+	struct ewma	xact_avg;
+
+	/* recent transactions per refresh, for the sparkline */
+	int			hist;
 };
 
 int			dbxactcmp(struct dbxact_t *, struct dbxact_t *);
 static void dbxact_info(void);
+void		export_dbxact(void);
 void		print_dbxact(void);
 int			read_dbxact(void);
 int			select_dbxact(void);
@@ -47,6 +61,9 @@ int			sort_dbxact_datname_callback(const void *, const void *);
 int			sort_dbxact_deadlocks_callback(const void *, const void *);
 int			sort_dbxact_numbackends_callback(const void *, const void *);
 int			sort_dbxact_rollback_callback(const void *, const void *);
+int			sort_dbxact_tps_1m_callback(const void *, const void *);
+int			sort_dbxact_tps_5m_callback(const void *, const void *);
+int			sort_dbxact_tps_15m_callback(const void *, const void *);
 
 RB_HEAD(dbxact, dbxact_t) head_dbxacts = RB_INITIALIZER(&head_dbxacts);
 RB_PROTOTYPE(dbxact, dbxact_t, entry, dbxactcmp)
@@ -75,6 +92,18 @@ field_def fields_dbxact[] =
 	{
 		"DEADLOCKS", 10, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
 	},
+	{
+		"TPS_1M", 7, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"TPS_5M", 7, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"TPS_15M", 8, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"TREND", HISTORY_LEN, HISTORY_LEN, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
 };
 
 #define FLD_DB_DATNAME       FIELD_ADDR(fields_dbxact, 0)
@@ -84,12 +113,17 @@ field_def fields_dbxact[] =
 #define FLD_DB_XACT_ROLLBACK FIELD_ADDR(fields_dbxact, 4)
 #define FLD_DB_XACT_ROLLBACK_RATE   FIELD_ADDR(fields_dbxact, 5)
 #define FLD_DB_DEADLOCKS     FIELD_ADDR(fields_dbxact, 6)
+#define FLD_DB_TPS_1M               FIELD_ADDR(fields_dbxact, 7)
+#define FLD_DB_TPS_5M               FIELD_ADDR(fields_dbxact, 8)
+#define FLD_DB_TPS_15M              FIELD_ADDR(fields_dbxact, 9)
+#define FLD_DB_TREND                FIELD_ADDR(fields_dbxact, 10)
 
 /* Define views */
 field_def  *view_dbxact_0[] = {
 	FLD_DB_DATNAME, FLD_DB_NUMBACKENDS, FLD_DB_XACT_COMMIT,
 	FLD_DB_XACT_COMMIT_RATE, FLD_DB_XACT_ROLLBACK, FLD_DB_XACT_ROLLBACK_RATE,
-	FLD_DB_DEADLOCKS, NULL
+	FLD_DB_TREND, FLD_DB_DEADLOCKS, FLD_DB_TPS_1M, FLD_DB_TPS_5M,
+	FLD_DB_TPS_15M, NULL
 };
 
 order_type	dbxact_order_list[] = {
@@ -98,13 +132,17 @@ order_type	dbxact_order_list[] = {
 	{"xact_commit", "xact_commit", 'c', sort_dbxact_commit_callback},
 	{"xact_rollback", "xact_rollback", 'r', sort_dbxact_rollback_callback},
 	{"deadlocks", "deadlocks", 'd', sort_dbxact_deadlocks_callback},
+	{"tps_1m", "tps_1m", '1', sort_dbxact_tps_1m_callback},
+	{"tps_5m", "tps_5m", '5', sort_dbxact_tps_5m_callback},
+	{"tps_15m", "tps_15m", 'F', sort_dbxact_tps_15m_callback},
 	{NULL, NULL, 0, NULL}
 };
 
 /* Define view managers */
 struct view_manager dbxact_mgr = {
 	"dbxact", select_dbxact, read_dbxact, sort_dbxact, print_header,
-	print_dbxact, keyboard_callback, dbxact_order_list, dbxact_order_list
+	print_dbxact, keyboard_callback, dbxact_order_list, dbxact_order_list,
+	NULL, export_dbxact, NULL, TIER_DATABASE
 };
 
 field_view	views_dbxact[] = {
@@ -114,24 +152,40 @@ field_view	views_dbxact[] = {
 
 int			dbxact_count;
 struct dbxact_t *dbxacts;
+struct snapshot_clock dbxact_clock;
+struct stats_epoch dbxact_epoch;
+struct history dbxact_history = HISTORY_INITIALIZER;
 
 static void
 dbxact_info(void)
 {
 	int			i;
+	int			reset = 0;
+	double		decay[EWMA_NAVG];
 	PGresult   *pgresult = NULL;
 
 	struct dbxact_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_DBXACT);
+		pgresult = pg_exec(filter_query(QUERY_STAT_DBXACT, FILTER_DATABASES,
+										"datid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = dbxact_count;
 			dbxact_count = PQntuples(pgresult);
+			reset = stats_reset(&dbxact_epoch, pgresult, 6);
+			snapshot_clock_tick(&dbxact_clock);
+			ewma_decay(&dbxact_clock, decay);
+			history_advance(&dbxact_history);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -166,9 +220,14 @@ dbxact_info(void)
 			return;
 		}
 		n->datid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(dbxact, &head_dbxacts, n);
 		if (p == NULL)
+		{
 			strncpy(n->datname, PQgetvalue(pgresult, i, 1), NAMEDATALEN);
+			n->hist = history_slot(&dbxact_history);
+		}
 		else
 		{
 			free(n);
@@ -178,15 +237,28 @@ dbxact_info(void)
 
 		n->xact_commit_old = n->xact_commit;
 		n->xact_commit = atoll(PQgetvalue(pgresult, i, 3));
-		n->xact_commit_diff = n->xact_commit - n->xact_commit_old;
+		n->xact_commit_diff = COUNTER_DELTA(n->xact_commit, n->xact_commit_old,
+											p == NULL || reset);
 
 		n->xact_rollback_old = n->xact_rollback;
 		n->xact_rollback = atoll(PQgetvalue(pgresult, i, 4));
-		n->xact_rollback_diff = n->xact_rollback - n->xact_rollback_old;
+		n->xact_rollback_diff = COUNTER_DELTA(n->xact_rollback,
+											  n->xact_rollback_old,
+											  p == NULL || reset);
 
 		n->deadlocks_old = n->deadlocks;
 		n->deadlocks = atoll(PQgetvalue(pgresult, i, 5));
-		n->deadlocks_diff = n->deadlocks - n->deadlocks_old;
+		n->deadlocks_diff = COUNTER_DELTA(n->deadlocks, n->deadlocks_old,
+										  p == NULL || reset);
+
+		if (p == NULL)
+			ewma_init(&n->xact_avg);
+		ewma_update(&n->xact_avg,
+					snapshot_rate(&dbxact_clock,
+								  n->xact_commit_diff + n->xact_rollback_diff),
+					decay, p == NULL || reset);
+		history_put(&dbxact_history, n->hist,
+					n->xact_commit_diff + n->xact_rollback_diff);
 
 		memcpy(&dbxacts[i], n, sizeof(struct dbxact_t));
 	}
@@ -224,6 +296,8 @@ initdbxact(void)
 	dbxacts = NULL;
 	dbxact_count = 0;
 
+	serve_allow_filtered(QUERY_STAT_DBXACT, FILTER_DATABASES, "datid");
+
 	for (v = views_dbxact; v->name != NULL; v++)
 		add_view(v);
 
@@ -238,6 +312,7 @@ print_dbxact(void)
 	int			cur = 0,
 				i;
 	int			end = dispstart + maxprint;
+	unsigned char levels[HISTORY_LEN];
 
 	if (end > num_disp)
 		end = num_disp;
@@ -252,15 +327,24 @@ print_dbxact(void)
 				print_fld_uint(FLD_DB_NUMBACKENDS, dbxacts[i].numbackends);
 				print_fld_ssize(FLD_DB_XACT_COMMIT,
 								dbxacts[i].xact_commit_diff);
-				print_fld_ssize(FLD_DB_XACT_COMMIT_RATE,
-								dbxacts[i].xact_commit_diff /
-								((int64_t) udelay / 1000000));
+				print_fld_rate(FLD_DB_XACT_COMMIT_RATE,
+							   snapshot_rate(&dbxact_clock,
+											 dbxacts[i].xact_commit_diff));
 				print_fld_ssize(FLD_DB_XACT_ROLLBACK,
 								dbxacts[i].xact_rollback_diff);
-				print_fld_ssize(FLD_DB_XACT_ROLLBACK_RATE,
-								dbxacts[i].xact_rollback_diff /
-								((int64_t) udelay / 1000000));
+				print_fld_rate(FLD_DB_XACT_ROLLBACK_RATE,
+							   snapshot_rate(&dbxact_clock,
+											 dbxacts[i].xact_rollback_diff));
+				print_fld_spark(FLD_DB_TREND, levels,
+								history_levels(&dbxact_history,
+											   dbxacts[i].hist, levels));
 				print_fld_ssize(FLD_DB_DEADLOCKS, dbxacts[i].deadlocks_diff);
+				print_fld_rate(FLD_DB_TPS_1M,
+							   dbxacts[i].xact_avg.avg[EWMA_1M]);
+				print_fld_rate(FLD_DB_TPS_5M,
+							   dbxacts[i].xact_avg.avg[EWMA_5M]);
+				print_fld_rate(FLD_DB_TPS_15M,
+							   dbxacts[i].xact_avg.avg[EWMA_15M]);
 				end_line();
 			}
 			if (++cur >= end)
@@ -296,7 +380,38 @@ sort_dbxact(void)
 	if (dbxact_count <= 0)
 		return;
 
-	mergesort(dbxacts, dbxact_count, sizeof(struct dbxact_t), ordering->func);
+	sort_rows(dbxacts, dbxact_count, sizeof(struct dbxact_t),
+			  offsetof(struct dbxact_t, order), ordering->func);
+}
+
+void
+export_dbxact(void)
+{
+	int			i;
+
+	export_family("pg_stat_database_numbackends", "gauge",
+				  "Backends connected to the database.");
+	for (i = 0; i < dbxact_count; i++)
+		export_gauge("pg_stat_database_numbackends", "datname",
+					 dbxacts[i].datname, dbxacts[i].numbackends);
+
+	export_family("pg_stat_database_xact_commit", "counter",
+				  "Transactions committed in the database.");
+	for (i = 0; i < dbxact_count; i++)
+		export_counter("pg_stat_database_xact_commit", "datname",
+					   dbxacts[i].datname, dbxacts[i].xact_commit);
+
+	export_family("pg_stat_database_xact_rollback", "counter",
+				  "Transactions rolled back in the database.");
+	for (i = 0; i < dbxact_count; i++)
+		export_counter("pg_stat_database_xact_rollback", "datname",
+					   dbxacts[i].datname, dbxacts[i].xact_rollback);
+
+	export_family("pg_stat_database_deadlocks", "counter",
+				  "Deadlocks detected in the database.");
+	for (i = 0; i < dbxact_count; i++)
+		export_counter("pg_stat_database_deadlocks", "datname",
+					   dbxacts[i].datname, dbxacts[i].deadlocks);
 }
 
 int
@@ -378,3 +493,38 @@ sort_dbxact_rollback_callback(const void *v1, const void *v2)
 
 	return sort_dbxact_datname_callback(v1, v2);
 }
+
+static int
+sort_dbxact_tps(const void *v1, const void *v2, int avg)
+{
+	struct dbxact_t *n1,
+			   *n2;
+
+	n1 = (struct dbxact_t *) v1;
+	n2 = (struct dbxact_t *) v2;
+
+	if (n1->xact_avg.avg[avg] < n2->xact_avg.avg[avg])
+		return sortdir;
+	if (n1->xact_avg.avg[avg] > n2->xact_avg.avg[avg])
+		return -sortdir;
+
+	return sort_dbxact_datname_callback(v1, v2);
+}
+
+int
+sort_dbxact_tps_1m_callback(const void *v1, const void *v2)
+{
+	return sort_dbxact_tps(v1, v2, EWMA_1M);
+}
+
+int
+sort_dbxact_tps_5m_callback(const void *v1, const void *v2)
+{
+	return sort_dbxact_tps(v1, v2, EWMA_5M);
+}
+
+int
+sort_dbxact_tps_15m_callback(const void *v1, const void *v2)
+{
+	return sort_dbxact_tps(v1, v2, EWMA_15M);
+}
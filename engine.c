@@ -22,6 +22,8 @@
 
 #include <ctype.h>
 #include <curses.h>
+#include <langinfo.h>
+#include <locale.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,6 +33,7 @@
 #endif							/* __linux__ */
 
 #include <term.h>
+#include <time.h>
 #include <unistd.h>
 #include <err.h>
 
@@ -43,7 +46,13 @@
 #undef lines
 #endif
 
+#include "bookmark.h"
 #include "engine.h"
+#include "output.h"
+#include "pg.h"
+#include "recorder.h"
+#include "replay.h"
+#include "self.h"
 
 #define MINIMUM(a, b) (((a) < (b)) ? (a) : (b))
 
@@ -57,11 +66,22 @@ struct view_ent
 };
 
 useconds_t	udelay = 5000000;
+useconds_t	usample = 250000;
+int			refresh_tiers = 1;
+
+/* the interval of each refresh_tier, TIER_DELAY taking udelay */
+static const useconds_t tier_interval[] = {
+	0, 500000, 1000000, 10000000, 60000000
+};
+
+/* the age of the data in the header, to know when it needs redrawing */
+static int	shown_age = -1;
 int			dispstart = 0;
 int			interactive = 1;
 int			averageonly = 0;
 int			maxprint = 0;
 int			paused = 0;
+int			step = 0;
 int			rawmode = 0;
 int			rawwidth = DEFAULT_WIDTH;
 int			sortdir = 1;
@@ -73,9 +93,12 @@ int			max_disp = -1;
 volatile	sig_atomic_t gotsig_close = 0;
 volatile	sig_atomic_t gotsig_resize = 0;
 volatile	sig_atomic_t gotsig_alarm = 0;
+volatile	sig_atomic_t gotsig_dump = 0;
 int			need_update = 0;
 int			need_sort = 0;
 int			separate_thousands = 0;
+int			show_averages = 0;
+int			utf8_blocks = 0;
 
 SCREEN	   *screen;
 
@@ -86,9 +109,32 @@ struct view_manager *curr_mgr = NULL;
 int			curr_line = 0;
 int			home_line = 0;
 
-/* line buffer for raw mode */
+/* line buffer for raw mode, of which only the first lineend bytes are used */
 char		linebuf[MAX_LINE_BUF];
 int			linepos = 0;
+int			lineend = 0;
+
+/*
+ * Shadow screens for damage tracking in interactive mode.  A refresh is drawn
+ * into grid_next instead of on the curses screen, and end_page() then hands
+ * curses only the runs of cells that differ from grid_shown, what is on the
+ * screen since the previous refresh.  Most cells of a refresh, and titles
+ * but for a change of layout, are the same as before and cost neither a
+ * curses call nor a comparison in doupdate().  A cell holds one character,
+ * up to 4 bytes of UTF-8; a shown cell starting with a NUL is unknown and
+ * always drawn again.
+ */
+struct grid_cell
+{
+	char		c[4];
+};
+
+static struct grid_cell *grid_next = NULL;
+static struct grid_cell *grid_shown = NULL;
+static int	grid_lines = 0;
+static int	grid_cols = 0;
+
+static const struct grid_cell blank_cell = {{' ', 0, 0, 0}};
 
 /* temp storage for state printing */
 char		tmp_buf[MAX_LINE_BUF];
@@ -146,63 +192,208 @@ GCC_PRINTFLIKE(1, 2)			/* defined in curses.h */
 	return len;
 }
 
-int
-tbprintft(char *format,...)
-GCC_PRINTFLIKE(1, 2)			/* defined in curses.h */
+static const char digit_pairs[] =
+"0001020304050607080910111213141516171819"
+"2021222324252627282930313233343536373839"
+"4041424344454647484950515253545556575859"
+"6061626364656667686970717273747576777879"
+"8081828384858687888990919293949596979899";
+
+/*
+ * Format n right to left into the buffer ending at end, two digits at a time,
+ * or a group of three with a separator in front when "separate" is set, and
+ * return where the number starts.  Nothing is terminated.
+ */
+char *
+format_uint(char *end, u_int64_t n, int separate)
 {
-	int			len;
-	va_list		arg;
-	char		buf[MAX_LINE_BUF];
+	char	   *p = end;
+	unsigned int r;
 
-	if (tb_ptr == NULL || tb_len <= 0)
-		return 0;
+	if (separate)
+	{
+		while (n >= 1000)
+		{
+			r = n % 1000;
+			n /= 1000;
+			p -= 3;
+			p[0] = '0' + r / 100;
+			memcpy(p + 1, digit_pairs + (r % 100) * 2, 2);
+			*--p = ',';
+		}
+		if (n >= 100)
+		{
+			r = n;
+			p -= 3;
+			p[0] = '0' + r / 100;
+			memcpy(p + 1, digit_pairs + (r % 100) * 2, 2);
+			return p;
+		}
+	}
+	else
+	{
+		while (n >= 100)
+		{
+			r = n % 100;
+			n /= 100;
+			p -= 2;
+			memcpy(p, digit_pairs + r * 2, 2);
+		}
+	}
 
-	va_start(arg, format);
-	len = vsnprintf(buf, tb_len, format, arg);
-	va_end(arg);
+	if (n >= 10)
+	{
+		p -= 2;
+		memcpy(p, digit_pairs + n * 2, 2);
+	}
+	else
+		*--p = '0' + n;
+	return p;
+}
 
-	if (len > tb_len)
-		tb_end();
-	else if (len > 0)
+/*
+ * The width of n as format_uint() formats it.
+ */
+static int
+uint_width(u_int64_t n, int separate)
+{
+	int			digits = 1;
+
+	while (n >= 10000)
 	{
-		int			d,
-					s;
-		int			digits,
-					curdigit;
+		n /= 10000;
+		digits += 4;
+	}
+	if (n >= 10)
+		digits++;
+	if (n >= 100)
+		digits++;
+	if (n >= 1000)
+		digits++;
+
+	return separate ? digits + (digits - 1) / 3 : digits;
+}
 
-		if (!separate_thousands)
-		{
-			strlcpy(tb_ptr, buf, tb_len);
-			return len;
-		}
+static void
+grid_clear(struct grid_cell *grid, struct grid_cell cell)
+{
+	int			i;
 
-		/* count until we hit a non digit. (e.g. the prefix) */
-		for (digits = 0; digits < len; digits++)
-			if (!isdigit((unsigned char) buf[digits]))
-				break;
+	for (i = 0; i < grid_lines * grid_cols; i++)
+		grid[i] = cell;
+}
 
-		curdigit = digits;
-		d = s = 0;
-		/* insert thousands separators while copying */
-		while (curdigit && d < tb_len)
-		{
-			if (curdigit < digits && curdigit % 3 == 0)
-				tb_ptr[d++] = ',';
-			tb_ptr[d++] = buf[s++];
-			curdigit--;
-		}
-		/* copy the remaining non-digits */
-		while (len > digits && d < tb_len)
+/*
+ * Size the shadow screens to the terminal, with nothing known to be shown.
+ */
+static void
+grid_setup(void)
+{
+	static const struct grid_cell unknown_cell;
+	struct grid_cell *next,
+			   *shown;
+
+	next = reallocarray(grid_next, lines * columns, sizeof(*next));
+	shown = reallocarray(grid_shown, lines * columns, sizeof(*shown));
+	if (next == NULL || shown == NULL)
+		err(1, "reallocarray");
+	grid_next = next;
+	grid_shown = shown;
+	grid_lines = lines;
+	grid_cols = columns;
+	grid_clear(grid_next, blank_cell);
+	grid_clear(grid_shown, unknown_cell);
+}
+
+/*
+ * Forget what a line of the screen shows after drawing on it directly.
+ */
+static void
+grid_forget(int line, int blank)
+{
+	static const struct grid_cell unknown_cell;
+	int			i;
+
+	if (line < 0 || line >= grid_lines)
+		return;
+	for (i = 0; i < grid_cols; i++)
+		grid_shown[line * grid_cols + i] = blank ? blank_cell : unknown_cell;
+}
+
+/*
+ * Put a string on a line of the next screen from a column, a character per
+ * cell, and return the column after it.
+ */
+static int
+grid_put(int line, int col, const char *str, int len)
+{
+	struct grid_cell *cell;
+	int			n;
+
+	if (line < 0 || line >= grid_lines)
+		return col;
+
+	cell = &grid_next[line * grid_cols];
+	while (len > 0 && col < grid_cols)
+	{
+		n = (*str & 0xe0) == 0xc0 ? 2 : (*str & 0xf0) == 0xe0 ? 3 :
+			(*str & 0xf8) == 0xf0 ? 4 : 1;
+		if (n > len)
+			n = len;
+		memset(cell[col].c, 0, sizeof(cell[col].c));
+		memcpy(cell[col].c, str, n);
+		str += n;
+		len -= n;
+		col++;
+	}
+	return col;
+}
+
+/*
+ * Draw the runs of cells of lines "first" to "last" of the next screen that
+ * differ from the shown ones, and blank those lines of the next screen for
+ * the following refresh.
+ */
+static void
+grid_flush(int first, int last)
+{
+	char		buf[MAX_LINE_BUF * 4];
+	struct grid_cell *next,
+			   *shown;
+	int			line,
+				col,
+				start,
+				len,
+				n;
+
+	if (last >= grid_lines)
+		last = grid_lines - 1;
+	for (line = first; line <= last; line++)
+	{
+		next = &grid_next[line * grid_cols];
+		shown = &grid_shown[line * grid_cols];
+		for (col = 0; col < grid_cols;)
 		{
-			tb_ptr[d++] = buf[s++];
-			digits++;
+			if (memcmp(&next[col], &shown[col], sizeof(*next)) == 0)
+			{
+				col++;
+				continue;
+			}
+
+			for (start = col, len = 0; col < grid_cols &&
+				 len < sizeof(buf) - sizeof(*next) &&
+				 memcmp(&next[col], &shown[col], sizeof(*next)) != 0; col++)
+			{
+				n = strnlen(next[col].c, sizeof(next[col].c));
+				memcpy(&buf[len], next[col].c, n);
+				len += n;
+				shown[col] = next[col];
+			}
+			mvaddnstr(line, start, buf, len);
 		}
-		tb_ptr[d] = '\0';
-		tb_ptr += d;
-		tb_len -= d;
-		len = d;
+		for (col = 0; col < grid_cols; col++)
+			next[col] = blank_cell;
 	}
-	return len;
 }
 
 void
@@ -218,9 +409,7 @@ move_horiz(int offset)
 			linepos = offset;
 	}
 	else
-	{
-		move(curr_line, offset);
-	}
+		linepos = offset < 0 ? 0 : offset;
 }
 
 void
@@ -235,26 +424,71 @@ print_str(int len, const char *str)
 
 		if (length <= 0)
 			return;
+		/* blank what was skipped over past the end of the line */
+		if (linepos > lineend)
+			memset(&linebuf[lineend], ' ', linepos - lineend);
 		bcopy(str, &linebuf[linepos], length);
 		linepos += length;
+		if (linepos > lineend)
+			lineend = linepos;
 	}
 	else
-		addnstr(str, len);
+		linepos = grid_put(curr_line, linepos, str, len);
+}
+
+/*
+ * Take len characters of the raw mode line from the current position, for a
+ * field to be formatted right where it is shown, and return where they start.
+ * The caller checks that they fit in the line.
+ */
+static char *
+print_reserve(int len)
+{
+	char	   *p;
+
+	if (linepos > lineend)
+		memset(&linebuf[lineend], ' ', linepos - lineend);
+	p = &linebuf[linepos];
+	linepos += len;
+	if (linepos > lineend)
+		lineend = linepos;
+	return p;
+}
+
+/*
+ * Print a whole line, such as the header, outside of any field.
+ */
+void
+print_line(int line, const char *str)
+{
+	if (rawmode)
+		output_line(str);
+	else
+		grid_put(line, 0, str, strlen(str));
 }
 
 void
 clear_linebuf(void)
 {
-	memset(linebuf, ' ', MAX_LINE_BUF);
+	lineend = 0;
 }
 
+/*
+ * Add the line to the frame, padded with blanks to the output width.
+ */
 void
 end_line(void)
 {
-	if (rawmode)
+	int			len;
+
+	if (output_format != OUTPUT_NONE)
+		output_end_row();
+	else if (rawmode)
 	{
-		linebuf[rawwidth] = '\0';
-		printf("%s\n", linebuf);
+		len = MINIMUM(lineend, rawwidth);
+		output_write(linebuf, len);
+		output_spaces(rawwidth - len);
+		output_write("\n", 1);
 		clear_linebuf();
 	}
 	curr_line++;
@@ -267,9 +501,11 @@ end_page(void)
 	{
 		linepos = 0;
 		clear_linebuf();
+		output_flush();
 	}
 	else
 	{
+		grid_flush(0, grid_lines - 1);
 		move(home_line, 0);
 		print_cmdline();
 		refresh();
@@ -279,6 +515,25 @@ end_page(void)
 
 /* field output functions */
 
+/*
+ * Where a string of len characters starts in a field it fits in, unless it is
+ * aligned on a colon.
+ */
+static int
+field_offset(field_def * fld, int len)
+{
+	switch (fld->align)
+	{
+		case FLD_ALIGN_RIGHT:
+			return fld->width - len;
+		case FLD_ALIGN_CENTER:
+		case FLD_ALIGN_COLUMN:
+			return (fld->width - len) / 2;
+		default:
+			return 0;
+	}
+}
+
 void
 print_fld_str(field_def * fld, const char *str)
 {
@@ -289,6 +544,12 @@ print_fld_str(field_def * fld, const char *str)
 	if (str == NULL || fld == NULL)
 		return;
 
+	if (output_format != OUTPUT_NONE)
+	{
+		output_str(fld, str);
+		return;
+	}
+
 	if (fld->start < 0)
 		return;
 
@@ -301,37 +562,72 @@ print_fld_str(field_def * fld, const char *str)
 	}
 	else
 	{
-		switch (fld->align)
+		if (fld->align == FLD_ALIGN_COLUMN &&
+			(cpos = strchr(str, ':')) != NULL)
 		{
-			case FLD_ALIGN_RIGHT:
-				move_horiz(fld->start + (fld->width - len));
-				break;
-			case FLD_ALIGN_CENTER:
-				move_horiz(fld->start + (fld->width - len) / 2);
-				break;
-			case FLD_ALIGN_COLUMN:
-				if ((cpos = strchr(str, ':')) == NULL)
-				{
-					offset = (fld->width - len) / 2;
-				}
-				else
-				{
-					offset = (fld->width / 2) - (cpos - str);
-					if (offset < 0)
-						offset = 0;
-					else if (offset > (fld->width - len))
-						offset = fld->width - len;
-				}
-				move_horiz(fld->start + offset);
-				break;
-			default:
-				move_horiz(fld->start);
-				break;
+			offset = (fld->width / 2) - (cpos - str);
+			if (offset < 0)
+				offset = 0;
+			else if (offset > (fld->width - len))
+				offset = fld->width - len;
 		}
+		else
+			offset = field_offset(fld, len);
+		move_horiz(fld->start + offset);
 		print_str(len, str);
 	}
 }
 
+/*
+ * Print a number of magnitude n, scaled down by d to the first of K, M, G and
+ * T it fits the field in, or "*" if it fits in none or d is 0.  Which scale
+ * fits is worked out from the width alone, and only that one is formatted,
+ * in raw mode right into its place in the line.
+ */
+static void
+print_fld_scaled(field_def * fld, u_int64_t n, int neg, int d)
+{
+	static const char units[] = " KMGT";
+	char		buf[32];
+	char	   *p,
+			   *end;
+	int			unit,
+				len;
+
+	if (fld->start < 0)
+		return;
+
+	for (unit = 0;; unit++)
+	{
+		len = uint_width(n, separate_thousands) + (neg && n != 0) +
+			(unit > 0);
+		if (len <= fld->width)
+			break;
+		if (d == 0 || unit == sizeof(units) - 2 || (unit > 0 && n == 0))
+		{
+			print_fld_str(fld, "*");
+			return;
+		}
+		n /= d;
+	}
+
+	move_horiz(fld->start + field_offset(fld, len));
+	if (rawmode && linepos + len <= MAX_LINE_BUF)
+		end = print_reserve(len) + len;
+	else
+		end = buf + sizeof(buf);
+
+	p = end;
+	if (unit > 0)
+		*--p = units[unit];
+	p = format_uint(p, n, separate_thousands);
+	if (neg && n != 0)
+		*--p = '-';
+
+	if (end == buf + sizeof(buf))
+		print_str(len, p);
+}
+
 void
 print_bar_title(field_def * fld)
 {
@@ -347,7 +643,7 @@ print_bar_title(field_def * fld)
 
 	int			divs[] = {20, 10, 5, 4, 3, 2, 1, 0};
 
-	if (fld->width < 1)
+	if (fld->width < 1 || output_format != OUTPUT_NONE)
 		return;
 
 	len = snprintf(buf, sizeof(buf), " %d\\", fld->arg);
@@ -411,6 +707,12 @@ print_fld_bar(field_def * fld, int value)
 				tw,
 				val;
 
+	if (output_format != OUTPUT_NONE)
+	{
+		output_int(fld, value);
+		return;
+	}
+
 	if (fld->width < 1)
 		return;
 
@@ -436,6 +738,56 @@ print_fld_bar(field_def * fld, int value)
 	print_fld_tb(fld);
 }
 
+/*
+ * Draw a sparkline of "n" levels between 0 and 8, oldest first, right aligned
+ * so that the newest interval always sits at the edge of the field.  The
+ * Unicode block elements are only used on a wide character curses screen
+ * with a UTF-8 locale; raw mode positions output by byte and always falls
+ * back to an ASCII ramp.
+ */
+void
+print_fld_spark(field_def * fld, const unsigned char *levels, int n)
+{
+	static const char *const blocks[] = {
+		" ", "\xe2\x96\x81", "\xe2\x96\x82", "\xe2\x96\x83",
+		"\xe2\x96\x84", "\xe2\x96\x85", "\xe2\x96\x86",
+		"\xe2\x96\x87", "\xe2\x96\x88"
+	};
+	static const char ramp[] = " .:-=+*#@";
+	char		buf[MAX_LINE_BUF];
+	int			i,
+				len = 0;
+
+	if (output_format != OUTPUT_NONE)
+	{
+		output_null(fld);
+		return;
+	}
+
+	if (fld == NULL || fld->start < 0 || fld->width < 1)
+		return;
+
+	if (n > fld->width)
+	{
+		levels += n - fld->width;
+		n = fld->width;
+	}
+
+	for (i = 0; i < n && len < sizeof(buf) - 4; i++)
+	{
+		if (utf8_blocks && !rawmode)
+		{
+			strlcpy(&buf[len], blocks[levels[i]], sizeof(buf) - len);
+			len += strlen(&buf[len]);
+		}
+		else
+			buf[len++] = ramp[levels[i]];
+	}
+
+	move_horiz(fld->start + fld->width - n);
+	print_str(len, buf);
+}
+
 void
 print_fld_tb(field_def * fld)
 {
@@ -508,6 +860,13 @@ reset_fields(void)
 	}
 }
 
+int
+field_hidden(field_def * fld)
+{
+	return ((fld->flags & FLD_FLAG_HIDDEN) ||
+			((fld->flags & FLD_FLAG_AVERAGE) && !show_averages));
+}
+
 void
 field_setup(void)
 {
@@ -526,7 +885,7 @@ field_setup(void)
 	for (fp = curr_view->view; *fp != NULL; fp++)
 	{
 		fld = *fp;
-		if (fld->flags & FLD_FLAG_HIDDEN)
+		if (field_hidden(fld))
 			continue;
 
 		if (width <= 1)
@@ -553,7 +912,7 @@ field_setup(void)
 		for (fp = curr_view->view; *fp != NULL; fp++)
 		{
 			fld = *fp;
-			if (fld->flags & FLD_FLAG_HIDDEN)
+			if (field_hidden(fld))
 				continue;
 			if ((fld->width < fld->max_width) &&
 				(fld->increment <= width))
@@ -577,7 +936,7 @@ field_setup(void)
 	for (fp = curr_view->view; *fp != NULL; fp++)
 	{
 		fld = *fp;
-		if (fld->flags & FLD_FLAG_HIDDEN)
+		if (field_hidden(fld))
 			continue;
 		if (fld->start < 0)
 			break;
@@ -603,9 +962,12 @@ set_curr_view(struct view_ent *ve)
 
 	v = ve->view;
 
-	if ((curr_view != NULL) && (curr_mgr != v->mgr))
+	/* the first view is selected too, for it to keep the connection open */
+	if (curr_view == NULL || curr_mgr != v->mgr)
 	{
-		gotsig_alarm = 1;
+		if (curr_view != NULL)
+			gotsig_alarm = 1;
+		release_connection();
 		if (v->mgr != NULL && v->mgr->select_fn != NULL)
 			v->mgr->select_fn();
 	}
@@ -743,6 +1105,11 @@ print_fld_age(field_def * fld, unsigned int age)
 
 	if (fld == NULL)
 		return;
+	if (output_format != OUTPUT_NONE)
+	{
+		output_uint(fld, age);
+		return;
+	}
 	len = fld->width;
 
 	if (len < 1)
@@ -792,52 +1159,17 @@ ok:
 void
 print_fld_sdiv(field_def * fld, u_int64_t size, int d)
 {
-	int			len;
-
 	if (fld == NULL)
 		return;
-
-	len = fld->width;
-	if (len < 1)
+	if (output_format != OUTPUT_NONE)
+	{
+		output_uint(fld, size);
 		return;
+	}
 
-	tb_start();
-	if (tbprintft("%llu", size) <= len)
-		goto ok;
-
-	tb_start();
-	size /= d;
-	if (tbprintft("%lluK", size) <= len)
-		goto ok;
-	if (size == 0)
-		goto err;
-
-	tb_start();
-	size /= d;
-	if (tbprintft("%lluM", size) <= len)
-		goto ok;
-	if (size == 0)
-		goto err;
-
-	tb_start();
-	size /= d;
-	if (tbprintft("%lluG", size) <= len)
-		goto ok;
-	if (size == 0)
-		goto err;
-
-	tb_start();
-	size /= d;
-	if (tbprintft("%lluT", size) <= len)
-		goto ok;
-
-err:
-	print_fld_str(fld, "*");
-	tb_end();
-	return;
-
-ok:
-	print_fld_tb(fld);
+	if (fld->width < 1)
+		return;
+	print_fld_scaled(fld, size, 0, d);
 }
 
 void
@@ -849,52 +1181,20 @@ print_fld_size(field_def * fld, u_int64_t size)
 void
 print_fld_ssdiv(field_def * fld, int64_t size, int d)
 {
-	int			len;
-
 	if (fld == NULL)
 		return;
-
-	len = fld->width;
-	if (len < 1)
+	if (output_format != OUTPUT_NONE)
+	{
+		output_int(fld, size);
 		return;
+	}
 
-	tb_start();
-	if (tbprintft("%lld", size) <= len)
-		goto ok;
-
-	tb_start();
-	size /= d;
-	if (tbprintft("%lldK", size) <= len)
-		goto ok;
-	if (size == 0)
-		goto err;
-
-	tb_start();
-	size /= d;
-	if (tbprintft("%lldM", size) <= len)
-		goto ok;
-	if (size == 0)
-		goto err;
-
-	tb_start();
-	size /= d;
-	if (tbprintft("%lldG", size) <= len)
-		goto ok;
-	if (size == 0)
-		goto err;
-
-	tb_start();
-	size /= d;
-	if (tbprintft("%lldT", size) <= len)
-		goto ok;
-
-err:
-	print_fld_str(fld, "*");
-	tb_end();
-	return;
-
-ok:
-	print_fld_tb(fld);
+	if (fld->width < 1)
+		return;
+	if (size < 0)
+		print_fld_scaled(fld, -(u_int64_t) size, 1, d);
+	else
+		print_fld_scaled(fld, size, 0, d);
 }
 
 void
@@ -906,7 +1206,14 @@ print_fld_ssize(field_def * fld, int64_t size)
 void
 print_fld_rate(field_def * fld, double rate)
 {
-	if (rate < 0)
+	if (output_format != OUTPUT_NONE)
+	{
+		if (rate < 0)
+			output_null(fld);
+		else
+			output_double(fld, rate);
+	}
+	else if (rate < 0)
 	{
 		print_fld_str(fld, "*");
 	}
@@ -919,7 +1226,14 @@ print_fld_rate(field_def * fld, double rate)
 void
 print_fld_bw(field_def * fld, double bw)
 {
-	if (bw < 0)
+	if (output_format != OUTPUT_NONE)
+	{
+		if (bw < 0)
+			output_null(fld);
+		else
+			output_double(fld, bw);
+	}
+	else if (bw < 0)
 	{
 		print_fld_str(fld, "*");
 	}
@@ -930,23 +1244,19 @@ print_fld_bw(field_def * fld, double bw)
 }
 
 void
-print_fld_uint(field_def * fld, unsigned int size)
+print_fld_uint(field_def * fld, u_int64_t size)
 {
-	int			len;
-
 	if (fld == NULL)
 		return;
-
-	len = fld->width;
-	if (len < 1)
+	if (output_format != OUTPUT_NONE)
+	{
+		output_uint(fld, size);
 		return;
+	}
 
-	tb_start();
-	if (tbprintft("%u", size) > len)
-		print_fld_str(fld, "*");
-	else
-		print_fld_tb(fld);
-	tb_end();
+	if (fld->width < 1)
+		return;
+	print_fld_scaled(fld, size, 0, 0);
 }
 
 void
@@ -956,6 +1266,11 @@ print_fld_float(field_def * fld, double f, int prec)
 
 	if (fld == NULL)
 		return;
+	if (output_format != OUTPUT_NONE)
+	{
+		output_double(fld, f);
+		return;
+	}
 
 	len = fld->width;
 	if (len < 1)
@@ -1049,6 +1364,98 @@ set_order_hotkey(int ch)
 	return 0;
 }
 
+/*
+ * Rows are read back in whatever order the server returns them, which throws
+ * away the ordering from the previous refresh.  Put every row seen before back
+ * where it was sorted to last time and append new rows after them, so that the
+ * natural runs picked up by mergesort(3) cover almost the whole array and the
+ * sort only has to repair what actually changed between refreshes.
+ *
+ * "off" is the offset of the row_order member within each row.
+ */
+void
+sort_rows(void *base, int nmemb, size_t size, size_t off,
+		  int (*cmp) (const void *, const void *))
+{
+	static char *rows_buf = NULL;
+	static size_t rows_cap = 0;	/* bytes, as views differ in row size */
+	static int *slots = NULL;
+	static int	slots_len = 0;
+
+	char	   *rows = base;
+	row_order  *ro;
+	void	   *p;
+	int			i,
+				r,
+				next,
+				maxrank = -1;
+
+	if (rows == NULL || nmemb <= 0)
+		return;
+
+	for (i = 0; i < nmemb; i++)
+	{
+		ro = (row_order *) (rows + i * size + off);
+		if (ro->rank > maxrank)
+			maxrank = ro->rank;
+	}
+
+	if (maxrank >= 0)
+	{
+		if (maxrank >= slots_len)
+		{
+			p = reallocarray(slots, maxrank + 1, sizeof(int));
+			if (p == NULL)
+				goto sort;
+			slots = p;
+			slots_len = maxrank + 1;
+		}
+		if ((size_t) nmemb * size > rows_cap)
+		{
+			p = reallocarray(rows_buf, nmemb, size);
+			if (p == NULL)
+				goto sort;
+			rows_buf = p;
+			rows_cap = (size_t) nmemb * size;
+		}
+
+		for (r = 0; r <= maxrank; r++)
+			slots[r] = -1;
+		for (i = 0; i < nmemb; i++)
+		{
+			ro = (row_order *) (rows + i * size + off);
+			if (ro->rank < 0)
+				continue;
+			if (slots[ro->rank] == -1)
+				slots[ro->rank] = i;
+			else
+				ro->rank = -1;
+		}
+
+		next = 0;
+		for (r = 0; r <= maxrank; r++)
+			if (slots[r] != -1)
+				memcpy(rows_buf + next++ * size, rows + slots[r] * size, size);
+		for (i = 0; i < nmemb; i++)
+		{
+			ro = (row_order *) (rows + i * size + off);
+			if (ro->rank < 0)
+				memcpy(rows_buf + next++ * size, rows + i * size, size);
+		}
+		memcpy(rows, rows_buf, nmemb * size);
+	}
+
+sort:
+	mergesort(rows, nmemb, size, cmp);
+
+	for (i = 0; i < nmemb; i++)
+	{
+		ro = (row_order *) (rows + i * size + off);
+		ro->rank = i;
+		((row_order *) ((char *) ro->node + off))->rank = i;
+	}
+}
+
 void
 next_order(void)
 {
@@ -1078,19 +1485,131 @@ next_order(void)
 
 /* main program functions */
 
+static int64_t
+monotonic_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static useconds_t
+tier_usec(struct view_manager *mgr)
+{
+	if (!refresh_tiers || mgr->tier == TIER_DELAY)
+		return udelay;
+	return tier_interval[mgr->tier];
+}
+
+/*
+ * How often the view is read: the interval of its tier, or the delay if one
+ * was given, stretched if the queries of its last read took more than the
+ * budget allows for it.
+ */
+useconds_t
+view_interval(struct view_manager *mgr)
+{
+	useconds_t	interval = tier_usec(mgr);
+	double		stretched;
+
+	if (query_budget > 0)
+	{
+		stretched = mgr->read_cost / query_budget;
+		if (stretched > interval)
+			interval = stretched < UINT32_MAX ? stretched : UINT32_MAX;
+	}
+	return interval;
+}
+
+/*
+ * Whether the view is read less often than usual to keep within the budget.
+ */
+int
+view_throttled(struct view_manager *mgr)
+{
+	return view_interval(mgr) > tier_usec(mgr);
+}
+
+/*
+ * The age of the data of the current view in seconds, or -1 if it was not
+ * read yet.
+ */
+int
+view_age(void)
+{
+	if (curr_mgr == NULL || curr_mgr->read_at == 0)
+		return -1;
+	return (monotonic_usec() - curr_mgr->read_at) / 1000000;
+}
+
+/*
+ * Microseconds until the current view is due to be read again, 0 if it is.
+ * A view that was never read is due at once, as is the view switched to if
+ * its data is older than its interval.  Replaying in batch mode reads at
+ * every turn, the replay clock moving by the interval of the view instead.
+ */
+static useconds_t
+refresh_wait(void)
+{
+	int64_t		elapsed;
+	useconds_t	interval;
+
+	if (curr_mgr == NULL)
+		return udelay;
+	if (replaying && !interactive && !paused)
+		return 0;
+
+	interval = view_interval(curr_mgr);
+	if (curr_mgr->read_at == 0)
+		return paused ? interval : 0;
+	elapsed = monotonic_usec() - curr_mgr->read_at;
+	if (elapsed >= interval)
+		return paused ? interval : 0;
+	return interval - elapsed;
+}
+
 int
 read_view(void)
 {
+	int64_t		cost,
+				start;
+	int			rc;
+
 	if (curr_mgr == NULL)
 		return (0);
 
-	if (paused)
+	if (!sampling())
+		replay_tick(view_interval(curr_mgr));
+
+	/* a paused view is read once more after a replay step */
+	if (paused && !step)
 		return (0);
+	step = 0;
 
-	if (curr_mgr->read_fn != NULL)
-		return (curr_mgr->read_fn());
+	if (curr_mgr->read_fn == NULL)
+		return (0);
 
-	return (0);
+	/* read the bookmark first, for the view to count changes from it */
+	if (since_bookmark && curr_mgr->sample_fn == NULL)
+	{
+		reading_bookmark = 1;
+		curr_mgr->read_fn();
+		reading_bookmark = 0;
+	}
+
+	cost = pg_query_usec();
+	start = monotonic_usec();
+	self_read_start(curr_view);
+	pg_tick_begin();
+	rc = curr_mgr->read_fn();
+	pg_tick_end();
+	curr_mgr->read_at = monotonic_usec();
+	cost = pg_query_usec() - cost;
+	self_read_end(curr_mgr->read_at - start, cost);
+	if (!replaying)
+		curr_mgr->read_cost = cost;
+	return (rc);
 }
 
 
@@ -1107,9 +1626,20 @@ disp_update(void)
 	if (dispstart < 0)
 		dispstart = 0;
 
+	shown_age = view_age();
+
 	if (curr_view == NULL)
 		return 0;
 
+	/* machine readable output has rows only, of every line of the view */
+	if (output_format != OUTPUT_NONE)
+	{
+		output_start();
+		if (curr_mgr != NULL && curr_mgr->print_fn != NULL)
+			curr_mgr->print_fn();
+		return (0);
+	}
+
 	if (curr_mgr != NULL)
 	{
 		curr_line = 0;
@@ -1135,9 +1665,101 @@ disp_update(void)
 void
 sort_view(void)
 {
+	int64_t		start;
+
 	if (curr_mgr != NULL)
 		if (curr_mgr->sort_fn != NULL)
+		{
+			start = monotonic_usec();
 			curr_mgr->sort_fn();
+			self_sort(curr_mgr, monotonic_usec() - start);
+		}
+}
+
+/*
+ * Redraw the screen, with the view itself unless only the page is ended, as
+ * when moving averages alone are printed.
+ */
+static void
+draw_view(int view)
+{
+	int64_t		start = monotonic_usec();
+
+	if (view)
+		disp_update();
+	end_page();
+	if (curr_mgr != NULL)
+		self_draw(curr_mgr, monotonic_usec() - start);
+}
+
+/*
+ * Redraw the header lines alone, leaving the rows of the view as they are.
+ */
+static void
+draw_header(void)
+{
+	int64_t		start = monotonic_usec();
+	int			li;
+
+	shown_age = view_age();
+	if (rawmode || curr_mgr == NULL || curr_mgr->header_fn == NULL)
+		return;
+
+	li = curr_mgr->header_fn();
+	if (li < 0)
+		return;
+	grid_flush(0, li);
+	move(home_line, 0);
+	print_cmdline();
+	refresh();
+	self_draw(curr_mgr, monotonic_usec() - start);
+}
+
+/*
+ * Views with a sample function are sampled every usample microseconds in
+ * between screen updates.
+ */
+int
+sampling(void)
+{
+	return (curr_mgr != NULL && curr_mgr->sample_fn != NULL && !paused);
+}
+
+/*
+ * Take a sample of the current view if one is due and return the number of
+ * microseconds until the next one is.
+ */
+useconds_t
+sample_view(void)
+{
+	static struct timespec next;
+	struct timespec now;
+	long long	wait;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wait = (next.tv_sec - now.tv_sec) * 1000000LL +
+		(next.tv_nsec - now.tv_nsec) / 1000;
+	if (wait > 0)
+		return wait;
+
+	replay_tick(usample);
+	curr_mgr->sample_fn();
+
+	/* keep the cadence unless sampling fell more than an interval behind */
+	if (wait < -(long long) usample)
+		next = now;
+	next.tv_sec += usample / 1000000;
+	next.tv_nsec += (usample % 1000000) * 1000;
+	if (next.tv_nsec >= 1000000000)
+	{
+		next.tv_sec++;
+		next.tv_nsec -= 1000000000;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wait = (next.tv_sec - now.tv_sec) * 1000000LL +
+		(next.tv_nsec - now.tv_nsec) / 1000;
+	return wait > 0 ? wait : 0;
 }
 
 void
@@ -1158,6 +1780,12 @@ sig_alarm(int sig)
 	gotsig_alarm = 1;
 }
 
+void
+sig_dump(int sig)
+{
+	gotsig_dump = 1;
+}
+
 void
 setup_term(int dmax)
 {
@@ -1175,6 +1803,11 @@ setup_term(int dmax)
 		if (dmax < 0)
 			dmax = 0;
 
+#ifdef HAVE_NCURSESW
+		setlocale(LC_CTYPE, "");
+		utf8_blocks = strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+#endif							/* HAVE_NCURSESW */
+
 		screen = newterm(NULL, stdout, stdin);
 		if (screen == NULL)
 		{
@@ -1185,6 +1818,7 @@ setup_term(int dmax)
 		}
 		columns = COLS;
 		lines = LINES;
+		grid_setup();
 
 		if (maxprint > lines - HEADER_LINES)
 			maxprint = lines - HEADER_LINES;
@@ -1225,6 +1859,7 @@ do_resize_term(void)
 		maxprint = lines - HEADER_LINES;
 
 	clear();
+	grid_setup();
 
 	field_setup();
 }
@@ -1285,6 +1920,7 @@ print_cmdline(void)
 		mvprintw(home_line, 0, "> %s", curr_message);
 	}
 	clrtoeol();
+	grid_forget(home_line, curr_cmd == NULL && curr_message == NULL);
 }
 
 
@@ -1303,6 +1939,8 @@ cmd_keyboard(int ch)
 		}
 		else
 			beep();
+		if (curr_cmd->edit != NULL)
+			curr_cmd->edit(cmdbuf);
 	}
 
 	switch (ch)
@@ -1322,6 +1960,8 @@ cmd_keyboard(int ch)
 			if (cmd_len > 0)
 			{
 				cmdbuf[--cmd_len] = 0;
+				if (curr_cmd->edit != NULL)
+					curr_cmd->edit(cmdbuf);
 			}
 			else
 				beep();
@@ -1332,6 +1972,8 @@ cmd_keyboard(int ch)
 			{
 				cmdbuf[0] = '\0';
 				cmd_len = 0;
+				if (curr_cmd->edit != NULL)
+					curr_cmd->edit(cmdbuf);
 			}
 			else
 				command_set(NULL, NULL);
@@ -1439,6 +2081,7 @@ keyboard(void)
 			break;
 		case CTRL_L:
 			clear();
+			grid_setup();
 			need_update = 1;
 			break;
 		default:
@@ -1459,6 +2102,18 @@ engine_initialize(void)
 	signal(SIGQUIT, sig_close);
 	signal(SIGWINCH, sig_resize);
 	signal(SIGALRM, sig_alarm);
+	signal(SIGUSR1, sig_dump);
+}
+
+/*
+ * The rows shown stay as they are while a command that follows the line as it
+ * is typed, such as a search, is open; a refresh that falls due meanwhile
+ * happens once it is closed.
+ */
+static int
+frozen(void)
+{
+	return (curr_cmd != NULL && curr_cmd->edit != NULL);
 }
 
 void
@@ -1468,16 +2123,18 @@ engine_loop(int countmax)
 
 	for (;;)
 	{
+		useconds_t	wait = udelay;
 
-		/* XXX forcing refresh by setting gotsig_alarm, but why??? */
-		gotsig_alarm = 1;
+		if (sampling())
+			wait = sample_view();
+		if (!frozen() && refresh_wait() == 0)
+			gotsig_alarm = 1;
 
-		if (gotsig_alarm)
+		if (gotsig_alarm && !frozen())
 		{
 			read_view();
 			need_sort = 1;
 			gotsig_alarm = 0;
-			ualarm(udelay, 0);
 		}
 
 		if (need_sort)
@@ -1485,26 +2142,21 @@ engine_loop(int countmax)
 			sort_view();
 			need_sort = 0;
 			need_update = 1;
-
-			/* XXX if sort took too long */
-			if (gotsig_alarm)
-			{
-				gotsig_alarm = 0;
-				ualarm(udelay, 0);
-			}
 		}
 
 		if (need_update)
 		{
-			erase();
-			if (!averageonly ||
-				(averageonly && count == countmax - 1))
-				disp_update();
-			end_page();
+			draw_view(!averageonly ||
+					  (averageonly && count == countmax - 1));
 			need_update = 0;
 			if (countmax && ++count >= countmax)
 				break;
 		}
+		else if (interactive && view_age() != shown_age)
+		{
+			/* only the age of the data in the header changed */
+			draw_header();
+		}
 
 		if (gotsig_close)
 			break;
@@ -1514,11 +2166,28 @@ engine_loop(int countmax)
 			gotsig_resize = 0;
 			need_update = 1;
 		}
+		if (gotsig_dump)
+		{
+			gotsig_dump = 0;
+			recorder_dump();
+			need_update = 1;
+		}
+		recorder_poll();
+
+		/* wake up for the next sample or read, whichever is first */
+		if (!sampling())
+			wait = frozen() ? udelay : refresh_wait();
+		else if (!frozen())
+			wait = MINIMUM(wait, refresh_wait());
 
 		if (interactive && need_update == 0)
+		{
+			/* and every second to count the age of the data */
+			timeout(MINIMUM(wait, 1000000) / 1000);
 			keyboard();
-		else if (interactive == 0)
-			usleep(udelay);
+		}
+		else if (interactive == 0 && (!replaying || sampling()))
+			usleep(wait);
 	}
 
 	if (rawmode == 0)
@@ -19,6 +19,7 @@
 #define _ENGINE_H_
 
 #include <curses.h>
+#include <stddef.h>
 
 #define DEFAULT_WIDTH  80
 #define DEFAULT_HEIGHT 25
@@ -50,6 +51,7 @@
 #define FLD_ALIGN_BAR    4
 
 #define FLD_FLAG_HIDDEN 1
+#define FLD_FLAG_AVERAGE 2		/* shown only along with moving averages */
 
 
 typedef struct
@@ -73,6 +75,31 @@ typedef struct
 	int			(*func) (const void *, const void *);
 }			order_type;
 
+/*
+ * Where a row landed the last time its view was sorted.  "node" points back at
+ * the long-lived tree entry the row was copied from so that the new rank can
+ * be remembered for the next refresh.
+ */
+typedef struct
+{
+	void	   *node;
+	int			rank;
+}			row_order;
+
+/*
+ * How often a view is read, by how much its queries cost the server.  Views
+ * of each tier are read at its own interval, unless a delay is given, which
+ * then applies to all of them.
+ */
+enum refresh_tier
+{
+	TIER_DELAY,					/* the delay, 5 seconds by default */
+	TIER_PROGRESS,				/* progress of commands, every 0.5 s */
+	TIER_DATABASE,				/* per database statistics, every second */
+	TIER_RELATION,				/* per relation or statement, every 10 s */
+	TIER_EXPENSIVE				/* scans of shared memory, every minute */
+};
+
 struct view_manager
 {
 	char	   *name;
@@ -84,6 +111,12 @@ struct view_manager
 	int			(*key_fn) (int);
 	order_type *order_list;
 	order_type *order_curr;
+	int			(*sample_fn) (void);
+	void		(*export_fn) (void);
+	const char *(*name_fn) (int);	/* name of a row shown, for search */
+	enum refresh_tier tier;
+	int64_t		read_at;		/* when last read, in monotonic usec */
+	int64_t		read_cost;		/* usec the queries of the read took */
 };
 
 typedef struct
@@ -98,6 +131,7 @@ struct command
 {
 	char	   *prompt;
 	void		(*exec) (const char *);
+	void		(*edit) (const char *);	/* after each change of the line */
 };
 
 
@@ -106,9 +140,10 @@ void		tb_start(void);
 void		tb_end(void);
 
 int			tbprintf(char *format,...) GCC_PRINTFLIKE(1, 2);
-int			tbprintft(char *format,...) GCC_PRINTFLIKE(1, 2);
+char	   *format_uint(char *, u_int64_t, int);
 
 void		end_line(void);
+void		print_line(int, const char *);
 void		end_page(void);
 
 void		print_fld_str(field_def *, const char *);
@@ -119,9 +154,10 @@ void		print_fld_ssdiv(field_def *, int64_t, int);
 void		print_fld_ssize(field_def *, int64_t);
 void		print_fld_bw(field_def *, double);
 void		print_fld_rate(field_def *, double);
-void		print_fld_uint(field_def *, unsigned int);
+void		print_fld_uint(field_def *, u_int64_t);
 void		print_fld_float(field_def *, double, int);
 void		print_fld_bar(field_def *, int);
+void		print_fld_spark(field_def *, const unsigned char *, int);
 void		print_fld_tb(field_def *);
 
 void		print_title(void);
@@ -129,6 +165,7 @@ void		print_title(void);
 void		hide_field(field_def * fld);
 void		show_field(field_def * fld);
 void		field_setup(void);
+int			field_hidden(field_def * fld);
 
 void		add_view(field_view * fv);
 int			set_view(const char *opt);
@@ -136,6 +173,8 @@ void		next_view(void);
 void		prev_view(void);
 
 int			foreach_order(void (*callback) (order_type *));
+void		sort_rows(void *, int, size_t, size_t,
+					  int (*) (const void *, const void *));
 void		set_order(const char *opt);
 void		next_order(void);
 
@@ -144,6 +183,10 @@ int			check_termcap(void);
 
 void		engine_initialize(void);
 void		engine_loop(int countmax);
+int			sampling(void);
+useconds_t	view_interval(struct view_manager *);
+int			view_throttled(struct view_manager *);
+int			view_age(void);
 
 struct command *command_set(struct command *cmd, const char *init);
 const char *message_set(const char *msg);
@@ -152,11 +195,14 @@ void		foreach_view(void (*callback) (field_view *));
 
 extern int	sortdir;
 extern useconds_t udelay;
+extern useconds_t usample;
+extern int	refresh_tiers;
 extern int	dispstart;
 extern int	interactive;
 extern int	averageonly;
 extern int	maxprint;
 extern int	paused;
+extern int	step;
 extern int	rawmode;
 extern int	rawwidth;
 extern int	columns,
@@ -165,10 +211,13 @@ extern int	columns,
 extern int	need_update;
 extern int	need_sort;
 extern int	separate_thousands;
+extern int	show_averages;
+extern int	utf8_blocks;
 
 extern volatile sig_atomic_t gotsig_close;
 extern volatile sig_atomic_t gotsig_resize;
 extern volatile sig_atomic_t gotsig_alarm;
+extern volatile sig_atomic_t gotsig_dump;
 
 extern field_view * curr_view;
 extern struct view_manager *curr_mgr;
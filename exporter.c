@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "exporter.h"
+#include "pg.h"
+#include "pg_systat.h"
+#include "recorder.h"
+#include "replay.h"
+
+#define EXPORTER_MAX_FDS	8
+#define EXPORTER_REQ_LEN	4096
+#define EXPORTER_TIMEOUT	1000	/* milliseconds a client may take */
+
+#define CONTENT_TYPE \
+		"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+struct export_buf
+{
+	char	   *data;
+	size_t		len;
+	size_t		size;
+	int			failed;			/* ran out of memory while rendering */
+};
+
+/* the last snapshot rendered, as served to every scrape until the next */
+static struct export_buf snapshot;
+
+static int	listen_fds[EXPORTER_MAX_FDS];
+static int	nlisten = 0;
+
+static struct view_manager *export_last;
+
+static void
+export_append(const char *s, size_t len)
+{
+	char	   *p;
+	size_t		size;
+
+	if (snapshot.failed)
+		return;
+
+	/* the buffer only grows, so a steady snapshot is rendered in place */
+	if (snapshot.len + len > snapshot.size)
+	{
+		size = snapshot.size > 0 ? snapshot.size : 65536;
+		while (snapshot.len + len > size)
+			size *= 2;
+		if ((p = realloc(snapshot.data, size)) == NULL)
+		{
+			snapshot.failed = 1;
+			return;
+		}
+		snapshot.data = p;
+		snapshot.size = size;
+	}
+	memcpy(snapshot.data + snapshot.len, s, len);
+	snapshot.len += len;
+}
+
+static void
+export_str(const char *s)
+{
+	export_append(s, strlen(s));
+}
+
+/*
+ * Append a label value, escaping the characters the text format requires.
+ */
+static void
+export_label_value(const char *s)
+{
+	const char *start;
+
+	for (start = s; *s != '\0'; s++)
+	{
+		if (*s != '\\' && *s != '"' && *s != '\n')
+			continue;
+		export_append(start, s - start);
+		export_str(*s == '\\' ? "\\\\" : *s == '"' ? "\\\"" : "\\n");
+		start = s + 1;
+	}
+	export_append(start, s - start);
+}
+
+static void
+export_sample(const char *name, const char *suffix, const char *label,
+			  const char *value, const char *number)
+{
+	export_str(name);
+	export_str(suffix);
+	if (label != NULL)
+	{
+		export_str("{");
+		export_str(label);
+		export_str("=\"");
+		export_label_value(value);
+		export_str("\"}");
+	}
+	export_str(" ");
+	export_str(number);
+	export_str("\n");
+}
+
+/*
+ * Start a metric family, which every sample of the metric must follow.
+ */
+void
+export_family(const char *name, const char *type, const char *help)
+{
+	export_str("# TYPE ");
+	export_str(name);
+	export_str(" ");
+	export_str(type);
+	export_str("\n# HELP ");
+	export_str(name);
+	export_str(" ");
+	export_str(help);
+	export_str("\n");
+}
+
+/*
+ * Append a sample of a counter family, labelled with "label" if not NULL.
+ */
+void
+export_counter(const char *name, const char *label, const char *value,
+			   int64_t n)
+{
+	char		number[24];
+
+	snprintf(number, sizeof(number), "%lld", (long long) n);
+	export_sample(name, "_total", label, value, number);
+}
+
+void
+export_gauge(const char *name, const char *label, const char *value,
+			 double n)
+{
+	char		number[32];
+
+	snprintf(number, sizeof(number), "%.15g", n);
+	export_sample(name, "", label, value, number);
+}
+
+static void
+export_view(field_view * v)
+{
+	/* a manager may have several field views, added one after the other */
+	if (v->mgr == export_last)
+		return;
+	export_last = v->mgr;
+
+	if (v->mgr->export_fn == NULL)
+		return;
+	v->mgr->read_fn();
+	v->mgr->export_fn();
+}
+
+/*
+ * Read every view with an export_fn and render the snapshot served until the
+ * next refresh.
+ */
+static void
+exporter_collect(void)
+{
+	snapshot.len = 0;
+	snapshot.failed = 0;
+
+	/* every view of a scrape sees the statistics as of the same moment */
+	export_last = NULL;
+	pg_tick_begin();
+	foreach_view(export_view);
+	pg_tick_end();
+
+	export_family("pg_systat_snapshot_timestamp_seconds", "gauge",
+				  "When the statistics were last read.");
+	export_gauge("pg_systat_snapshot_timestamp_seconds", NULL, NULL,
+				 replaying ? replay_clock() / 1000.0 : (double) time(NULL));
+	export_str("# EOF\n");
+}
+
+static int64_t
+monotonic_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Write all of "p" unless "deadline" passes first, each write waiting at most
+ * EXPORTER_TIMEOUT for the client.
+ */
+static int
+write_all(int fd, const char *p, size_t len, int64_t deadline)
+{
+	ssize_t		n;
+
+	while (len > 0)
+	{
+		if (monotonic_ms() >= deadline)
+			return -1;
+		if ((n = write(fd, p, len)) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * Answer one HTTP request with the snapshot.  Only the request line matters;
+ * the rest of the request is read so that closing the connection does not
+ * reset it before the client has read the response.  The client has
+ * EXPORTER_TIMEOUT in all to send its request, however slowly it trickles
+ * in, as nothing is collected or served meanwhile.
+ */
+static void
+exporter_serve(int fd)
+{
+	char		req[EXPORTER_REQ_LEN];
+	char		header[256];
+	const char *status = "200 OK";
+	const char *type = CONTENT_TYPE;
+	const char *body = snapshot.data;
+	size_t		len = 0,
+				bodylen = snapshot.len;
+	ssize_t		n;
+	struct pollfd pfd;
+	struct timeval tv = {EXPORTER_TIMEOUT / 1000, 0};
+	int64_t		deadline = monotonic_ms() + EXPORTER_TIMEOUT,
+				left;
+
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (len < sizeof(req) - 1)
+	{
+		if ((left = deadline - monotonic_ms()) <= 0 ||
+			poll(&pfd, 1, left) <= 0)
+			return;
+		if ((n = read(fd, req + len, sizeof(req) - 1 - len)) <= 0)
+			return;
+		len += n;
+		req[len] = '\0';
+		if (strstr(req, "\r\n\r\n") != NULL || strstr(req, "\n\n") != NULL)
+			break;
+	}
+	req[len] = '\0';
+
+	if (strncmp(req, "GET /metrics ", 13) != 0 &&
+		strncmp(req, "GET / ", 6) != 0)
+	{
+		status = "404 Not Found";
+		type = "text/plain";
+		body = "Not Found\n";
+		bodylen = strlen(body);
+	}
+	else if (snapshot.failed || snapshot.len == 0)
+	{
+		status = "503 Service Unavailable";
+		type = "text/plain";
+		body = "No statistics\n";
+		bodylen = strlen(body);
+	}
+
+	n = snprintf(header, sizeof(header),
+				 "HTTP/1.1 %s\r\n"
+				 "Content-Type: %s\r\n"
+				 "Content-Length: %zu\r\n"
+				 "Connection: close\r\n\r\n", status, type, bodylen);
+	/* and as long again to read the response */
+	deadline = monotonic_ms() + EXPORTER_TIMEOUT;
+	if (write_all(fd, header, n, deadline) == 0)
+		write_all(fd, body, bodylen, deadline);
+	shutdown(fd, SHUT_WR);
+}
+
+static void
+exporter_accept(int lfd)
+{
+	int			fd;
+
+	while ((fd = accept(lfd, NULL, NULL)) != -1)
+	{
+		exporter_serve(fd);
+		close(fd);
+	}
+}
+
+/*
+ * Listen on "[host:]port", on every address of the host, by default the
+ * loopback interface only.  An IPv6 address is given in brackets.
+ */
+int
+exporter_open(const char *arg)
+{
+	struct addrinfo hints,
+			   *res,
+			   *ai;
+	char	   *copy,
+			   *host = NULL,
+			   *port,
+			   *p,
+			   *q;
+	int			fd,
+				on = 1,
+				error;
+
+	if ((copy = strdup(arg)) == NULL)
+		return -1;
+	port = copy;
+	if ((p = strrchr(copy, ':')) != NULL &&
+		(*copy != '[' || ((q = strchr(copy, ']')) != NULL && q < p)))
+	{
+		*p = '\0';
+		host = copy;
+		port = p + 1;
+	}
+	if (host != NULL && *host == '[')
+	{
+		host++;
+		if ((p = strchr(host, ']')) != NULL)
+			*p = '\0';
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	error = getaddrinfo(host != NULL && *host != '\0' ? host :
+						EXPORTER_DEFAULT_HOST, port, &hints, &res);
+	free(copy);
+	if (error != 0)
+	{
+		errno = EADDRNOTAVAIL;
+		return -1;
+	}
+
+	error = EADDRNOTAVAIL;
+	for (ai = res; ai != NULL && nlisten < EXPORTER_MAX_FDS; ai = ai->ai_next)
+	{
+		if ((fd = socket(ai->ai_family, ai->ai_socktype,
+						 ai->ai_protocol)) == -1)
+			continue;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		if (bind(fd, ai->ai_addr, ai->ai_addrlen) == -1 ||
+			listen(fd, 16) == -1 ||
+			fcntl(fd, F_SETFL, O_NONBLOCK) == -1)
+		{
+			error = errno;
+			close(fd);
+			continue;
+		}
+		listen_fds[nlisten++] = fd;
+	}
+	freeaddrinfo(res);
+
+	if (nlisten == 0)
+	{
+		errno = error;
+		return -1;
+	}
+
+	/* a scraper going away must not kill us */
+	signal(SIGPIPE, SIG_IGN);
+	return 0;
+}
+
+/*
+ * Refresh the snapshot every refresh interval, answering scrapes in between,
+ * until told to quit.
+ */
+void
+exporter_loop(void)
+{
+	struct pollfd pfds[EXPORTER_MAX_FDS];
+	struct timespec now,
+				next;
+	int			i,
+				timeout;
+
+	for (i = 0; i < nlisten; i++)
+	{
+		pfds[i].fd = listen_fds[i];
+		pfds[i].events = POLLIN;
+	}
+
+	while (!gotsig_close)
+	{
+		replay_tick(udelay);
+		exporter_collect();
+
+		clock_gettime(CLOCK_MONOTONIC, &next);
+		next.tv_sec += udelay / 1000000;
+		next.tv_nsec += (udelay % 1000000) * 1000;
+		if (next.tv_nsec >= 1000000000)
+		{
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000;
+		}
+
+		for (;;)
+		{
+			if (gotsig_close)
+				break;
+			if (gotsig_dump)
+			{
+				gotsig_dump = 0;
+				recorder_dump();
+			}
+			recorder_poll();
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			timeout = (next.tv_sec - now.tv_sec) * 1000 +
+				(next.tv_nsec - now.tv_nsec) / 1000000;
+			if (timeout <= 0)
+				break;
+
+			if (poll(pfds, nlisten, timeout) > 0)
+			{
+				for (i = 0; i < nlisten; i++)
+					if (pfds[i].revents & POLLIN)
+						exporter_accept(pfds[i].fd);
+			}
+		}
+	}
+
+	for (i = 0; i < nlisten; i++)
+		close(listen_fds[i]);
+}
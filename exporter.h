@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#ifndef _EXPORTER_H_
+#define _EXPORTER_H_
+
+#include <stdint.h>
+
+/*
+ * Headless mode serving the statistics of the views in the OpenMetrics text
+ * format over HTTP, for Prometheus to scrape in place of a separate exporter
+ * querying the same catalog views again.
+ *
+ * The views that have an export_fn are read every refresh interval, exactly
+ * as they are for display, and their export_fn then renders the whole
+ * snapshot into one buffer.  A scrape is answered with that buffer as it is,
+ * without querying the server or formatting or allocating anything, so any
+ * number of scrapers adds no load on the server.
+ */
+#define EXPORTER_DEFAULT_HOST	"localhost"
+
+int			exporter_open(const char *);
+void		exporter_loop(void);
+
+void		export_family(const char *, const char *, const char *);
+void		export_counter(const char *, const char *, const char *, int64_t);
+void		export_gauge(const char *, const char *, const char *, double);
+
+#endif							/* _EXPORTER_H_ */
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <regex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "filter.h"
+
+#define SYSTEM_SCHEMA \
+		"(schemaname IN ('pg_catalog', 'information_schema') OR " \
+		"schemaname ~ '^pg_toast')"
+
+struct filter
+{
+	char	   *spec;			/* as given, for editing */
+	char	   *schema;
+	char	   *table;
+	char	   *database;
+	int			user;
+	int			system;
+	int64_t		size;
+};
+
+static struct filter filter;
+static unsigned int filter_gen = 0;
+
+/* the last query filter_query() returned */
+static char *query_buf = NULL;
+static size_t query_size = 0;
+
+static void
+filter_free(struct filter *f)
+{
+	free(f->spec);
+	free(f->schema);
+	free(f->table);
+	free(f->database);
+	memset(f, 0, sizeof(struct filter));
+}
+
+static int
+filter_regex(char **dst, const char *re)
+{
+	regex_t		preg;
+
+	if (*re == '\0' || regcomp(&preg, re, REG_EXTENDED | REG_NOSUB) != 0)
+		return -1;
+	regfree(&preg);
+
+	free(*dst);
+	return (*dst = strdup(re)) == NULL ? -1 : 0;
+}
+
+static int
+filter_size(int64_t *dst, const char *s)
+{
+	char	   *end;
+	long long	n;
+	int			shift = 0;
+
+	errno = 0;
+	n = strtoll(s, &end, 10);
+	if (errno != 0 || end == s || n < 0)
+		return -1;
+	switch (toupper((unsigned char) *end))
+	{
+		case 'T':
+			shift += 10;
+			/* FALLTHROUGH */
+		case 'G':
+			shift += 10;
+			/* FALLTHROUGH */
+		case 'M':
+			shift += 10;
+			/* FALLTHROUGH */
+		case 'K':
+			shift += 10;
+			end++;
+			break;
+	}
+	if (toupper((unsigned char) *end) == 'B')
+		end++;
+	/* a size that does not fit is not understood either */
+	if (*end != '\0' || n > (LLONG_MAX >> shift))
+		return -1;
+	*dst = n << shift;
+	return 0;
+}
+
+/*
+ * Replace the filters with those of spec, or remove them all if it is empty.
+ * Returns -1 and keeps the filters as they were if a term is not understood.
+ */
+int
+filter_set(const char *spec)
+{
+	struct filter f;
+	char	   *copy,
+			   *term,
+			   *p,
+			   *value;
+	int			rc = 0;
+
+	memset(&f, 0, sizeof(struct filter));
+	if ((copy = strdup(spec)) == NULL)
+		return -1;
+
+	for (p = copy; rc == 0 && (term = strsep(&p, " \t")) != NULL;)
+	{
+		if (*term == '\0')
+			continue;
+		if ((value = strchr(term, '=')) != NULL)
+			*value++ = '\0';
+
+		if (value == NULL && strcasecmp(term, "user") == 0)
+			f.user = 1;
+		else if (value == NULL && strcasecmp(term, "system") == 0)
+			f.system = 1;
+		else if (value == NULL)
+			rc = -1;
+		else if (strcasecmp(term, "schema") == 0)
+			rc = filter_regex(&f.schema, value);
+		else if (strcasecmp(term, "table") == 0)
+			rc = filter_regex(&f.table, value);
+		else if (strcasecmp(term, "database") == 0)
+			rc = filter_regex(&f.database, value);
+		else if (strcasecmp(term, "size") == 0)
+			rc = filter_size(&f.size, value);
+		else
+			rc = -1;
+	}
+	free(copy);
+
+	if (rc == 0 && (f.spec = strdup(spec)) == NULL)
+		rc = -1;
+	if (rc == -1)
+	{
+		filter_free(&f);
+		return -1;
+	}
+
+	filter_free(&filter);
+	filter = f;
+	filter_gen++;
+	return 0;
+}
+
+/*
+ * The filters as they were given, or an empty string.
+ */
+const char *
+filter_get(void)
+{
+	return filter.spec != NULL ? filter.spec : "";
+}
+
+/*
+ * Changes with every change of the filters.  Rows filtered out for a while do
+ * not have counters to compare with when they come back, so views re-baseline
+ * on a change.
+ */
+unsigned int
+filter_generation(void)
+{
+	return filter_gen;
+}
+
+/*
+ * Make room for a query of up to len bytes.  The buffer only grows, so once
+ * it fits the queries it is not allocated again.
+ */
+static int
+query_grow(size_t len)
+{
+	char	   *p;
+	size_t		size;
+
+	if (len <= query_size)
+		return 0;
+	size = query_size > 0 ? query_size : 1024;
+	while (size < len)
+		size *= 2;
+	if ((p = realloc(query_buf, size)) == NULL)
+		return -1;
+	query_buf = p;
+	query_size = size;
+	return 0;
+}
+
+static void
+query_append(size_t *len, const char *s)
+{
+	size_t		n = strlen(s);
+
+	memcpy(query_buf + *len, s, n + 1);
+	*len += n;
+}
+
+/*
+ * Append a condition, starting the WHERE clause or adding to it.
+ */
+static void
+query_cond(size_t *len, int *where, const char *s)
+{
+	query_append(len, *where ? "\n  AND " : "\nWHERE ");
+	query_append(len, s);
+	*where = 1;
+}
+
+/*
+ * Append a regular expression as an escape string constant.
+ */
+static void
+query_regex(size_t *len, const char *re)
+{
+	char		c[2] = {0, 0};
+
+	query_append(len, "E'");
+	for (; *re != '\0'; re++)
+	{
+		c[0] = *re;
+		if (*re == '\'' || *re == '\\')
+			query_append(len, c);
+		query_append(len, c);
+	}
+	query_append(len, "'");
+}
+
+/*
+ * The query, without its terminating semicolon, with the filters that apply
+ * to the target added to its WHERE clause.  id is the column that identifies
+ * the relation or database of a row.  Without filters this is the query as it
+ * always was, so that recordings made without filters still replay; one made
+ * with filters replays with the same filters only.  The result is valid until
+ * the next call, and an empty query if there is no memory for it.
+ */
+const char *
+filter_query(const char *query, enum filter_target target, const char *id)
+{
+	char		size[64];
+	size_t		len = 0;
+	int			where = strstr(query, "\nWHERE ") != NULL;
+
+	/* room for the conditions, with every character of a regex escaped */
+	if (query_grow(strlen(query) + 512 +
+				   2 * strlen(filter.spec != NULL ? filter.spec : "")) == -1)
+		return "";
+
+	query_append(&len, query);
+
+	if (target == FILTER_DATABASES)
+	{
+		if (filter.database != NULL)
+		{
+			query_cond(&len, &where, id);
+			query_append(&len, " IN (SELECT oid FROM pg_database "
+						 "WHERE datname ~ ");
+			query_regex(&len, filter.database);
+			query_append(&len, ")");
+		}
+	}
+	else
+	{
+		if (filter.schema != NULL)
+		{
+			query_cond(&len, &where, "schemaname ~ ");
+			query_regex(&len, filter.schema);
+		}
+		if (filter.table != NULL)
+		{
+			query_cond(&len, &where, "relname ~ ");
+			query_regex(&len, filter.table);
+		}
+		if (filter.user && !filter.system)
+			query_cond(&len, &where, "NOT " SYSTEM_SCHEMA);
+		else if (filter.system && !filter.user)
+			query_cond(&len, &where, SYSTEM_SCHEMA);
+		if (filter.size > 0)
+		{
+			query_cond(&len, &where, "(SELECT relpages FROM pg_class WHERE "
+					   "oid = ");
+			query_append(&len, id);
+			snprintf(size, sizeof(size),
+					 ")::bigint * current_setting('block_size')::bigint "
+					 ">= %lld", (long long) filter.size);
+			query_append(&len, size);
+		}
+	}
+
+	query_append(&len, ";");
+	return query_buf;
+}
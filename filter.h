@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#ifndef _FILTER_H_
+#define _FILTER_H_
+
+/*
+ * Filters on the rows of the relation and database views, given with -f or
+ * the F command as space separated terms:
+ *
+ *	schema=REGEX	schemas matching the regular expression
+ *	table=REGEX		tables, or the tables of indexes, matching it
+ *	user			user tables only, as pg_stat_user_tables has them
+ *	system			system tables only, as pg_stat_sys_tables has them
+ *	size=SIZE		relations of at least SIZE bytes, k, M, G or T
+ *	database=REGEX	databases matching the regular expression
+ *
+ * The filters are compiled into the WHERE clause of the statistics queries,
+ * so the rows filtered out are never sent by the server, let alone parsed,
+ * kept or sorted.  The size of a relation is the one pg_class has from the
+ * last VACUUM or ANALYZE, which unlike pg_relation_size() does not lock
+ * every relation on each refresh.
+ */
+enum filter_target
+{
+	FILTER_TABLES,
+	FILTER_INDEXES,
+	FILTER_DATABASES
+};
+
+int			filter_set(const char *);
+const char *filter_get(void);
+unsigned int filter_generation(void);
+const char *filter_query(const char *, enum filter_target, const char *);
+
+#endif							/* _FILTER_H_ */
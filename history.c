@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#include <stdlib.h>
+#ifdef __linux__
+#include <bsd/stdlib.h>
+#endif							/* __linux__ */
+#include <string.h>
+
+#include "bookmark.h"
+#include "history.h"
+
+#define HISTORY_INDEX(h, slot, tick) \
+	((size_t) (slot) * HISTORY_LEN + (tick) % HISTORY_LEN)
+
+/*
+ * Hand out the slot for a newly seen entity, its history all idle.  Returns
+ * -1 if the ring could not be grown.
+ */
+int
+history_slot(struct history *h)
+{
+	uint32_t   *grown;
+	unsigned int *stored;
+	int			size;
+
+	if (h->nslots >= h->size)
+	{
+		size = h->size > 0 ? h->size * 2 : 64;
+		grown = calloc((size_t) size * HISTORY_LEN, sizeof(uint32_t));
+		if (grown == NULL)
+			return -1;
+		stored = reallocarray(h->stored, size, sizeof(unsigned int));
+		if (stored == NULL)
+		{
+			free(grown);
+			return -1;
+		}
+		h->stored = stored;
+		if (h->samples != NULL)
+			memcpy(grown, h->samples,
+				   (size_t) h->nslots * HISTORY_LEN * sizeof(uint32_t));
+		free(h->samples);
+		h->samples = grown;
+		h->size = size;
+	}
+
+	h->stored[h->nslots] = h->tick;
+	return h->nslots++;
+}
+
+/*
+ * Start the samples of a new refresh.  An entity that has gone away, or was
+ * not updated this time, simply drifts out of its history, as the refreshes
+ * it missed count as idle.  The history stands still while changes are shown
+ * since the bookmark.
+ */
+void
+history_advance(struct history *h)
+{
+	if (!since_bookmark)
+		h->tick++;
+}
+
+/*
+ * Whether the sample of refresh "tick" in "slot" was stored, rather than left
+ * over from a refresh HISTORY_LEN or more before, which counts as idle.
+ */
+static int
+history_stored(const struct history *h, int slot, unsigned int tick)
+{
+	return h->tick - tick >= h->tick - h->stored[slot];
+}
+
+/*
+ * Store the delta of "slot" for the current refresh, clearing first the
+ * samples of the refreshes since it was last stored.  Negative deltas cannot
+ * be drawn and are stored as idle, and the rare delta that does not fit is
+ * clamped.
+ */
+void
+history_put(struct history *h, int slot, int64_t value)
+{
+	uint32_t   *s;
+	unsigned int t;
+
+	if (slot < 0 || slot >= h->nslots || since_bookmark)
+		return;
+
+	s = &h->samples[(size_t) slot * HISTORY_LEN];
+	if (h->tick - h->stored[slot] > HISTORY_LEN)
+		memset(s, 0, HISTORY_LEN * sizeof(uint32_t));
+	else if (h->stored[slot] != h->tick)
+		for (t = h->stored[slot] + 1; t != h->tick; t++)
+			s[t % HISTORY_LEN] = 0;
+	h->stored[slot] = h->tick;
+
+	if (value < 0)
+		value = 0;
+	else if (value > UINT32_MAX)
+		value = UINT32_MAX;
+	s[h->tick % HISTORY_LEN] = (uint32_t) value;
+}
+
+/*
+ * Scale the history of "slot" into sparkline levels, oldest first, relative
+ * to its own largest sample.  An idle interval is level 0 and any activity at
+ * all is at least level 1, so a quiet entity is still told apart from an idle
+ * one.  Returns the number of levels, HISTORY_LEN or fewer before that many
+ * refreshes have been seen.
+ */
+int
+history_levels(const struct history *h, int slot, unsigned char *levels)
+{
+	const uint32_t *s;
+	uint32_t	v[HISTORY_LEN];
+	uint32_t	max = 0;
+	unsigned int t;
+	int			i,
+				n;
+
+	if (slot < 0 || slot >= h->nslots)
+		return 0;
+
+	n = h->tick < HISTORY_LEN ? h->tick : HISTORY_LEN;
+	s = &h->samples[(size_t) slot * HISTORY_LEN];
+
+	for (i = 0, t = h->tick - n + 1; i < n; i++, t++)
+	{
+		v[i] = history_stored(h, slot, t) ? s[t % HISTORY_LEN] : 0;
+		if (v[i] > max)
+			max = v[i];
+	}
+
+	for (i = 0; i < n; i++)
+		levels[i] = v[i] == 0 ? 0 :
+			(unsigned char) (((uint64_t) v[i] * HISTORY_LEVELS + max - 1) /
+							 max);
+
+	return n;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <stdint.h>
+
+/*
+ * The last HISTORY_LEN per refresh deltas of one quantity for every tracked
+ * entity, drawn as a sparkline next to the current value.  Each entity owns a
+ * slot, and the samples of a slot sit next to each other in one preallocated
+ * array used as a ring: the sample of refresh "tick" is at tick % HISTORY_LEN.
+ * Each slot also remembers the refresh it was last stored in, so the samples
+ * of the refreshes it missed are cleared only when it is stored again, within
+ * its own row, and keeping the history costs nothing per refresh beyond the
+ * stores themselves.
+ */
+#define HISTORY_LEN	16
+
+/* highest sparkline level, level 0 being an idle interval */
+#define HISTORY_LEVELS	8
+
+struct history
+{
+	int			nslots;			/* slots handed out so far */
+	int			size;			/* slots allocated */
+	unsigned int tick;			/* refreshes seen */
+	uint32_t   *samples;
+	unsigned int *stored;		/* refresh each slot was last stored in */
+};
+
+#define HISTORY_INITIALIZER { 0, 0, 0, NULL, NULL }
+
+int			history_slot(struct history *);
+void		history_advance(struct history *);
+void		history_put(struct history *, int, int64_t);
+int			history_levels(const struct history *, int, unsigned char *);
+
+#endif							/* _HISTORY_H_ */
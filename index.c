@@ -11,17 +11,22 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "filter.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_INDEXES \
 		"SELECT indexrelid, schemaname, relname, indexrelname, idx_scan,\n" \
-		"       idx_tup_read, idx_tup_fetch\n" \
-		"FROM pg_stat_all_indexes;"
+		"       idx_tup_read, idx_tup_fetch,\n" \
+		"       " STATS_EPOCH_DATABASE "\n" \
+		"FROM pg_stat_all_indexes"
 
 struct index_t
 {
 	RB_ENTRY(index_t) entry;
+	row_order	order;
 
 	long long	indexrelid;
 	char		schemaname[NAMEDATALEN + 1];
@@ -43,6 +48,7 @@ struct index_t
 
 int			indexcmp(struct index_t *, struct index_t *);
 static void index_info(void);
+const char *index_name(int);
 void		print_index(void);
 int			read_index(void);
 int			select_index(void);
@@ -106,7 +112,8 @@ order_type	index_order_list[] = {
 /* Define view managers */
 struct view_manager index_mgr = {
 	"index", select_index, read_index, sort_index, print_header,
-	print_index, keyboard_callback, index_order_list, index_order_list
+	print_index, keyboard_callback, index_order_list, index_order_list,
+	NULL, NULL, index_name, TIER_RELATION
 };
 
 field_view	views_index[] = {
@@ -116,24 +123,34 @@ field_view	views_index[] = {
 
 int			index_count;
 struct index_t *indexs;
+struct stats_epoch index_epoch;
 
 static void
 index_info(void)
 {
 	int			i;
+	int			reset = 0;
 	PGresult   *pgresult = NULL;
 
 	struct index_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_INDEXES);
+		pgresult = pg_exec(filter_query(QUERY_STAT_INDEXES, FILTER_INDEXES,
+										"indexrelid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = index_count;
 			index_count = PQntuples(pgresult);
+			reset = stats_reset(&index_epoch, pgresult, 7);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -168,6 +185,8 @@ index_info(void)
 			return;
 		}
 		n->indexrelid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(index, &head_indexs, n);
 		if (p != NULL)
 		{
@@ -180,15 +199,20 @@ index_info(void)
 
 		n->idx_scan_old = n->idx_scan;
 		n->idx_scan = atoll(PQgetvalue(pgresult, i, 4));
-		n->idx_scan_diff = n->idx_scan - n->idx_scan_old;
+		n->idx_scan_diff = COUNTER_DELTA(n->idx_scan, n->idx_scan_old,
+										 p == NULL || reset);
 
 		n->idx_tup_read_old = n->idx_tup_read;
 		n->idx_tup_read = atoll(PQgetvalue(pgresult, i, 5));
-		n->idx_tup_read_diff = n->idx_tup_read - n->idx_tup_read_old;
+		n->idx_tup_read_diff = COUNTER_DELTA(n->idx_tup_read,
+											 n->idx_tup_read_old,
+											 p == NULL || reset);
 
 		n->idx_tup_fetch_old = n->idx_tup_fetch;
 		n->idx_tup_fetch = atoll(PQgetvalue(pgresult, i, 6));
-		n->idx_tup_fetch_diff = n->idx_tup_fetch - n->idx_tup_fetch_old;
+		n->idx_tup_fetch_diff = COUNTER_DELTA(n->idx_tup_fetch,
+											  n->idx_tup_fetch_old,
+											  p == NULL || reset);
 
 		memcpy(&indexs[i], n, sizeof(struct index_t));
 	}
@@ -227,6 +251,8 @@ initindex(void)
 	indexs = NULL;
 	index_count = 0;
 
+	serve_allow_filtered(QUERY_STAT_INDEXES, FILTER_INDEXES, "indexrelid");
+
 	for (v = views_index; v->name != NULL; v++)
 		add_view(v);
 
@@ -274,6 +300,14 @@ print_index(void)
 	} while (0);
 }
 
+const char *
+index_name(int i)
+{
+	if (i >= index_count)
+		return NULL;
+	return indexs[i].indexrelname;
+}
+
 void
 sort_index(void)
 {
@@ -293,8 +327,8 @@ sort_index(void)
 	if (index_count <= 0)
 		return;
 
-	mergesort(indexs, index_count, sizeof(struct index_t),
-			  ordering->func);
+	sort_rows(indexs, index_count, sizeof(struct index_t),
+			  offsetof(struct index_t, order), ordering->func);
 }
 
 int
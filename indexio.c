@@ -11,17 +11,22 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "filter.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_INDEXIOES \
 		"SELECT indexrelid, schemaname, relname, indexrelname,\n" \
-		"       idx_blks_read, idx_blks_hit\n" \
-		"FROM pg_statio_all_indexes;"
+		"       idx_blks_read, idx_blks_hit,\n" \
+		"       " STATS_EPOCH_DATABASE "\n" \
+		"FROM pg_statio_all_indexes"
 
 struct indexio_t
 {
 	RB_ENTRY(indexio_t) entry;
+	row_order	order;
 
 	long long	indexiorelid;
 	char		schemaname[NAMEDATALEN + 1];
@@ -39,6 +44,7 @@ struct indexio_t
 
 int			indexiocmp(struct indexio_t *, struct indexio_t *);
 static void indexio_info(void);
+const char *indexio_name(int);
 void		print_indexio(void);
 int			read_indexio(void);
 int			select_indexio(void);
@@ -99,7 +105,8 @@ order_type	indexio_order_list[] = {
 /* Define view managers */
 struct view_manager indexio_mgr = {
 	"indexio", select_indexio, read_indexio, sort_indexio, print_header,
-	print_indexio, keyboard_callback, indexio_order_list, indexio_order_list
+	print_indexio, keyboard_callback, indexio_order_list, indexio_order_list,
+	NULL, NULL, indexio_name, TIER_RELATION
 };
 
 field_view	views_indexio[] = {
@@ -109,24 +116,34 @@ field_view	views_indexio[] = {
 
 int			indexio_count;
 struct indexio_t *indexios;
+struct stats_epoch indexio_epoch;
 
 static void
 indexio_info(void)
 {
 	int			i;
+	int			reset = 0;
 	PGresult   *pgresult = NULL;
 
 	struct indexio_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_INDEXIOES);
+		pgresult = pg_exec(filter_query(QUERY_STAT_INDEXIOES, FILTER_INDEXES,
+										"indexrelid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = indexio_count;
 			indexio_count = PQntuples(pgresult);
+			reset = stats_reset(&indexio_epoch, pgresult, 6);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -161,6 +178,8 @@ indexio_info(void)
 			return;
 		}
 		n->indexiorelid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(indexio, &head_indexios, n);
 		if (p != NULL)
 		{
@@ -173,11 +192,15 @@ indexio_info(void)
 
 		n->idx_blks_read_old = n->idx_blks_read;
 		n->idx_blks_read = atoll(PQgetvalue(pgresult, i, 4));
-		n->idx_blks_read_diff = n->idx_blks_read - n->idx_blks_read_old;
+		n->idx_blks_read_diff = COUNTER_DELTA(n->idx_blks_read,
+											  n->idx_blks_read_old,
+											  p == NULL || reset);
 
 		n->idx_blks_hit_old = n->idx_blks_hit;
 		n->idx_blks_hit = atoll(PQgetvalue(pgresult, i, 5));
-		n->idx_blks_hit_diff = n->idx_blks_hit - n->idx_blks_hit_old;
+		n->idx_blks_hit_diff = COUNTER_DELTA(n->idx_blks_hit,
+											 n->idx_blks_hit_old,
+											 p == NULL || reset);
 
 		memcpy(&indexios[i], n, sizeof(struct indexio_t));
 	}
@@ -216,6 +239,8 @@ initindexio(void)
 	indexios = NULL;
 	indexio_count = 0;
 
+	serve_allow_filtered(QUERY_STAT_INDEXIOES, FILTER_INDEXES, "indexrelid");
+
 	for (v = views_indexio; v->name != NULL; v++)
 		add_view(v);
 
@@ -264,6 +289,14 @@ print_indexio(void)
 	} while (0);
 }
 
+const char *
+indexio_name(int i)
+{
+	if (i >= indexio_count)
+		return NULL;
+	return indexios[i].indexiorelname;
+}
+
 void
 sort_indexio(void)
 {
@@ -283,8 +316,8 @@ sort_indexio(void)
 	if (indexio_count <= 0)
 		return;
 
-	mergesort(indexios, indexio_count, sizeof(struct indexio_t),
-			  ordering->func);
+	sort_rows(indexios, indexio_count, sizeof(struct indexio_t),
+			  offsetof(struct indexio_t, order), ordering->func);
 }
 
 int
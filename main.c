@@ -44,6 +44,7 @@
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <grp.h>
 #include <limits.h>
 #include <netdb.h>
 #include <signal.h>
@@ -65,6 +66,14 @@
 #include "pg_systat.h"
 #include "pg.h"
 #include "port.h"
+#include "bookmark.h"
+#include "exporter.h"
+#include "filter.h"
+#include "output.h"
+#include "recorder.h"
+#include "replay.h"
+#include "search.h"
+#include "serve.h"
 
 #define TIMEPOS (80 - 8 - 20 - 1)
 #define PGSTRBUF 30
@@ -73,6 +82,8 @@
 #define PORT_LEN 5
 #define NUM_STRINGS 8
 
+#define QUERY_VERSION "SELECT regexp_split_to_table(version(), '\\s+')"
+
 double		naptime = 5.0;
 
 void		usage(void);
@@ -82,10 +93,14 @@ void		usage(void);
 void		cmd_delay(const char *);
 void		cmd_count(const char *);
 void		cmd_compat(const char *);
+void		cmd_seek(const char *);
+void		cmd_filter(const char *);
 
 struct command cm_compat = {"Command", cmd_compat};
 struct command cm_delay = {"Seconds to delay", cmd_delay};
 struct command cm_count = {"Number of lines to display", cmd_count};
+struct command cm_seek = {"Go to time", cmd_seek};
+struct command cm_filter = {"Filter", cmd_filter};
 
 
 /*
@@ -113,48 +128,30 @@ _strdup(const char *in)
 
 /* display functions */
 
-int
-print_header(void)
-{
-	time_t		now;
-	int			start = dispstart + 1,
-				end = dispstart + maxprint;
-
-	char		header[MAX_LINE_BUF];
-	char		pgstr[PGSTRBUF + 1] = "";
-	char		tmpbuf[TIMEPOS];
-	char		timebuf[26];
-	char		database[DATABASE_NAME_MAX + 1] = "";
-	char		hostname[HOST_NAME_MAX + 1] = "";
-	char		username[USER_NAME_MAX + 1] = "";
-	char		port[PORT_LEN + 1] = "";
+/* the server of the header */
+static char pgstr[PGSTRBUF + 1];
+static char database[DATABASE_NAME_MAX + 1];
+static char hostname[HOST_NAME_MAX + 1];
+static char username[USER_NAME_MAX + 1];
+static char port[PORT_LEN + 1];
+static int64_t server_read_at = -1;
 
+static void
+read_server(void)
+{
 	PGresult   *pgresult = NULL;
 	const char *pgdb;
 	const char *pghost;
 	const char *pgport;
 	const char *pguser;
 
-	if (end > num_disp)
-		end = num_disp;
-
-	tb_start();
-
-	if (!paused)
-	{
-		char	   *ctim;
-
-		time(&now);
-		ctim = ctime(&now);
-		ctim[11 + 8] = '\0';
-		strlcpy(timebuf, ctim + 11, sizeof(timebuf));
-	}
+	server_read_at = curr_mgr != NULL ? curr_mgr->read_at : -1;
+	pgstr[0] = database[0] = hostname[0] = username[0] = port[0] = '\0';
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection,
-						  "SELECT regexp_split_to_table(version(), '\\s+')");
+		pgresult = pg_exec(QUERY_VERSION);
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 			snprintf(pgstr, sizeof(pgstr), "%s %s", PQgetvalue(pgresult, 0, 0),
 					 PQgetvalue(pgresult, 1, 0));
@@ -174,27 +171,92 @@ print_header(void)
 		pguser = PQuser(options.connection);
 		if (pguser && pguser[0])
 			strncpy(username, pguser, USER_NAME_MAX);
-	}
 
-	if (num_disp && (start > 1 || end != num_disp))
-		snprintf(tmpbuf, sizeof(tmpbuf),
-				 "(%u-%u of %u) %s%s", start, end, num_disp,
-				 paused ? "PAUSED " : "", pgstr);
-	else
-		snprintf(tmpbuf, sizeof(tmpbuf), "%s%s",
-				 paused ? "PAUSED " : "", pgstr);
-
-	snprintf(header, sizeof(header), "%s %s %s@%s:%s/%s", timebuf, tmpbuf,
-			 username, hostname, port, database);
+		/* the daemon attached to stands in for the server */
+		if (attached)
+			strlcpy(hostname, serve_path(), sizeof(hostname));
+	}
 
 	if (pgresult != NULL)
 		PQclear(pgresult);
 	disconnect_from_db();
+}
 
-	if (rawmode)
-		printf("\n\n%s\n", header);
+int
+print_header(void)
+{
+	time_t		now;
+	int			start = dispstart + 1,
+				end = dispstart + maxprint;
+
+	char		header[MAX_LINE_BUF];
+	char		tmpbuf[TIMEPOS];
+	char		timebuf[26];
+	char		state[16] = "";
+	char		age[24] = "";
+	char		throttle[32] = "";
+	char		datebuf[16];
+	int			secs;
+
+	if (end > num_disp)
+		end = num_disp;
+
+	tb_start();
+
+	if (!paused)
+	{
+		char	   *ctim;
+
+		time(&now);
+		ctim = ctime(&now);
+		ctim[11 + 8] = '\0';
+		strlcpy(timebuf, ctim + 11, sizeof(timebuf));
+	}
+
+	if (paused)
+		strlcpy(state, "PAUSED ", sizeof(state));
+	else if (since_bookmark && bookmark_time() != 0)
+	{
+		now = bookmark_time();
+		strftime(state, sizeof(state), "SINCE %H:%M:%S ", localtime(&now));
+	}
+	if (replaying)
+	{
+		now = replay_clock() / 1000;
+		strftime(timebuf, sizeof(timebuf), "%H:%M:%S", localtime(&now));
+		strftime(datebuf, sizeof(datebuf), "%Y-%m-%d", localtime(&now));
+		if (state[0] == '\0' && replay_get_speed() > 1)
+			snprintf(state, sizeof(state), "%dx ", replay_get_speed());
+	}
+
+	/* the data of slow views ages visibly between reads */
+	if (interactive && (secs = view_age()) > 0)
+		snprintf(age, sizeof(age), "%ds old ", secs);
+	if (curr_mgr != NULL && view_throttled(curr_mgr))
+		snprintf(throttle, sizeof(throttle), "THROTTLED %.0fs ",
+				 view_interval(curr_mgr) / 1000000.0);
+
+	/* what the server is, asked again only once the view was read again */
+	if (curr_mgr == NULL || curr_mgr->read_at != server_read_at)
+		read_server();
+
+	if (num_disp && (start > 1 || end != num_disp))
+		snprintf(tmpbuf, sizeof(tmpbuf), "(%u-%u of %u) %s%s%s%s", start,
+				 end, num_disp, age, throttle, state, pgstr);
+	else
+		snprintf(tmpbuf, sizeof(tmpbuf), "%s%s%s%s", age, throttle, state,
+				 pgstr);
+
+	if (replaying)
+		snprintf(header, sizeof(header), "%s %s %s %s", timebuf, tmpbuf,
+				 replay_file(), datebuf);
 	else
-		mvprintw(0, 0, "%s", header);
+		snprintf(header, sizeof(header), "%s %s %s@%s:%s/%s", timebuf,
+				 tmpbuf, username, hostname, port, database);
+
+	if (rawmode)
+		output_write("\n\n", 2);
+	print_line(0, header);
 
 	return (1);
 }
@@ -245,13 +307,40 @@ usage(void)
 	fprintf(stderr, "Usage:\n");
 	fprintf(stderr, "  %s [OPTION]... [VIEW] [DELAY]\n", __progname);
 	fprintf(stderr, "\nGeneral options:\n");
+	fprintf(stderr, "  -A           display moving averages of rates\n");
 	fprintf(stderr, "  -a           display all lines\n");
 	fprintf(stderr, "  -B           non-interactive mode, exit after two "
 			"update\n");
 	fprintf(stderr, "  -b           non-interactive mode, exit after one "
 			"update\n");
-	fprintf(stderr, "  -d count     exit after count screen updates\n");
+	fprintf(stderr, "  -C count     exit after count screen updates\n");
+	fprintf(stderr, "  -D, --serve socket\n"
+			"               query the server for pg_systat attached to "
+			"socket\n");
+	fprintf(stderr, "  -F minutes   keep the last minutes of statistics for "
+			"dumping\n");
+	fprintf(stderr, "  -G, --serve-group group\n"
+			"               let group attach to the --serve socket\n");
+	fprintf(stderr, "  -f filter    show only the tables, indexes and "
+			"databases matching filter\n");
 	fprintf(stderr, "  -i           interactive mode\n");
+	fprintf(stderr, "  -J, --attach socket\n"
+			"               query through the pg_systat serving socket\n");
+	fprintf(stderr, "  -L [host:]port\n"
+			"               serve statistics to Prometheus over HTTP\n");
+	fprintf(stderr, "  -M file[@time]\n"
+			"               show changes since the time recorded to file\n");
+	fprintf(stderr, "  -N rows      have the server compute changes and "
+			"return only the top rows\n");
+	fprintf(stderr, "  -O format    non-interactive mode, print every row as csv "
+			"or json\n");
+	fprintf(stderr, "  -o file      record statistics to file\n");
+	fprintf(stderr, "  -R file      replay statistics recorded to file\n");
+	fprintf(stderr, "  -S interval  sampling interval of the sample views\n");
+	fprintf(stderr, "  -T budget    query time allowed, as N%% of one core or N "
+			"ms per second\n");
+	fprintf(stderr, "  -t seconds   cancel queries taking longer, 0 to never\n");
+	fprintf(stderr, "  -w width     maximum width of non-interactive output\n");
 	fprintf(stderr, "\nConnection options:\n");
 	fprintf(stderr, "  -d dbname    database name to connect to\n");
 	fprintf(stderr, "  -h host      database server host or socket "
@@ -268,7 +357,8 @@ show_view(void)
 		return;
 
 	tb_start();
-	tbprintf("%s %g", curr_view->name, naptime);
+	tbprintf("%s %g", curr_view->name,
+			 curr_mgr != NULL ? view_interval(curr_mgr) / 1000000.0 : naptime);
 	tb_end();
 	message_set(tmp_buf);
 }
@@ -377,11 +467,30 @@ cmd_delay(const char *buf)
 	if (del > 0)
 	{
 		udelay = (useconds_t) (del * 1000000);
+		refresh_tiers = 0;
 		gotsig_alarm = 1;
 		naptime = del;
 	}
 }
 
+void
+cmd_seek(const char *buf)
+{
+	if (replay_seek(buf) == -1)
+		error("Invalid time: %s", buf);
+	else
+		gotsig_alarm = 1;
+}
+
+void
+cmd_filter(const char *buf)
+{
+	if (filter_set(buf) == -1)
+		error("Invalid filter: %s", buf);
+	else
+		gotsig_alarm = 1;
+}
+
 void
 cmd_count(const char *buf)
 {
@@ -441,6 +550,45 @@ format_b(long long amt)
 	return (ret);
 }
 
+/*
+ * The query budget, as a percentage of one core, with or without %, or as
+ * milliseconds of queries per second.
+ */
+static int
+parse_budget(const char *s)
+{
+	char	   *end;
+	double		n;
+
+	n = strtod(s, &end);
+	if (end == s || n <= 0)
+		return -1;
+	if (strcmp(end, "ms") == 0)
+		n /= 10;
+	else if (strcmp(end, "%") != 0 && *end != '\0')
+		return -1;
+	if (n > 100)
+		return -1;
+	query_budget = n / 100;
+	return 0;
+}
+
+/*
+ * The statement timeout, in seconds, 0 for none.
+ */
+static int
+parse_timeout(const char *s)
+{
+	char	   *end;
+	double		n;
+
+	n = strtod(s, &end);
+	if (end == s || *end != '\0' || !(n >= 0) || n * 1000 > INT_MAX)
+		return -1;
+	statement_timeout = n * 1000;
+	return 0;
+}
+
 int
 keyboard_callback(int ch)
 {
@@ -466,6 +614,55 @@ keyboard_callback(int ch)
 			separate_thousands = !separate_thousands;
 			gotsig_alarm = 1;
 			break;
+		case 'A':
+			show_averages = !show_averages;
+			field_setup();
+			need_update = 1;
+			break;
+		case '|':
+			command_set(&cm_filter, filter_get());
+			break;
+		case '/':
+			search_start();
+			break;
+		case 'X':
+			recorder_dump();
+			need_update = 1;
+			break;
+		case 'k':
+			bookmark_set();
+			gotsig_alarm = 1;
+			error("Bookmarked");
+			break;
+		case 'K':
+			if (!bookmark_isset())
+			{
+				error("No bookmark, set one with k");
+				break;
+			}
+			since_bookmark = !since_bookmark;
+			gotsig_alarm = 1;
+			break;
+		case '.':
+			if (!replaying)
+				return 0;
+			replay_step();
+			paused = 1;
+			step = 1;
+			gotsig_alarm = 1;
+			break;
+		case '<':
+		case '>':
+			if (!replaying)
+				return 0;
+			replay_speed(ch == '>');
+			need_update = 1;
+			break;
+		case 'g':
+			if (!replaying)
+				return 0;
+			command_set(&cm_seek, NULL);
+			break;
 		case ':':
 			command_set(&cm_compat, NULL);
 			break;
@@ -481,6 +678,9 @@ initialize(void)
 {
 	engine_initialize();
 
+	/* the queries run for every view, for the daemon to run for viewers */
+	serve_allow(QUERY_VERSION);
+
 	/* Initialize in order to appear in interactive mode. */
 	initdbxact();
 	initdbblk();
@@ -507,6 +707,8 @@ initialize(void)
 	initcopyprogress();
 	initbuffercacherel();
 	initbuffercachestat();
+	initsample();
+	initself();
 }
 
 int
@@ -516,8 +718,17 @@ main(int argc, char *argv[])
 	extern char *optarg;
 	extern int	optind;
 	double		delay = 5;
+	double		sample = 0.25;
 
 	char	   *viewstr = NULL;
+	char	   *bookmarkstr = NULL;
+	char	   *listenstr = NULL;
+	char	   *replaystr = NULL;
+	char	   *servestr = NULL;
+	char	   *attachstr = NULL;
+	char	   *groupstr = NULL;
+	struct group *gr;
+	gid_t		gid = (gid_t) -1;
 
 	int			countmax = 0;
 	int			maxlines = 0;
@@ -525,23 +736,88 @@ main(int argc, char *argv[])
 	int			ch;
 	int			optindex;
 	static struct option long_options[] = {
+		{"attach", required_argument, NULL, 'J'},
 		{"dbname", required_argument, NULL, 'd'},
 		{"host", required_argument, NULL, 'h'},
 		{"port", required_argument, NULL, 'p'},
+		{"bookmark", required_argument, NULL, 'M'},
+		{"filter", required_argument, NULL, 'f'},
+		{"format", required_argument, NULL, 'O'},
+		{"listen", required_argument, NULL, 'L'},
+		{"record", required_argument, NULL, 'o'},
+		{"top", required_argument, NULL, 'N'},
+		{"budget", required_argument, NULL, 'T'},
+		{"statement-timeout", required_argument, NULL, 't'},
+		{"replay", required_argument, NULL, 'R'},
+		{"serve", required_argument, NULL, 'D'},
+		{"serve-group", required_argument, NULL, 'G'},
 		{"username", required_argument, NULL, 'U'},
 		{NULL, 0, NULL, 0}
 	};
 
 	memset(&options, 0, sizeof(struct adhoc_opts));
-	while ((ch = getopt_long(argc, argv, "BCU:Wabd:h:ip:s:", long_options,
-							 &optindex)) != -1)
+	options.values[PG_APPNAME] = "pg_systat";
+	while ((ch = getopt_long(argc, argv,
+							 "ABC:D:F:G:J:L:M:N:O:R:S:T:U:Wabd:f:h:io:p:s:t:w:",
+							 long_options, &optindex)) != -1)
 	{
 		switch (ch)
 		{
+			case 'A':
+				show_averages = 1;
+				break;
 			case 'C':
 				countmax = strtonum(optarg, 1, INT_MAX, &errstr);
 				if (errstr)
-					errx(1, "-d %s: %s", optarg, errstr);
+					errx(1, "-C %s: %s", optarg, errstr);
+				break;
+			case 'D':
+				servestr = optarg;
+				interactive = 0;
+				break;
+			case 'F':
+				recorder_init(atof(optarg));
+				break;
+			case 'G':
+				groupstr = optarg;
+				break;
+			case 'J':
+				attachstr = optarg;
+				break;
+			case 'L':
+				listenstr = optarg;
+				interactive = 0;
+				break;
+			case 'M':
+				bookmarkstr = optarg;
+				break;
+			case 'N':
+				top_rows = strtonum(optarg, 1, INT_MAX, &errstr);
+				if (errstr)
+					errx(1, "-N %s: %s", optarg, errstr);
+				break;
+			case 'T':
+				if (parse_budget(optarg) == -1)
+					errx(1, "-T %s: invalid budget", optarg);
+				break;
+			case 't':
+				if (parse_timeout(optarg) == -1)
+					errx(1, "-t %s: invalid timeout", optarg);
+				break;
+			case 'O':
+				if (output_set_format(optarg) == -1)
+					errx(1, "-O %s: unknown format", optarg);
+				rawmode = 1;
+				interactive = 0;
+				maxlines = -1;
+				break;
+			case 'R':
+				replaystr = optarg;
+				break;
+			case 'S':
+				sample = atof(optarg);
+				if (sample <= 0)
+					sample = 0.25;
 				break;
 			case 'U':
 				options.values[PG_USER] = _strdup(optarg);
@@ -565,12 +841,20 @@ main(int argc, char *argv[])
 			case 'd':
 				options.values[PG_DBNAME] = _strdup(optarg);
 				break;
+			case 'f':
+				if (filter_set(optarg) == -1)
+					errx(1, "-f %s: invalid filter", optarg);
+				break;
 			case 'h':
 				options.values[PG_HOST] = _strdup(optarg);
 				break;
 			case 'i':
 				interactive = 1;
 				break;
+			case 'o':
+				if (recorder_open(optarg) == -1)
+					err(1, "-o %s", optarg);
+				break;
 			case 'p':
 				options.values[PG_PORT] = _strdup(optarg);
 				break;
@@ -578,6 +862,7 @@ main(int argc, char *argv[])
 				delay = atof(optarg);
 				if (delay <= 0)
 					delay = 5;
+				refresh_tiers = 0;
 				break;
 			case 'w':
 				rawwidth = strtonum(optarg, 1, MAX_LINE_BUF - 1, &errstr);
@@ -593,6 +878,42 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
+	if ((servestr != NULL || attachstr != NULL) && replaystr != NULL)
+		errx(1, "-R cannot be combined with --serve or --attach");
+
+	/* the bookmark is read before the recording to replay is opened */
+	if (bookmarkstr != NULL && bookmark_load(bookmarkstr) == -1)
+		err(1, "-M %s", bookmarkstr);
+	if (replaystr != NULL && replay_open(replaystr) == -1)
+		err(1, "-R %s", replaystr);
+	if (listenstr != NULL && exporter_open(listenstr) == -1)
+		err(1, "-L %s", listenstr);
+	if (groupstr != NULL)
+	{
+		if (servestr == NULL)
+			errx(1, "--serve-group requires --serve");
+		if ((gr = getgrnam(groupstr)) != NULL)
+			gid = gr->gr_gid;
+		else
+		{
+			gid = strtonum(groupstr, 0, INT_MAX, &errstr);
+			if (errstr)
+				errx(1, "--serve-group %s: no such group", groupstr);
+		}
+	}
+	if (servestr != NULL)
+	{
+		if (serve_open(servestr, gid) == -1)
+			err(1, "--serve %s", servestr);
+		/* the views allow the queries the daemon runs for viewers */
+		initialize();
+		serve_loop();
+		recorder_close();
+		return 0;
+	}
+	if (attachstr != NULL && serve_attach(attachstr) == -1)
+		err(1, "--attach %s", attachstr);
+
 	if (argc == 1)
 	{
 		double		del = atof(argv[0]);
@@ -600,7 +921,10 @@ main(int argc, char *argv[])
 		if (del == 0)
 			viewstr = argv[0];
 		else
+		{
 			delay = del;
+			refresh_tiers = 0;
+		}
 	}
 	else if (argc == 2)
 	{
@@ -608,6 +932,7 @@ main(int argc, char *argv[])
 		delay = atof(argv[1]);
 		if (delay <= 0)
 			delay = 5;
+		refresh_tiers = 0;
 	}
 
 	udelay = (useconds_t) (delay * 1000000.0);
@@ -616,8 +941,19 @@ main(int argc, char *argv[])
 
 	naptime = (double) udelay / 1000000.0;
 
+	usample = (useconds_t) (sample * 1000000.0);
+	if (usample < 1)
+		usample = 1;
+
 	initialize();
 
+	if (listenstr != NULL)
+	{
+		exporter_loop();
+		recorder_close();
+		return 0;
+	}
+
 	set_order(NULL);
 	if (viewstr && set_view(viewstr))
 	{
@@ -633,12 +969,14 @@ main(int argc, char *argv[])
 
 	setup_term(maxlines);
 
-	if (rawmode && countmax == 0)
+	/* machine readable output goes on until interrupted */
+	if (rawmode && countmax == 0 && output_format == OUTPUT_NONE)
 		countmax = 1;
 
 	gotsig_alarm = 1;
 
 	engine_loop(countmax);
+	recorder_close();
 
 	return 0;
 }
@@ -0,0 +1,419 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "replay.h"
+
+#define OUTPUT_BUF_LEN	65536	/* initial size of the frame buffer */
+#define OUTPUT_MAX_COLS	64
+
+#define MINIMUM(a, b) (((a) < (b)) ? (a) : (b))
+
+/* where the value of a field of the current row is in rowbuf */
+struct output_cell
+{
+	size_t		offset;
+	int			len;			/* -1 if the field has no value */
+	int			quote;			/* a string rather than a number */
+};
+
+int			output_format = OUTPUT_NONE;
+
+/* everything printed since the last refresh was written out */
+static char *outbuf = NULL;
+static size_t outlen = 0;
+static size_t outsize = 0;
+
+/* the shown fields of the current view, and those of the last CSV header */
+static field_def *cols[OUTPUT_MAX_COLS];
+static int	ncols = 0;
+static field_def *header_cols[OUTPUT_MAX_COLS];
+static int	header_ncols = -1;
+static int	last_col = -1;
+
+static struct output_cell cells[OUTPUT_MAX_COLS];
+static int	row_cells = 0;
+static char *rowbuf = NULL;
+static size_t rowlen = 0;
+static size_t rowsize = 0;
+
+static char timestamp[32];
+
+int
+output_set_format(const char *name)
+{
+	if (strcmp(name, "csv") == 0)
+		output_format = OUTPUT_CSV;
+	else if (strcmp(name, "json") == 0 || strcmp(name, "jsonl") == 0)
+		output_format = OUTPUT_JSON;
+	else
+		return -1;
+	return 0;
+}
+
+static void
+write_all(const char *p, size_t len)
+{
+	ssize_t		n;
+
+	while (len > 0)
+	{
+		if ((n = write(STDOUT_FILENO, p, len)) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		p += n;
+		len -= n;
+	}
+}
+
+/*
+ * Write out the frame, the output of a whole refresh, in one write() unless
+ * it goes to a pipe or terminal that takes less at a time.
+ */
+void
+output_flush(void)
+{
+	write_all(outbuf, outlen);
+	outlen = 0;
+}
+
+/*
+ * Append to the frame.  The buffer is kept from one frame to the next and
+ * only grows, to the size of the largest frame; should it fail to, the frame
+ * is written out in parts instead.
+ */
+void
+output_write(const char *s, size_t len)
+{
+	char	   *p;
+	size_t		size;
+
+	if (outlen + len > outsize)
+	{
+		size = outsize > 0 ? outsize : OUTPUT_BUF_LEN;
+		while (outlen + len > size)
+			size *= 2;
+		if ((p = realloc(outbuf, size)) != NULL)
+		{
+			outbuf = p;
+			outsize = size;
+		}
+		else
+		{
+			output_flush();
+			if (len > outsize)
+			{
+				write_all(s, len);
+				return;
+			}
+		}
+	}
+	memcpy(outbuf + outlen, s, len);
+	outlen += len;
+}
+
+void
+output_spaces(int n)
+{
+	static const char spaces[] = "                                ";
+
+	while (n > 0)
+	{
+		output_write(spaces, MINIMUM(n, sizeof(spaces) - 1));
+		n -= sizeof(spaces) - 1;
+	}
+}
+
+void
+output_line(const char *s)
+{
+	output_write(s, strlen(s));
+	output_write("\n", 1);
+}
+
+static void
+out_str(const char *s)
+{
+	output_write(s, strlen(s));
+}
+
+static void
+out_csv(const char *s, size_t len)
+{
+	size_t		i,
+				start;
+
+	for (i = 0; i < len; i++)
+		if (s[i] == ',' || s[i] == '"' || s[i] == '\r' || s[i] == '\n')
+			break;
+	if (i == len)
+	{
+		output_write(s, len);
+		return;
+	}
+
+	output_write("\"", 1);
+	for (i = start = 0; i < len; i++)
+	{
+		if (s[i] != '"')
+			continue;
+		output_write(s + start, i - start + 1);
+		output_write("\"", 1);
+		start = i + 1;
+	}
+	output_write(s + start, len - start);
+	output_write("\"", 1);
+}
+
+static void
+out_json(const char *s, size_t len)
+{
+	char		esc[8];
+	size_t		i,
+				start;
+	unsigned char c;
+
+	output_write("\"", 1);
+	for (i = start = 0; i < len; i++)
+	{
+		c = (unsigned char) s[i];
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		output_write(s + start, i - start);
+		if (c == '"' || c == '\\')
+		{
+			esc[0] = '\\';
+			esc[1] = c;
+			output_write(esc, 2);
+		}
+		else
+			output_write(esc, snprintf(esc, sizeof(esc), "\\u%04x", c));
+		start = i + 1;
+	}
+	output_write(s + start, len - start);
+	output_write("\"", 1);
+}
+
+/*
+ * Start the output of a refresh: note the time of the refresh and the fields
+ * of the view that are shown, writing a CSV header if they changed.
+ */
+void
+output_start(void)
+{
+	struct timespec ts;
+	field_def **fp;
+	struct tm  *tm;
+	time_t		t;
+	long		ms;
+	int			i;
+
+	ncols = 0;
+	last_col = -1;
+	if (curr_view != NULL && curr_view->view != NULL)
+		for (fp = curr_view->view; *fp != NULL && ncols < OUTPUT_MAX_COLS;
+			 fp++)
+			if (!field_hidden(*fp))
+				cols[ncols++] = *fp;
+	for (i = 0; i < ncols; i++)
+		cells[i].len = -1;
+	row_cells = 0;
+	rowlen = 0;
+
+	if (replaying)
+	{
+		t = replay_clock() / 1000;
+		ms = replay_clock() % 1000;
+	}
+	else
+	{
+		clock_gettime(CLOCK_REALTIME, &ts);
+		t = ts.tv_sec;
+		ms = ts.tv_nsec / 1000000;
+	}
+	tm = gmtime(&t);
+	i = strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", tm);
+	snprintf(timestamp + i, sizeof(timestamp) - i, ".%03ldZ", ms);
+
+	if (output_format != OUTPUT_CSV)
+		return;
+	if (ncols == header_ncols &&
+		memcmp(cols, header_cols, ncols * sizeof(cols[0])) == 0)
+		return;
+
+	out_str("time,view");
+	for (i = 0; i < ncols; i++)
+	{
+		output_write(",", 1);
+		out_csv(cols[i]->title, strlen(cols[i]->title));
+	}
+	output_write("\n", 1);
+	memcpy(header_cols, cols, ncols * sizeof(cols[0]));
+	header_ncols = ncols;
+}
+
+/*
+ * Fields are mostly printed in the order of the view, so look for the field
+ * after the previous one first.
+ */
+static int
+output_column(field_def * fld)
+{
+	int			i;
+
+	for (i = last_col + 1; i < ncols; i++)
+		if (cols[i] == fld)
+			return (last_col = i);
+	for (i = 0; i <= last_col && i < ncols; i++)
+		if (cols[i] == fld)
+			return (last_col = i);
+	return -1;
+}
+
+static void
+output_cell(field_def * fld, const char *s, size_t len, int quote)
+{
+	char	   *p;
+	size_t		size;
+	int			col;
+
+	if (fld == NULL || (col = output_column(fld)) == -1)
+		return;
+
+	if (rowlen + len > rowsize)
+	{
+		size = rowsize > 0 ? rowsize : MAX_LINE_BUF;
+		while (rowlen + len > size)
+			size *= 2;
+		if ((p = realloc(rowbuf, size)) == NULL)
+			return;
+		rowbuf = p;
+		rowsize = size;
+	}
+	memcpy(rowbuf + rowlen, s, len);
+	cells[col].offset = rowlen;
+	cells[col].len = len;
+	cells[col].quote = quote;
+	rowlen += len;
+	row_cells++;
+}
+
+void
+output_str(field_def * fld, const char *str)
+{
+	if (str != NULL)
+		output_cell(fld, str, strlen(str), 1);
+}
+
+void
+output_int(field_def * fld, int64_t n)
+{
+	char		buf[24];
+	char	   *p,
+			   *end = buf + sizeof(buf);
+
+	if (n < 0)
+	{
+		p = format_uint(end, -(u_int64_t) n, 0);
+		*--p = '-';
+	}
+	else
+		p = format_uint(end, n, 0);
+	output_cell(fld, p, end - p, 0);
+}
+
+void
+output_uint(field_def * fld, u_int64_t n)
+{
+	char		buf[24];
+	char	   *p,
+			   *end = buf + sizeof(buf);
+
+	p = format_uint(end, n, 0);
+	output_cell(fld, p, end - p, 0);
+}
+
+void
+output_double(field_def * fld, double n)
+{
+	char		buf[32];
+
+	if (!isfinite(n))
+		return;
+	output_cell(fld, buf, snprintf(buf, sizeof(buf), "%.15g", n), 0);
+}
+
+/*
+ * A field whose value is unknown, written as an empty CSV field or null.
+ */
+void
+output_null(field_def * fld)
+{
+	output_column(fld);
+}
+
+void
+output_end_row(void)
+{
+	int			i;
+
+	if (row_cells == 0)
+		return;
+
+	if (output_format == OUTPUT_CSV)
+	{
+		out_str(timestamp);
+		output_write(",", 1);
+		out_csv(curr_view->name, strlen(curr_view->name));
+		for (i = 0; i < ncols; i++)
+		{
+			output_write(",", 1);
+			if (cells[i].len < 0)
+				continue;
+			if (cells[i].quote)
+				out_csv(rowbuf + cells[i].offset, cells[i].len);
+			else
+				output_write(rowbuf + cells[i].offset, cells[i].len);
+		}
+		output_write("\n", 1);
+	}
+	else
+	{
+		out_str("{\"time\":\"");
+		out_str(timestamp);
+		out_str("\",\"view\":");
+		out_json(curr_view->name, strlen(curr_view->name));
+		for (i = 0; i < ncols; i++)
+		{
+			output_write(",", 1);
+			out_json(cols[i]->title, strlen(cols[i]->title));
+			output_write(":", 1);
+			if (cells[i].len < 0)
+				out_str("null");
+			else if (cells[i].quote)
+				out_json(rowbuf + cells[i].offset, cells[i].len);
+			else
+				output_write(rowbuf + cells[i].offset, cells[i].len);
+		}
+		output_write("}\n", 2);
+	}
+
+	for (i = 0; i < ncols; i++)
+		cells[i].len = -1;
+	row_cells = 0;
+	rowlen = 0;
+	last_col = -1;
+}
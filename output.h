@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "engine.h"
+
+/*
+ * Everything raw mode prints for a refresh is assembled in one frame buffer
+ * and written out with a single write() at the end of the refresh, rather
+ * than going through stdio line by line.
+ *
+ * In machine readable batch output, instead of padding every value into its
+ * column, the print_fld_* functions hand the value itself to the functions
+ * below, which add one CSV line or JSON object per row to the frame with
+ * every shown field of the view at full precision, preceded by the time of
+ * the refresh and the name of the view.  A CSV header is written whenever the
+ * columns change.
+ */
+#define OUTPUT_NONE		0
+#define OUTPUT_CSV		1
+#define OUTPUT_JSON		2
+
+extern int	output_format;
+
+int			output_set_format(const char *);
+void		output_start(void);
+void		output_str(field_def *, const char *);
+void		output_int(field_def *, int64_t);
+void		output_uint(field_def *, u_int64_t);
+void		output_double(field_def *, double);
+void		output_null(field_def *);
+void		output_end_row(void);
+void		output_flush(void);
+void		output_write(const char *, size_t);
+void		output_spaces(int);
+void		output_line(const char *);
+
+#endif							/* _OUTPUT_H_ */
@@ -2,55 +2,366 @@
  * Copyright (c) 2019 PostgreSQL Global Development Group
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#ifdef __linux__
+#include <bsd/string.h>
+#endif							/* __linux__ */
 
 #include "pg.h"
+#include "bookmark.h"
+#include "filter.h"
+#include "recorder.h"
+#include "replay.h"
+#include "self.h"
+#include "serve.h"
 
-const char *keywords[6] = {"host", "port", "user", "password", "dbname", NULL};
+#define SET_SESSION \
+		"SET SESSION CHARACTERISTICS AS TRANSACTION ISOLATION LEVEL " \
+		"READ UNCOMMITTED;"
+
+/*
+ * From PostgreSQL 15 on the statistics are fetched from shared memory as they
+ * are accessed, and cached per object only, unless asked to be snapshotted
+ * all at once.  Older servers read a snapshot of all of them at the first
+ * access of a transaction.
+ */
+#define BEGIN_TICK "BEGIN;"
+#define BEGIN_TICK_15 "BEGIN; SET LOCAL stats_fetch_consistency = snapshot;"
+
+/*
+ * Whether the queries are run in the transaction of a read of a view, and
+ * whether the transaction was begun, at the first connect_to_db() of the read.
+ */
+enum tick_state
+{
+	TICK_NONE,
+	TICK_READING,
+	TICK_BEGUN
+};
+
+const char *keywords[7] = {"host", "port", "user", "password", "dbname",
+"fallback_application_name", NULL};
 struct adhoc_opts options;
+int			top_rows = 0;
+double		query_budget = 0;
+int			statement_timeout = 30000;
+
+/* time spent connecting and waiting for queries, in microseconds */
+static int64_t query_usec = 0;
+
+static enum tick_state tick = TICK_NONE;
+
+/* the current view asked for the connection to be kept open */
+static int	kept = 0;
+
+static int64_t
+monotonic_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void
+tick_exec(const char *query)
+{
+	int64_t		start = monotonic_usec();
+
+	PQclear(PQexec(options.connection, query));
+	query_usec += monotonic_usec() - start;
+}
+
+/*
+ * Begin the transaction of the read of a view on the connection just made or
+ * kept open.  A read without queries, or from a recording, begins none.
+ */
+static void
+tick_begin()
+{
+	if (tick != TICK_READING)
+		return;
+
+	tick = TICK_BEGUN;
+	if (options.connection == NULL)
+		return;
+	tick_exec(PQserverVersion(options.connection) >= 150000 ?
+			  BEGIN_TICK_15 : BEGIN_TICK);
+}
+
+/*
+ * Start the transaction of the read over, after a query failed and aborted
+ * it, for the next queries to run, or after a table was created in it, for
+ * the table to stay.  The queries after this no longer see the same
+ * statistics as those before.
+ */
+static void
+tick_restart()
+{
+	if (tick != TICK_BEGUN || options.connection == NULL)
+		return;
+
+	tick_exec(PQserverVersion(options.connection) >= 150000 ?
+			  "COMMIT; " BEGIN_TICK_15 : "COMMIT; " BEGIN_TICK);
+}
 
 void
 connect_to_db()
 {
-	int			i;
+	char		set[128];
+	int64_t		start;
 
-	if (options.persistent && PQsocket(options.connection) >= 0)
+	if (replaying || attached || tick == TICK_BEGUN)
+		return;
+	if ((options.persistent || kept) && PQsocket(options.connection) >= 0)
+	{
+		tick_begin();
 		return;
+	}
 
+	start = monotonic_usec();
 	options.connection = PQconnectdbParams(keywords, options.values, 1);
 	if (PQstatus(options.connection) != CONNECTION_OK)
 	{
 		PQfinish(options.connection);
 		options.connection = NULL;
+		query_usec += monotonic_usec() - start;
+		tick_begin();
 		return;
 	}
 
-	if (options.persistent)
-		for (i = 0; i < 5; i++)
-			if (options.values[i] != NULL)
-				free((void *) options.values[i]);
+	/* a statistics query that runs away is cancelled rather than waited for */
+	if (statement_timeout > 0)
+		snprintf(set, sizeof(set), SET_SESSION " SET statement_timeout = %d;",
+				 statement_timeout);
+	else
+		strlcpy(set, SET_SESSION, sizeof(set));
+	PQclear(PQexec(options.connection, set));
+	query_usec += monotonic_usec() - start;
+	tick_begin();
+}
+
+/*
+ * Keep the connection open, as -W does, until another view is selected.  Used
+ * by views that query far more often than once per refresh.
+ */
+void
+keep_connection()
+{
+	kept = 1;
+}
 
-	PQexec(options.connection,
-		   "SET SESSION CHARACTERISTICS AS TRANSACTION ISOLATION LEVEL " \
-		   "READ UNCOMMITTED;");
+/*
+ * Close the connection kept open for the view left, unless -W keeps it.
+ */
+void
+release_connection()
+{
+	if (!kept)
+		return;
+	kept = 0;
+	if (options.persistent || tick != TICK_NONE)
+		return;
+	PQfinish(options.connection);
+	options.connection = NULL;
 }
 
 void
 disconnect_from_db()
 {
-	if (options.persistent)
+	if (options.persistent || kept || tick != TICK_NONE)
 		return;
 	PQfinish(options.connection);
+	options.connection = NULL;
+}
+
+/*
+ * Run the queries of a read of a view, until pg_tick_end(), on one connection
+ * and in one transaction, for all of them to see the statistics as they were
+ * at the same time and for the server to take a snapshot of them only once.
+ */
+void
+pg_tick_begin()
+{
+	if (tick == TICK_NONE)
+		tick = TICK_READING;
+}
+
+void
+pg_tick_end()
+{
+	enum tick_state was = tick;
+
+	tick = TICK_NONE;
+	if (was != TICK_BEGUN || options.connection == NULL)
+		return;
+	tick_exec("COMMIT;");
+	disconnect_from_db();
+}
+
+/*
+ * Whether there is a connection to query, a recording to replay, or a daemon
+ * attached to.
+ */
+int
+pg_connected()
+{
+	return options.connection != NULL || replaying || attached;
+}
+
+/*
+ * The version number of the server queried, or of the server the replayed
+ * statistics were recorded from.
+ */
+int
+pg_server_version()
+{
+	if (replaying)
+		return replay_server_version();
+	if (attached)
+		return serve_server_version();
+	return PQserverVersion(options.connection);
+}
+
+/*
+ * When the last statistics query returned, on the clock of the recording when
+ * replaying.  Per second rates are computed from this.
+ */
+void
+pg_taken(struct timespec *ts)
+{
+	if (reading_bookmark)
+		bookmark_taken(ts);
+	else if (replaying)
+		replay_taken(ts);
+	else if (attached)
+		serve_taken(ts);
+	else
+		clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+/*
+ * Run a statistics query on the current connection.  All queries of the views
+ * go through here so that the flight recorder and the bookmark see their
+ * results, and so that they can be answered from a recording, the bookmark or
+ * the daemon attached to instead.
+ */
+PGresult *
+pg_exec(const char *query)
+{
+	PGresult   *pgresult;
+	int64_t		start,
+				usec;
+
+	if (reading_bookmark)
+		return bookmark_exec(query);
+
+	if (replaying)
+		pgresult = replay_exec(query);
+	else
+	{
+		start = monotonic_usec();
+		if (attached)
+			pgresult = serve_exec(query);
+		else
+			pgresult = PQexec(options.connection, query);
+		usec = monotonic_usec() - start;
+		query_usec += usec;
+		self_query(usec, pgresult);
+		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
+			recorder_add(query, pgresult);
+		else
+			tick_restart();
+	}
+
+	if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
+		bookmark_add(query, pgresult);
+	return pgresult;
+}
+
+/*
+ * The time spent so far connecting to the server and waiting for the results
+ * of queries, in microseconds.  This is what the queries cost the server as
+ * far as can be told from here, and a little more, for the network.
+ */
+int64_t
+pg_query_usec()
+{
+	return query_usec;
 }
 
 int
 pg_version()
 {
 	connect_to_db();
-	int			version = PQserverVersion(options.connection) / 100;
+	int			version = pg_server_version() / 100;
 
 	disconnect_from_db();
 	return version;
 }
+
+/*
+ * Check whether the statistics in "pgresult" were reset since the previous
+ * check of the same epoch, whether replay jumped to another time, or whether
+ * the filters on the rows changed.  "column" is the STATS_EPOCH_* column the
+ * query ends with.  Views re-baseline their counters when this returns 1
+ * instead of showing the difference between unrelated snapshots.  The first
+ * check only records the epoch, and a result without rows is not checked.
+ */
+int
+stats_reset(struct stats_epoch *epoch, const PGresult *pgresult, int column)
+{
+	const char *ident;
+	int			reset;
+
+	if (PQntuples(pgresult) == 0 || column >= PQnfields(pgresult) ||
+		PQgetisnull(pgresult, 0, column))
+		return 0;
+
+	ident = PQgetvalue(pgresult, 0, column);
+	reset = epoch->ident[0] != '\0' &&
+		(strncmp(epoch->ident, ident, STATS_EPOCH_LEN - 1) != 0 ||
+		 epoch->replay != replay_generation() ||
+		 epoch->filter != filter_generation());
+	strlcpy(epoch->ident, ident, STATS_EPOCH_LEN);
+	epoch->replay = replay_generation();
+	epoch->filter = filter_generation();
+
+	return reset;
+}
+
+/*
+ * Create a temporary table for the current session, unless it was already
+ * created in it.  *pid is the backend the table was last created in, or 0.
+ * Nothing is created when replaying, where the queries using the table are
+ * answered from the recording.  Returns -1 if the table cannot be created,
+ * as on a standby.
+ */
+int
+pg_session_table(int *pid, const char *create)
+{
+	PGresult   *pgresult;
+	int			rc = 0;
+
+	if (replaying)
+		return 0;
+	if (options.connection == NULL)
+		return -1;
+	if (*pid != 0 && *pid == PQbackendPID(options.connection))
+		return 0;
+
+	pgresult = PQexec(options.connection, create);
+	if (PQresultStatus(pgresult) == PGRES_COMMAND_OK)
+		*pid = PQbackendPID(options.connection);
+	else
+		rc = -1;
+	PQclear(pgresult);
+	tick_restart();
+	return rc;
+}
@@ -5,6 +5,8 @@
 #ifndef _PG_H_
 #define _PG_H_
 
+#include <stdint.h>
+#include <time.h>
 #include <libpq-fe.h>
 #include "pg_config_manual.h"
 
@@ -12,26 +14,90 @@
 #define QUERY_STAT_STMT_EXIST \
 				"SELECT * from pg_extension where extname = 'pg_stat_statements'"
 
+/*
+ * What identifies a pg_stat_statements entry.  The same queryid is shared by
+ * a statement run by different users or in different databases, and from
+ * PostgreSQL 14 on by its top level and nested executions.
+ */
+#define STMT_KEY "concat_ws(' ', userid, dbid, queryid)"
+#define STMT_KEY_14 "concat_ws(' ', userid, dbid, queryid, toplevel)"
+
 enum pgparams
 {
 	PG_HOST,
 	PG_PORT,
 	PG_USER,
 	PG_PASSWORD,
-	PG_DBNAME
+	PG_DBNAME,
+	PG_APPNAME
+};
+
+/*
+ * The column that statistics queries end with for stats_reset(): what their
+ * cumulative statistics are counted from.  The server's start time tells of
+ * a restart or a failover to another server, and the reset time of the
+ * current database, or of pg_stat_statements from PostgreSQL 14 on, of a
+ * reset of the statistics.
+ */
+#define STATS_EPOCH_DATABASE \
+		"concat_ws(' ', pg_postmaster_start_time(),\n" \
+		"          (SELECT stats_reset FROM pg_stat_database\n" \
+		"           WHERE datname = current_database()))\n" \
+		"       AS stats_epoch"
+#define STATS_EPOCH_STATEMENTS \
+		"pg_postmaster_start_time()::text AS stats_epoch"
+#define STATS_EPOCH_STATEMENTS_14 \
+		"concat_ws(' ', pg_postmaster_start_time(),\n" \
+		"          (SELECT stats_reset FROM pg_stat_statements_info))\n" \
+		"       AS stats_epoch"
+
+#define STATS_EPOCH_LEN 160
+
+struct stats_epoch
+{
+	char		ident[STATS_EPOCH_LEN];
+	unsigned int replay;		/* replay_generation() of the last check */
+	unsigned int filter;		/* filter_generation() of the last check */
 };
 
 struct adhoc_opts
 {
 	int			persistent;
 	PGconn	   *connection;
-	const char *values[6];
+	const char *values[7];
 };
 
 extern struct adhoc_opts options;
 
+/*
+ * Number of rows of the views that support it to have the server compute the
+ * changes of and return, rather than every row, or 0 to fetch every row.
+ */
+extern int	top_rows;
+
+/*
+ * The share of the time of one core, as a fraction, that connecting and
+ * running queries may take on average, or 0 for no limit; views are read
+ * less often than their interval when their queries would take more.  And
+ * the statement_timeout of the connections in milliseconds, or 0 to keep the
+ * one of the server.
+ */
+extern double query_budget;
+extern int	statement_timeout;
+
 void		connect_to_db();
 void		disconnect_from_db();
+void		keep_connection();
+void		release_connection();
 int			pg_version();
+int			pg_connected();
+int			pg_server_version();
+void		pg_taken(struct timespec *);
+PGresult   *pg_exec(const char *);
+int64_t		pg_query_usec();
+int			stats_reset(struct stats_epoch *, const PGresult *, int);
+int			pg_session_table(int *, const char *);
+void		pg_tick_begin();
+void		pg_tick_end();
 
 #endif							/* _PG_H_ */
@@ -65,6 +65,8 @@ int			initstmtwal(void);
 int			initcopyprogress(void);
 int			initbuffercacherel(void);
 int			initbuffercachestat(void);
+int			initsample(void);
+int			initself(void);
 
 void		error(const char *fmt,...);
 char	   *format_b(long long);
@@ -0,0 +1,781 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#include <sys/queue.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <bsd/sys/tree.h>
+#endif							/* __linux__ */
+
+#include "pg.h"
+#include "pg_systat.h"
+#include "recorder.h"
+
+/* what a cell of the previous result of a query held */
+#define KIND_NULL	0
+#define KIND_NUM	1
+#define KIND_TEXT	2
+
+struct recbuf
+{
+	unsigned char *data;
+	size_t		len;
+	size_t		size;
+};
+
+/* a text stored in a segment, found again by its hash */
+struct rec_name
+{
+	uint64_t	hash;
+	uint32_t	offset;			/* of the text in the segment */
+	uint32_t	len;
+	uint32_t	index;			/* number of the text plus one, 0 if unused */
+};
+
+struct rec_segment
+{
+	TAILQ_ENTRY(rec_segment) entries;
+	int64_t		start;			/* milliseconds since the epoch */
+	int			server_version;
+	unsigned int gen;
+	int			full;			/* ran out of memory, start a new one */
+	struct recbuf buf;
+	struct rec_name *names;
+	uint32_t	names_size;
+	uint32_t	nnames;
+};
+
+/*
+ * A query seen by the recorder and its previous result, kept for each cell as
+ * the number and its last change, or a hash of the text, to encode the next
+ * result from.
+ */
+struct rec_query
+{
+	RB_ENTRY(rec_query) entry;
+	char	   *text;
+	unsigned int id;
+	unsigned int gen;			/* segment the query was last defined in */
+	int			nrows;
+	int			ncols;
+	size_t		size;
+	int64_t    *prev;
+	int64_t    *delta;
+	unsigned char *kind;
+	unsigned char *scale;
+};
+
+int			rec_query_cmp(struct rec_query *, struct rec_query *);
+
+RB_HEAD(rec_queries, rec_query) head_rec_queries =
+RB_INITIALIZER(&head_rec_queries);
+RB_PROTOTYPE(rec_queries, rec_query, entry, rec_query_cmp)
+RB_GENERATE(rec_queries, rec_query, entry, rec_query_cmp)
+
+TAILQ_HEAD(rec_segment_list, rec_segment) rec_segments =
+TAILQ_HEAD_INITIALIZER(rec_segments);
+
+static int64_t rec_window = 0;	/* milliseconds kept in memory */
+static int	rec_fd = -1;		/* file recorded to */
+static unsigned int rec_gen = 0;
+static unsigned int rec_nqueries = 0;
+
+static pid_t dump_pid = 0;
+static char dump_path[64];
+
+int
+rec_query_cmp(struct rec_query *e1, struct rec_query *e2)
+{
+	return strcmp(e1->text, e2->text);
+}
+
+static int64_t
+wall_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int
+put_varint(unsigned char *p, uint64_t v)
+{
+	int			n = 0;
+
+	while (v >= 0x80)
+	{
+		p[n++] = (unsigned char) (v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (unsigned char) v;
+	return n;
+}
+
+#define ZIGZAG(v) (((uint64_t) (v) << 1) ^ (uint64_t) ((v) >> 63))
+
+static int
+buf_reserve(struct recbuf *b, size_t n)
+{
+	unsigned char *grown;
+	size_t		size;
+
+	if (b->len + n <= b->size)
+		return 0;
+
+	for (size = b->size > 0 ? b->size : 4096; size < b->len + n; size *= 2)
+		;
+	grown = realloc(b->data, size);
+	if (grown == NULL)
+		return -1;
+	b->data = grown;
+	b->size = size;
+	return 0;
+}
+
+/*
+ * The buf_ functions below expect the room for what they store to have been
+ * reserved beforehand.
+ */
+static void
+buf_tag(struct recbuf *b, unsigned char tag)
+{
+	b->data[b->len++] = tag;
+}
+
+static void
+buf_varint(struct recbuf *b, uint64_t v)
+{
+	b->len += put_varint(&b->data[b->len], v);
+}
+
+static void
+buf_bytes(struct recbuf *b, const void *data, size_t len)
+{
+	buf_varint(b, len);
+	memcpy(&b->data[b->len], data, len);
+	b->len += len;
+}
+
+/*
+ * Parse a cell holding exactly the canonical text of an integer or a decimal,
+ * so that it can be printed back the same from its digits and the number of
+ * them after the decimal point.
+ */
+static int
+parse_num(const char *s, int len, int64_t *v, int *scale)
+{
+	int			neg = len > 0 && s[0] == '-';
+	int			i = neg,
+				digits = 0,
+				point = -1;
+	int64_t		n = 0;
+
+	if (i >= len || s[i] == '.' ||
+		(s[i] == '0' && i + 1 < len && s[i + 1] != '.'))
+		return 0;
+
+	for (; i < len; i++)
+	{
+		if (s[i] == '.')
+		{
+			if (point >= 0 || i + 1 == len)
+				return 0;
+			point = i;
+			continue;
+		}
+		if (s[i] < '0' || s[i] > '9' || ++digits > 18)
+			return 0;
+		n = n * 10 + (s[i] - '0');
+	}
+	if (neg && n == 0)
+		return 0;
+
+	*v = neg ? -n : n;
+	*scale = point >= 0 ? len - point - 1 : 0;
+	return 1;
+}
+
+/* FNV-1a */
+static uint64_t
+hash_text(const char *s, int len)
+{
+	uint64_t	h = 14695981039346656037ULL;
+	int			i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ (unsigned char) s[i]) * 1099511628211ULL;
+	return h;
+}
+
+/*
+ * Look up a text already stored in the segment.  Returns its number plus one,
+ * or 0 if it was not stored yet.
+ */
+static uint32_t
+rec_name_find(const struct rec_segment *seg, const char *s, int len,
+			  uint64_t hash)
+{
+	const struct rec_name *n;
+	uint32_t	mask = seg->names_size - 1;
+	uint32_t	i;
+
+	if (seg->names_size == 0)
+		return 0;
+
+	for (i = hash & mask;; i = (i + 1) & mask)
+	{
+		n = &seg->names[i];
+		if (n->index == 0)
+			return 0;
+		if (n->hash == hash && n->len == (uint32_t) len &&
+			memcmp(&seg->buf.data[n->offset], s, len) == 0)
+			return n->index;
+	}
+}
+
+static void
+rec_name_insert(struct rec_name *names, uint32_t size,
+				const struct rec_name *name)
+{
+	uint32_t	i;
+
+	for (i = name->hash & (size - 1); names[i].index != 0;
+		 i = (i + 1) & (size - 1))
+		;
+	names[i] = *name;
+}
+
+/*
+ * Number the text just stored at "offset" in the segment.  The table is kept
+ * at most half full.
+ */
+static int
+rec_name_add(struct rec_segment *seg, uint64_t hash, size_t offset, int len)
+{
+	struct rec_name name = {hash, offset, len, seg->nnames + 1};
+	struct rec_name *grown;
+	uint32_t	i,
+				size;
+
+	if ((seg->nnames + 1) * 2 > seg->names_size)
+	{
+		size = seg->names_size > 0 ? seg->names_size * 2 : 1024;
+		grown = calloc(size, sizeof(struct rec_name));
+		if (grown == NULL)
+			return -1;
+		for (i = 0; i < seg->names_size; i++)
+			if (seg->names[i].index != 0)
+				rec_name_insert(grown, size, &seg->names[i]);
+		free(seg->names);
+		seg->names = grown;
+		seg->names_size = size;
+	}
+
+	rec_name_insert(seg->names, seg->names_size, &name);
+	seg->nnames++;
+	return 0;
+}
+
+static struct rec_query *
+rec_query_get(const char *text)
+{
+	struct rec_query key,
+			   *q;
+
+	key.text = (char *) text;
+	q = RB_FIND(rec_queries, &head_rec_queries, &key);
+	if (q != NULL)
+		return q;
+
+	q = calloc(1, sizeof(struct rec_query));
+	if (q == NULL)
+		return NULL;
+	q->text = strdup(text);
+	if (q->text == NULL)
+	{
+		free(q);
+		return NULL;
+	}
+	q->id = rec_nqueries++;
+	RB_INSERT(rec_queries, &head_rec_queries, q);
+	return q;
+}
+
+static int
+write_all(int fd, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	ssize_t		n;
+
+	while (len > 0)
+	{
+		n = write(fd, p, len);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int
+write_header(int fd)
+{
+	unsigned char head[REC_MAGIC_LEN + 10];
+
+	memcpy(head, REC_MAGIC, REC_MAGIC_LEN);
+	return write_all(fd, head,
+					 REC_MAGIC_LEN + put_varint(&head[REC_MAGIC_LEN],
+												REC_VERSION));
+}
+
+static int
+write_segment(int fd, const struct rec_segment *seg)
+{
+	unsigned char head[1 + 3 * 10];
+	int			len = 0;
+
+	head[len++] = REC_SEGMENT;
+	len += put_varint(&head[len], seg->start);
+	len += put_varint(&head[len], seg->server_version);
+	len += put_varint(&head[len], seg->buf.len);
+
+	if (write_all(fd, head, len) == -1 ||
+		write_all(fd, seg->buf.data, seg->buf.len) == -1)
+		return -1;
+	return 0;
+}
+
+/*
+ * Append a finished segment to the file being recorded to.
+ */
+static void
+rec_segment_close(struct rec_segment *seg)
+{
+	if (rec_fd == -1 || seg->buf.len == 0)
+		return;
+
+	if (write_segment(rec_fd, seg) == -1)
+	{
+		error("Recording stopped: %s", strerror(errno));
+		close(rec_fd);
+		rec_fd = -1;
+	}
+}
+
+static void
+rec_segment_free(struct rec_segment *seg)
+{
+	free(seg->buf.data);
+	free(seg->names);
+	free(seg);
+}
+
+/*
+ * Start a new segment when the current one is full and drop the segments that
+ * lie entirely before the window kept in memory.
+ */
+static struct rec_segment *
+rec_segment_get(int64_t now)
+{
+	struct rec_segment *seg = TAILQ_LAST(&rec_segments, rec_segment_list),
+			   *first,
+			   *next;
+
+	if (seg == NULL || seg->full || now - seg->start >= REC_SEGMENT_MS)
+	{
+		if (seg != NULL)
+			rec_segment_close(seg);
+
+		seg = calloc(1, sizeof(struct rec_segment));
+		if (seg == NULL)
+			return NULL;
+		seg->start = now;
+		seg->gen = ++rec_gen;
+		if (options.connection != NULL)
+			seg->server_version = PQserverVersion(options.connection);
+		TAILQ_INSERT_TAIL(&rec_segments, seg, entries);
+	}
+
+	while ((first = TAILQ_FIRST(&rec_segments)) != seg &&
+		   (next = TAILQ_NEXT(first, entries)) != NULL &&
+		   now - next->start >= rec_window)
+	{
+		TAILQ_REMOVE(&rec_segments, first, entries);
+		rec_segment_free(first);
+	}
+
+	return seg;
+}
+
+static int
+rec_define(struct recbuf *b, struct rec_query *q, const PGresult *res)
+{
+	int			c,
+				len,
+				ncols = PQnfields(res);
+
+	if (buf_reserve(b, 1 + 2 * 10) == -1)
+		return -1;
+	buf_tag(b, REC_QUERY);
+	buf_varint(b, q->id);
+	buf_varint(b, ncols);
+
+	for (c = 0; c < ncols; c++)
+	{
+		len = strlen(PQfname(res, c));
+		if (buf_reserve(b, 10 + len) == -1)
+			return -1;
+		buf_bytes(b, PQfname(res, c), len);
+	}
+
+	len = strlen(q->text);
+	if (buf_reserve(b, 10 + len) == -1)
+		return -1;
+	buf_bytes(b, q->text, len);
+	return 0;
+}
+
+static int
+rec_query_grow(struct rec_query *q, size_t size)
+{
+	int64_t    *prev,
+			   *delta;
+	unsigned char *kind,
+			   *scale;
+
+	if ((prev = realloc(q->prev, size * sizeof(int64_t))) == NULL)
+		return -1;
+	q->prev = prev;
+	if ((delta = realloc(q->delta, size * sizeof(int64_t))) == NULL)
+		return -1;
+	q->delta = delta;
+	if ((kind = realloc(q->kind, size)) == NULL)
+		return -1;
+	q->kind = kind;
+	if ((scale = realloc(q->scale, size)) == NULL)
+		return -1;
+	q->scale = scale;
+
+	q->size = size;
+	return 0;
+}
+
+static int
+rec_result(struct rec_segment *seg, struct rec_query *q, const PGresult *res,
+		   int64_t offset)
+{
+	struct recbuf *b = &seg->buf;
+	int			nrows = PQntuples(res),
+				ncols = PQnfields(res);
+	int			r,
+				c,
+				len,
+				scale,
+				have_prev;
+	size_t		i;
+	const char *s;
+	int64_t		v,
+				d;
+	uint32_t	name;
+
+	if ((size_t) nrows * ncols > q->size &&
+		rec_query_grow(q, (size_t) nrows * ncols * 2) == -1)
+		return -1;
+
+	if (buf_reserve(b, 1 + 4 * 10) == -1)
+		return -1;
+	buf_tag(b, REC_RESULT);
+	buf_varint(b, q->id);
+	buf_varint(b, offset);
+	buf_varint(b, nrows);
+	buf_varint(b, ncols);
+
+	for (r = 0; r < nrows; r++)
+	{
+		have_prev = r < q->nrows && ncols == q->ncols;
+		for (c = 0; c < ncols; c++)
+		{
+			i = (size_t) r * ncols + c;
+			s = PQgetvalue(res, r, c);
+			len = PQgetlength(res, r, c);
+
+			/* room for the longest encoding of the cell */
+			if (buf_reserve(b, 1 + 2 * 10 + len) == -1)
+				return -1;
+
+			if (PQgetisnull(res, r, c))
+			{
+				buf_tag(b, have_prev && q->kind[i] == KIND_NULL ?
+						CELL_REPEAT : CELL_NULL);
+				q->kind[i] = KIND_NULL;
+			}
+			else if (parse_num(s, len, &v, &scale))
+			{
+				if (have_prev && q->kind[i] == KIND_NUM &&
+					q->scale[i] == scale)
+				{
+					d = v - q->prev[i];
+					if (d == q->delta[i])
+						buf_tag(b, CELL_REPEAT);
+					else
+					{
+						buf_tag(b, CELL_DOD);
+						buf_varint(b, ZIGZAG(d - q->delta[i]));
+					}
+					q->delta[i] = d;
+				}
+				else
+				{
+					if (scale == 0)
+						buf_tag(b, CELL_INT);
+					else
+					{
+						buf_tag(b, CELL_DEC);
+						buf_varint(b, scale);
+					}
+					buf_varint(b, ZIGZAG(v));
+					q->delta[i] = 0;
+				}
+				q->prev[i] = v;
+				q->kind[i] = KIND_NUM;
+				q->scale[i] = scale;
+			}
+			else
+			{
+				v = (int64_t) hash_text(s, len);
+				if (have_prev && q->kind[i] == KIND_TEXT && q->prev[i] == v)
+					buf_tag(b, CELL_REPEAT);
+				else if ((name = rec_name_find(seg, s, len, v)) != 0)
+				{
+					buf_tag(b, CELL_NAME);
+					buf_varint(b, name - 1);
+				}
+				else
+				{
+					buf_tag(b, CELL_TEXT);
+					buf_bytes(b, s, len);
+					if (rec_name_add(seg, v, b->len - len, len) == -1)
+						return -1;
+				}
+				q->prev[i] = v;
+				q->kind[i] = KIND_TEXT;
+			}
+		}
+	}
+
+	q->nrows = nrows;
+	q->ncols = ncols;
+	return 0;
+}
+
+/*
+ * Keep the last "minutes" of query results in memory, or nothing if it is 0.
+ */
+void
+recorder_init(double minutes)
+{
+	rec_window = (int64_t) (minutes * 60000);
+}
+
+/*
+ * Record every query result to "path", appending to it if it already holds a
+ * recording.
+ */
+int
+recorder_open(const char *path)
+{
+	char		magic[REC_MAGIC_LEN + 1];
+	struct stat st;
+
+	rec_fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+	if (rec_fd == -1)
+		return -1;
+
+	if (fstat(rec_fd, &st) == -1)
+		goto fail;
+	if (st.st_size == 0)
+	{
+		if (write_header(rec_fd) == -1)
+			goto fail;
+		return 0;
+	}
+
+	if (pread(rec_fd, magic, sizeof(magic), 0) != sizeof(magic) ||
+		memcmp(magic, REC_MAGIC, REC_MAGIC_LEN) != 0 ||
+		magic[REC_MAGIC_LEN] != REC_VERSION)
+	{
+		errno = EINVAL;
+		goto fail;
+	}
+	return 0;
+
+fail:
+	close(rec_fd);
+	rec_fd = -1;
+	return -1;
+}
+
+/*
+ * Write out the segment still being filled and stop recording.
+ */
+void
+recorder_close(void)
+{
+	struct rec_segment *seg = TAILQ_LAST(&rec_segments, rec_segment_list);
+
+	if (rec_fd == -1)
+		return;
+
+	if (seg != NULL)
+		rec_segment_close(seg);
+	if (rec_fd != -1)
+		close(rec_fd);
+	rec_fd = -1;
+}
+
+/*
+ * Add the result of a statistics query to the current segment.  Results that
+ * do not fit in memory are left out and a new segment is started, in which the
+ * next results are stored in full.
+ */
+void
+recorder_add(const char *query, const PGresult *res)
+{
+	struct rec_segment *seg;
+	struct rec_query *q;
+	int64_t		now;
+	size_t		mark;
+
+	if (rec_window <= 0 && rec_fd == -1)
+		return;
+
+	now = wall_ms();
+	if ((seg = rec_segment_get(now)) == NULL ||
+		(q = rec_query_get(query)) == NULL)
+		return;
+
+	mark = seg->buf.len;
+	if (q->gen != seg->gen)
+	{
+		q->nrows = 0;
+		if (rec_define(&seg->buf, q, res) == -1)
+			goto fail;
+		q->gen = seg->gen;
+	}
+	if (rec_result(seg, q, res, now - seg->start) == -1)
+		goto fail;
+	return;
+
+fail:
+	seg->buf.len = mark;
+	seg->full = 1;
+}
+
+/*
+ * Write the header and every segment kept to "path".
+ */
+static int
+recorder_write(const char *path)
+{
+	struct rec_segment *seg;
+	int			fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return -1;
+
+	if (write_header(fd) == -1)
+		goto fail;
+	TAILQ_FOREACH(seg, &rec_segments, entries)
+	{
+		if (seg->buf.len > 0 && write_segment(fd, seg) == -1)
+			goto fail;
+	}
+
+	if (fsync(fd) == -1)
+		goto fail;
+	return close(fd);
+
+fail:
+	close(fd);
+	unlink(path);
+	return -1;
+}
+
+/*
+ * Dump the flight recorder to a file named after the current time.  The dump
+ * is written by a child process working on a copy-on-write image of the
+ * segments, so sampling and screen updates go on undisturbed, and it only
+ * appears under its final name once it was written in full.
+ */
+void
+recorder_dump(void)
+{
+	char		tmp_path[sizeof(dump_path) + 4];
+	time_t		now;
+	pid_t		pid;
+
+	if (rec_window <= 0)
+	{
+		error("The flight recorder is not enabled, see -F");
+		return;
+	}
+
+	recorder_poll();
+	if (dump_pid > 0)
+	{
+		error("A flight recorder dump to %s is in progress", dump_path);
+		return;
+	}
+
+	time(&now);
+	strftime(dump_path, sizeof(dump_path), "pg_systat-%Y%m%d-%H%M%S.rec",
+			 localtime(&now));
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", dump_path);
+
+	pid = fork();
+	if (pid == -1)
+	{
+		error("Cannot dump the flight recorder: %s", strerror(errno));
+		return;
+	}
+	if (pid == 0)
+		_exit(recorder_write(tmp_path) == 0 &&
+			  rename(tmp_path, dump_path) == 0 ? 0 : 1);
+
+	dump_pid = pid;
+	error("Dumping the flight recorder to %s", dump_path);
+}
+
+/*
+ * Collect the process writing a dump once it is done, and report it if it
+ * failed.
+ */
+void
+recorder_poll(void)
+{
+	int			status;
+
+	if (dump_pid <= 0 || waitpid(dump_pid, &status, WNOHANG) != dump_pid)
+		return;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		error("The flight recorder dump to %s failed", dump_path);
+	dump_pid = 0;
+}
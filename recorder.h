@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#ifndef _RECORDER_H_
+#define _RECORDER_H_
+
+#include <stdint.h>
+#include <libpq-fe.h>
+
+/*
+ * The recorder keeps the result of every statistics query, either for the
+ * last few minutes in memory as a flight recorder, or appended to a file for
+ * as long as pg_systat runs.
+ *
+ * Results are stored in segments of REC_SEGMENT_MS milliseconds.  A segment
+ * is a keyframe: the first result of a query in it is stored in full and every
+ * following one only as its change from the previous result of the same
+ * query, so each segment decodes on its own and old segments can simply be
+ * dropped.  A file is a header followed by the segments:
+ *
+ *   header:  REC_MAGIC, REC_VERSION
+ *   segment: REC_SEGMENT, start time, server version, length, records
+ *   query:   REC_QUERY, id, columns, column names, query text
+ *   result:  REC_RESULT, id, milliseconds since the segment start, rows,
+ *            columns, cells
+ *
+ * All numbers are unsigned LEB128 varints, signed ones zigzag encoded, and
+ * strings are a length followed by the bytes.  Each cell starts with one of
+ * the CELL tags.
+ *
+ * Numbers, integers or decimals whose text can be printed back exactly, are
+ * stored by delta of delta against the cell in the same row and column of
+ * the previous result: a counter growing at a steady rate, or not at all, is
+ * a single CELL_REPEAT byte.  Every distinct text in a segment is stored once
+ * and referred to by its number afterwards, so names repeated across results
+ * and queries cost a byte or two.
+ */
+#define REC_MAGIC		"PGSYSREC"
+#define REC_MAGIC_LEN	8
+#define REC_VERSION		2
+
+#define REC_SEGMENT_MS	30000
+
+#define REC_SEGMENT		'S'
+#define REC_QUERY		'Q'
+#define REC_RESULT		'R'
+
+#define CELL_REPEAT		0		/* previous value plus previous change */
+#define CELL_DOD		1		/* change of the change of a number */
+#define CELL_INT		2		/* integer */
+#define CELL_DEC		3		/* decimal: digits after the point, digits */
+#define CELL_TEXT		4		/* text, numbered in order of appearance */
+#define CELL_NAME		5		/* number of a text seen in the segment */
+#define CELL_NULL		6
+
+void		recorder_init(double);
+int			recorder_open(const char *);
+void		recorder_close(void);
+void		recorder_add(const char *, const PGresult *);
+void		recorder_dump(void);
+void		recorder_poll(void);
+
+#endif							/* _RECORDER_H_ */
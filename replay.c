@@ -0,0 +1,905 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#include <sys/mman.h>
+#include <sys/queue.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <bsd/stdlib.h>
+#include <bsd/sys/tree.h>
+#endif							/* __linux__ */
+
+#include "engine.h"
+#include "pg_systat.h"
+#include "recorder.h"
+#include "replay.h"
+
+/* what a cell of the last result of a query holds */
+#define KIND_NULL	0
+#define KIND_NUM	1
+#define KIND_TEXT	2
+
+/* limits beyond which a record can only be corrupt */
+#define MAX_QUERY_ID	65536
+#define MAX_COLUMNS		4096
+#define MAX_SCALE		18
+
+#define UNZIGZAG(v) ((int64_t) ((v) >> 1) ^ -(int64_t) ((v) & 1))
+
+struct reader
+{
+	const unsigned char *p;
+	const unsigned char *end;
+};
+
+struct replay_segment
+{
+	int64_t		start;			/* milliseconds since the epoch */
+	int			server_version;
+	size_t		offset;			/* of the records in the file */
+	size_t		len;
+};
+
+struct replay_cell
+{
+	unsigned char kind;
+	unsigned char scale;
+	int			len;
+	const char *text;			/* in the mapped file */
+	int64_t		v;
+	int64_t		delta;
+};
+
+struct replay_text
+{
+	const char *s;
+	int			len;
+};
+
+/*
+ * A query met in the recording and its last result decoded so far.  The
+ * result stays available across segments until the next one replaces it.
+ */
+struct replay_query
+{
+	RB_ENTRY(replay_query) entry;
+	TAILQ_ENTRY(replay_query) list;
+	char	   *text;
+	int			nnames;
+	char	  **names;
+	int			nrows;			/* rows of the last result, -1 if none */
+	int			ncols;
+	int			prev_rows;		/* rows the next result is encoded against */
+	size_t		size;
+	struct replay_cell *cells;
+	int64_t		taken;
+	unsigned int generation;	/* of the replay clock when it was taken */
+};
+
+int			replay_query_cmp(struct replay_query *, struct replay_query *);
+
+RB_HEAD(replay_queries, replay_query) head_replay_queries =
+RB_INITIALIZER(&head_replay_queries);
+RB_PROTOTYPE(replay_queries, replay_query, entry, replay_query_cmp)
+RB_GENERATE(replay_queries, replay_query, entry, replay_query_cmp)
+
+TAILQ_HEAD(replay_query_list, replay_query) replay_query_list =
+TAILQ_HEAD_INITIALIZER(replay_query_list);
+
+int			replaying = 0;
+
+static const char *rp_file;
+static const unsigned char *rp_map;
+static size_t rp_size;
+
+static struct replay_segment *rp_segs;
+static int	rp_nsegs = 0;
+
+/* decoding position */
+static int	rp_seg = -1;
+static struct reader rp_cur;
+static struct replay_query **rp_ids;
+static unsigned int rp_nids = 0;
+static struct replay_text *rp_texts;
+static int	rp_ntexts = 0;
+static int	rp_texts_size = 0;
+static int64_t rp_last;			/* time of the last result decoded */
+static int	rp_at_end = 0;
+
+static int64_t rp_clock;
+static int64_t rp_real;			/* wall clock at the last tick */
+static int	rp_speed = 1;
+static unsigned int rp_generation = 0;
+static struct replay_query *rp_last_query;
+static int64_t rp_taken;
+
+static int64_t
+monotonic_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int
+replay_query_cmp(struct replay_query *e1, struct replay_query *e2)
+{
+	return strcmp(e1->text, e2->text);
+}
+
+static int
+get_varint(struct reader *rd, uint64_t *v)
+{
+	uint64_t	n = 0;
+	int			shift;
+
+	for (shift = 0; shift < 64 && rd->p < rd->end; shift += 7)
+	{
+		n |= (uint64_t) (*rd->p & 0x7f) << shift;
+		if ((*rd->p++ & 0x80) == 0)
+		{
+			*v = n;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int
+get_bytes(struct reader *rd, const char **s, int *len)
+{
+	uint64_t	n;
+
+	if (get_varint(rd, &n) == -1 || n > (uint64_t) (rd->end - rd->p))
+		return -1;
+	*s = (const char *) rd->p;
+	*len = n;
+	rd->p += n;
+	return 0;
+}
+
+/*
+ * Start decoding segment "i" from its beginning.
+ */
+static void
+enter_segment(int i)
+{
+	rp_seg = i;
+	rp_cur.p = rp_map + rp_segs[i].offset;
+	rp_cur.end = rp_cur.p + rp_segs[i].len;
+	if (rp_nids > 0)
+		memset(rp_ids, 0, rp_nids * sizeof(struct replay_query *));
+	rp_ntexts = 0;
+}
+
+static int
+add_text(const char *s, int len)
+{
+	struct replay_text *grown;
+	int			size;
+
+	if (rp_ntexts == rp_texts_size)
+	{
+		size = rp_texts_size > 0 ? rp_texts_size * 2 : 1024;
+		grown = reallocarray(rp_texts, size, sizeof(struct replay_text));
+		if (grown == NULL)
+			return -1;
+		rp_texts = grown;
+		rp_texts_size = size;
+	}
+	rp_texts[rp_ntexts].s = s;
+	rp_texts[rp_ntexts].len = len;
+	rp_ntexts++;
+	return 0;
+}
+
+static int
+decode_query(struct reader *rd)
+{
+	struct replay_query *q,
+			   *found;
+	struct replay_query **ids;
+	uint64_t	id,
+				ncols;
+	const char *s;
+	int			c,
+				len;
+	char	  **names;
+
+	if (get_varint(rd, &id) == -1 || id >= MAX_QUERY_ID ||
+		get_varint(rd, &ncols) == -1 || ncols > MAX_COLUMNS)
+		return -1;
+
+	names = calloc(ncols > 0 ? ncols : 1, sizeof(char *));
+	if (names == NULL)
+		return -1;
+	for (c = 0; c < (int) ncols; c++)
+	{
+		if (get_bytes(rd, &s, &len) == -1 ||
+			(names[c] = strndup(s, len)) == NULL)
+			goto fail;
+	}
+
+	q = calloc(1, sizeof(struct replay_query));
+	if (q == NULL || get_bytes(rd, &s, &len) == -1 ||
+		(q->text = strndup(s, len)) == NULL)
+	{
+		free(q);
+		goto fail;
+	}
+	found = RB_INSERT(replay_queries, &head_replay_queries, q);
+	if (found != NULL)
+	{
+		free(q->text);
+		free(q);
+		q = found;
+		for (c = 0; c < q->nnames; c++)
+			free(q->names[c]);
+		free(q->names);
+	}
+	else
+	{
+		q->nrows = -1;
+		TAILQ_INSERT_TAIL(&replay_query_list, q, list);
+	}
+	q->names = names;
+	q->nnames = ncols;
+	q->prev_rows = 0;
+
+	if (id >= rp_nids)
+	{
+		ids = reallocarray(rp_ids, id + 1, sizeof(struct replay_query *));
+		if (ids == NULL)
+			return -1;
+		memset(&ids[rp_nids], 0,
+			   (id + 1 - rp_nids) * sizeof(struct replay_query *));
+		rp_ids = ids;
+		rp_nids = id + 1;
+	}
+	rp_ids[id] = q;
+	return 0;
+
+fail:
+	while (--c >= 0)
+		free(names[c]);
+	free(names);
+	return -1;
+}
+
+static int
+decode_cell(struct reader *rd, struct replay_cell *cell, int have_prev)
+{
+	uint64_t	v;
+	int			tag;
+
+	if (rd->p >= rd->end)
+		return -1;
+
+	switch ((tag = *rd->p++))
+	{
+		case CELL_REPEAT:
+			if (!have_prev)
+				return -1;
+			if (cell->kind == KIND_NUM)
+				cell->v += cell->delta;
+			break;
+		case CELL_DOD:
+			if (!have_prev || cell->kind != KIND_NUM ||
+				get_varint(rd, &v) == -1)
+				return -1;
+			cell->delta += UNZIGZAG(v);
+			cell->v += cell->delta;
+			break;
+		case CELL_INT:
+		case CELL_DEC:
+			cell->scale = 0;
+			if (tag == CELL_DEC)
+			{
+				if (get_varint(rd, &v) == -1 || v > MAX_SCALE)
+					return -1;
+				cell->scale = v;
+			}
+			if (get_varint(rd, &v) == -1)
+				return -1;
+			cell->kind = KIND_NUM;
+			cell->v = UNZIGZAG(v);
+			cell->delta = 0;
+			break;
+		case CELL_TEXT:
+			if (get_bytes(rd, &cell->text, &cell->len) == -1 ||
+				add_text(cell->text, cell->len) == -1)
+				return -1;
+			cell->kind = KIND_TEXT;
+			break;
+		case CELL_NAME:
+			if (get_varint(rd, &v) == -1 || v >= (uint64_t) rp_ntexts)
+				return -1;
+			cell->kind = KIND_TEXT;
+			cell->text = rp_texts[v].s;
+			cell->len = rp_texts[v].len;
+			break;
+		case CELL_NULL:
+			cell->kind = KIND_NULL;
+			break;
+		default:
+			return -1;
+	}
+	return 0;
+}
+
+static int
+decode_result(struct reader *rd, struct replay_query *q, int nrows, int ncols)
+{
+	struct replay_cell *cells;
+	size_t		i,
+				size = (size_t) nrows * ncols;
+	int			r,
+				c,
+				have_prev;
+
+	if (size > q->size)
+	{
+		cells = reallocarray(q->cells, size, sizeof(struct replay_cell));
+		if (cells == NULL)
+			return -1;
+		q->cells = cells;
+		q->size = size;
+	}
+
+	for (r = 0; r < nrows; r++)
+	{
+		have_prev = r < q->prev_rows && ncols == q->ncols;
+		for (c = 0; c < ncols; c++)
+		{
+			i = (size_t) r * ncols + c;
+			if (decode_cell(rd, &q->cells[i], have_prev) == -1)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Decode the next record of the recording, unless it is a result taken after
+ * "limit".  Returns 1 and the query when a result was decoded, 0 for any other
+ * record, and -1 at the limit or the end of the recording.
+ */
+static int
+decode_next(int64_t limit, struct replay_query **applied)
+{
+	struct reader rd;
+	struct replay_query *q;
+	uint64_t	id,
+				offset,
+				nrows,
+				ncols;
+	int64_t		taken;
+
+	while (rp_cur.p >= rp_cur.end)
+	{
+		if (rp_seg + 1 >= rp_nsegs || rp_segs[rp_seg + 1].start > limit)
+			return -1;
+		enter_segment(rp_seg + 1);
+	}
+
+	rd = rp_cur;
+	switch (*rd.p++)
+	{
+		case REC_QUERY:
+			if (decode_query(&rd) == -1)
+				goto bad;
+			rp_cur = rd;
+			return 0;
+		case REC_RESULT:
+			if (get_varint(&rd, &id) == -1 ||
+				get_varint(&rd, &offset) == -1 ||
+				get_varint(&rd, &nrows) == -1 ||
+				get_varint(&rd, &ncols) == -1 ||
+				id >= rp_nids || (q = rp_ids[id]) == NULL ||
+				ncols > MAX_COLUMNS || nrows > (uint64_t) (rd.end - rd.p) ||
+				nrows * ncols > (uint64_t) (rd.end - rd.p))
+				goto bad;
+			taken = rp_segs[rp_seg].start + offset;
+			if (taken > limit)
+				return -1;
+			if (decode_result(&rd, q, nrows, ncols) == -1)
+			{
+				q->nrows = -1;
+				q->prev_rows = 0;
+				goto bad;
+			}
+			q->nrows = nrows;
+			q->ncols = ncols;
+			q->prev_rows = nrows;
+			q->taken = taken;
+			q->generation = rp_generation;
+			rp_last = taken;
+			rp_cur = rd;
+			*applied = q;
+			return 1;
+	}
+
+bad:
+	error("Skipping corrupt recording at offset %zu",
+		  (size_t) (rp_cur.p - rp_map));
+	rp_cur.p = rp_cur.end;
+	return 0;
+}
+
+/*
+ * Decode every result taken up to the replay clock.  The clock stops at the
+ * last result of the recording.
+ */
+static void
+decode_to_clock(void)
+{
+	struct replay_query *q;
+
+	while (decode_next(rp_clock, &q) >= 0)
+		;
+
+	if (rp_seg == rp_nsegs - 1 && rp_cur.p >= rp_cur.end &&
+		rp_clock > rp_last)
+	{
+		rp_clock = rp_last;
+		rp_at_end = 1;
+	}
+}
+
+/*
+ * Move the replay clock to "t", anywhere in the recording.  Decoding starts
+ * from the segment before the one holding "t" so that the views find the
+ * results of queries that were not run yet in that segment by then.
+ */
+static void
+replay_goto(int64_t t)
+{
+	int			lo = 0,
+				hi = rp_nsegs - 1,
+				mid;
+
+	if (t < rp_segs[0].start)
+		t = rp_segs[0].start;
+	while (lo < hi)
+	{
+		mid = (lo + hi + 1) / 2;
+		if (rp_segs[mid].start <= t)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	enter_segment(lo > 0 ? lo - 1 : 0);
+	rp_last = rp_segs[rp_seg].start;
+	rp_clock = t;
+	rp_at_end = 0;
+	rp_generation++;
+	decode_to_clock();
+}
+
+/*
+ * Open a recording and index its segments.  A last segment cut short, as
+ * left behind by a crash, ends the recording.
+ */
+int
+replay_open(const char *path)
+{
+	struct replay_segment *grown;
+	struct reader rd;
+	struct stat st;
+	uint64_t	start,
+				version,
+				len;
+	int			fd,
+				size = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -1;
+	if (fstat(fd, &st) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	if (st.st_size <= REC_MAGIC_LEN)
+	{
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	rp_map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (rp_map == MAP_FAILED)
+		return -1;
+	rp_size = st.st_size;
+
+	if (memcmp(rp_map, REC_MAGIC, REC_MAGIC_LEN) != 0 ||
+		rp_map[REC_MAGIC_LEN] != REC_VERSION)
+		goto fail;
+
+	rd.p = rp_map + REC_MAGIC_LEN + 1;
+	rd.end = rp_map + rp_size;
+	while (rd.p < rd.end)
+	{
+		if (*rd.p++ != REC_SEGMENT || get_varint(&rd, &start) == -1 ||
+			get_varint(&rd, &version) == -1 || get_varint(&rd, &len) == -1 ||
+			len > (uint64_t) (rd.end - rd.p))
+			break;
+
+		if (rp_nsegs == size)
+		{
+			size = size > 0 ? size * 2 : 1024;
+			grown = reallocarray(rp_segs, size,
+								 sizeof(struct replay_segment));
+			if (grown == NULL)
+				goto fail;
+			rp_segs = grown;
+		}
+		rp_segs[rp_nsegs].start = start;
+		rp_segs[rp_nsegs].server_version = version;
+		rp_segs[rp_nsegs].offset = rd.p - rp_map;
+		rp_segs[rp_nsegs].len = len;
+		rp_nsegs++;
+		rd.p += len;
+	}
+	if (rp_nsegs == 0)
+		goto fail;
+
+	rp_file = path;
+	replaying = 1;
+	rp_real = monotonic_ms();
+	replay_goto(rp_segs[0].start);
+	return 0;
+
+fail:
+	munmap((void *) rp_map, rp_size);
+	free(rp_segs);
+	rp_segs = NULL;
+	rp_nsegs = 0;
+	errno = EINVAL;
+	return -1;
+}
+
+/*
+ * Forget the recording, for another one to be opened.
+ */
+void
+replay_close(void)
+{
+	struct replay_query *q;
+	int			c;
+
+	if (!replaying)
+		return;
+
+	while ((q = TAILQ_FIRST(&replay_query_list)) != NULL)
+	{
+		TAILQ_REMOVE(&replay_query_list, q, list);
+		for (c = 0; c < q->nnames; c++)
+			free(q->names[c]);
+		free(q->names);
+		free(q->cells);
+		free(q->text);
+		free(q);
+	}
+	RB_INIT(&head_replay_queries);
+
+	free(rp_ids);
+	rp_ids = NULL;
+	rp_nids = 0;
+	free(rp_texts);
+	rp_texts = NULL;
+	rp_ntexts = 0;
+	rp_texts_size = 0;
+	free(rp_segs);
+	rp_segs = NULL;
+	rp_nsegs = 0;
+	rp_seg = -1;
+	munmap((void *) rp_map, rp_size);
+
+	/* the path belongs to the caller, who may free it now */
+	rp_file = NULL;
+	rp_last_query = NULL;
+	rp_speed = 1;
+	replaying = 0;
+}
+
+/*
+ * Call "callback" with the text of every query that has a result at the
+ * replay clock.
+ */
+void
+replay_foreach(void (*callback) (const char *))
+{
+	struct replay_query *q;
+
+	TAILQ_FOREACH(q, &replay_query_list, list)
+	{
+		if (q->nrows >= 0 && q->generation == rp_generation)
+			callback(q->text);
+	}
+}
+
+/*
+ * Advance the replay clock.  Interactively it follows the wall clock, so that
+ * sampling and refreshes happen at their usual pace, while in batch mode it
+ * moves by exactly "usec" per call and the same recording always gives the
+ * same output.
+ */
+void
+replay_tick(useconds_t usec)
+{
+	int64_t		now,
+				elapsed;
+
+	if (!replaying)
+		return;
+
+	now = monotonic_ms();
+	if (!paused && !rp_at_end)
+	{
+		elapsed = interactive ? now - rp_real : usec / 1000;
+		rp_clock += elapsed * rp_speed;
+		decode_to_clock();
+
+		if (rp_at_end)
+		{
+			if (interactive)
+			{
+				paused = 1;
+				error("End of recording");
+			}
+			else
+				gotsig_close = 1;
+		}
+	}
+	rp_real = now;
+}
+
+/*
+ * Move the clock to the next result of the last query the views ran.
+ */
+void
+replay_step(void)
+{
+	struct replay_query *q;
+	int			r;
+
+	if (!replaying)
+		return;
+
+	while ((r = decode_next(INT64_MAX, &q)) >= 0)
+	{
+		if (r == 1 && (rp_last_query == NULL || q == rp_last_query))
+		{
+			rp_clock = q->taken;
+			return;
+		}
+	}
+	error("End of recording");
+}
+
+/*
+ * Move the clock to a time given as [YYYY-MM-DD ]HH:MM[:SS], on the current
+ * day of the recording when no date is given, by [+-]N[smh] from the current
+ * time, or to the "start" or "end" of the recording.
+ */
+int
+replay_seek(const char *s)
+{
+	struct tm	tm;
+	time_t		now = rp_clock / 1000;
+	double		n;
+	char	   *end;
+	int			year,
+				mon,
+				day,
+				hour,
+				min,
+				sec = 0;
+
+	if (!replaying)
+		return -1;
+
+	if (strcmp(s, "start") == 0 || strcmp(s, "end") == 0)
+	{
+		replay_goto(*s == 's' ? rp_segs[0].start : INT64_MAX);
+		return 0;
+	}
+
+	if (*s == '+' || *s == '-')
+	{
+		n = strtod(s, &end);
+		if (end == s)
+			return -1;
+		switch (*end)
+		{
+			case '\0':
+			case 's':
+				break;
+			case 'm':
+				n *= 60;
+				break;
+			case 'h':
+				n *= 3600;
+				break;
+			default:
+				return -1;
+		}
+		replay_goto(rp_clock + (int64_t) (n * 1000));
+		return 0;
+	}
+
+	localtime_r(&now, &tm);
+	if (sscanf(s, "%d-%d-%d %d:%d:%d", &year, &mon, &day, &hour, &min,
+			   &sec) >= 5)
+	{
+		tm.tm_year = year - 1900;
+		tm.tm_mon = mon - 1;
+		tm.tm_mday = day;
+	}
+	else if (sscanf(s, "%d:%d:%d", &hour, &min, &sec) < 2)
+		return -1;
+	tm.tm_hour = hour;
+	tm.tm_min = min;
+	tm.tm_sec = sec;
+	tm.tm_isdst = -1;
+
+	replay_goto((int64_t) mktime(&tm) * 1000);
+	return 0;
+}
+
+/*
+ * Replay ten times faster, or slower.
+ */
+void
+replay_speed(int faster)
+{
+	if (faster && rp_speed < REPLAY_MAX_SPEED)
+		rp_speed *= 10;
+	else if (!faster && rp_speed > 1)
+		rp_speed /= 10;
+}
+
+int
+replay_get_speed(void)
+{
+	return rp_speed;
+}
+
+int64_t
+replay_clock(void)
+{
+	return rp_clock;
+}
+
+const char *
+replay_file(void)
+{
+	return rp_file;
+}
+
+/*
+ * Changes every time the clock jumps, so that views can tell that their
+ * previous snapshot is not the one before the next.
+ */
+unsigned int
+replay_generation(void)
+{
+	return rp_generation;
+}
+
+int
+replay_server_version(void)
+{
+	return rp_seg >= 0 ? rp_segs[rp_seg].server_version : 0;
+}
+
+/*
+ * When the result last returned by replay_exec() was taken.
+ */
+void
+replay_taken(struct timespec *ts)
+{
+	ts->tv_sec = rp_taken / 1000;
+	ts->tv_nsec = (rp_taken % 1000) * 1000000;
+}
+
+static int
+format_num(char *buf, int64_t v, int scale)
+{
+	char		digits[24];
+	uint64_t	u = v < 0 ? -(uint64_t) v : (uint64_t) v;
+	int			n,
+				len = 0;
+
+	n = snprintf(digits, sizeof(digits), "%0*llu", scale + 1,
+				 (unsigned long long) u);
+	if (v < 0)
+		buf[len++] = '-';
+	memcpy(&buf[len], digits, n - scale);
+	len += n - scale;
+	if (scale > 0)
+	{
+		buf[len++] = '.';
+		memcpy(&buf[len], &digits[n - scale], scale);
+		len += scale;
+	}
+	buf[len] = '\0';
+	return len;
+}
+
+/*
+ * Answer a query with its last result recorded at or before the replay clock,
+ * or with an error if there is none.
+ */
+PGresult *
+replay_exec(const char *query)
+{
+	struct replay_query key,
+			   *q;
+	struct replay_cell *cell;
+	PGresAttDesc *attrs;
+	PGresult   *res;
+	char		buf[48];
+	int			r,
+				c,
+				len;
+
+	key.text = (char *) query;
+	q = RB_FIND(replay_queries, &head_replay_queries, &key);
+	if (q == NULL || q->nrows < 0 || q->generation != rp_generation)
+		return PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+
+	res = PQmakeEmptyPGresult(NULL, PGRES_TUPLES_OK);
+	attrs = calloc(q->ncols > 0 ? q->ncols : 1, sizeof(PGresAttDesc));
+	if (res == NULL || attrs == NULL)
+		goto fail;
+	for (c = 0; c < q->ncols; c++)
+	{
+		attrs[c].name = c < q->nnames ? q->names[c] : "";
+		attrs[c].typlen = -1;
+		attrs[c].atttypmod = -1;
+	}
+	if (!PQsetResultAttrs(res, q->ncols, attrs))
+		goto fail;
+
+	for (r = 0; r < q->nrows; r++)
+	{
+		for (c = 0; c < q->ncols; c++)
+		{
+			cell = &q->cells[(size_t) r * q->ncols + c];
+			if (cell->kind == KIND_NULL)
+				len = PQsetvalue(res, r, c, NULL, -1);
+			else if (cell->kind == KIND_NUM)
+			{
+				len = format_num(buf, cell->v, cell->scale);
+				len = PQsetvalue(res, r, c, buf, len);
+			}
+			else
+				len = PQsetvalue(res, r, c, (char *) cell->text, cell->len);
+			if (!len)
+				goto fail;
+		}
+	}
+	free(attrs);
+
+	rp_last_query = q;
+	rp_taken = q->taken;
+	return res;
+
+fail:
+	free(attrs);
+	PQclear(res);
+	return PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+}
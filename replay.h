@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <libpq-fe.h>
+
+/*
+ * Replay a recording made with -o, or a flight recorder dump, in place of the
+ * server.  Every query of the views is answered with its last result recorded
+ * at or before the replay clock, so the views show what they would have shown
+ * at that time.
+ *
+ * The file is mapped rather than read, and only the segment headers are read
+ * when it is opened to index the segments by their start time.  Seeking finds
+ * the segment in the index and decodes it from its start, since every segment
+ * is a keyframe, so it takes the same time anywhere in a file of any size.
+ */
+#define REPLAY_MAX_SPEED	100
+
+extern int	replaying;
+
+int			replay_open(const char *);
+void		replay_close(void);
+void		replay_foreach(void (*) (const char *));
+void		replay_tick(useconds_t);
+void		replay_step(void);
+int			replay_seek(const char *);
+void		replay_speed(int);
+int			replay_get_speed(void);
+int64_t		replay_clock(void);
+const char *replay_file(void);
+unsigned int replay_generation(void);
+int			replay_server_version(void);
+void		replay_taken(struct timespec *);
+PGresult   *replay_exec(const char *);
+
+#endif							/* _REPLAY_H_ */
@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#include <stdlib.h>
+#ifdef __linux__
+#include <bsd/stdlib.h>
+#include <bsd/sys/tree.h>
+#endif							/* __linux__ */
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "counter.h"
+#include "pg.h"
+#include "pg_systat.h"
+#include "serve.h"
+
+/*
+ * High frequency sampling views.  While one of these views is selected the
+ * engine calls its sample function every sampling interval (-S), which is
+ * meant to be well below the refresh delay.  The rate of the sampled counter
+ * is accumulated per row between screen updates, and each update shows the
+ * last, minimum, average and maximum rate seen since the previous one, so
+ * that short bursts are not averaged away by a long refresh delay.
+ */
+
+#define QUERY_SAMPLE_DB \
+		"SELECT coalesce(datname, '<shared relation objects>'),\n" \
+		"       xact_commit + xact_rollback\n" \
+		"FROM pg_stat_database;"
+#define QUERY_SAMPLE_STMT \
+		"SELECT queryid, sum(calls)\n" \
+		"FROM pg_stat_statements\n" \
+		"GROUP BY queryid;"
+
+struct sample_t
+{
+	RB_ENTRY(sample_t) entry;
+	row_order	order;
+
+	char		name[NAMEDATALEN + 1];
+
+	/* counter value at the last sample and when it was taken */
+	int64_t		value;
+	struct timespec taken;
+
+	/* rates accumulated since the last screen update */
+	int			samples;
+	double		last;
+	double		min;
+	double		max;
+	double		sum;
+
+	/* rates shown by the current screen update */
+	int			disp_samples;
+	double		disp_last;
+	double		disp_min;
+	double		disp_avg;
+	double		disp_max;
+};
+
+RB_HEAD(sample, sample_t);
+
+struct sampler
+{
+	const char *query;
+	struct sample head;
+	struct sample_t **nodes;	/* every row ever seen, for updates */
+	int			node_count;
+	struct sample_t *rows;		/* rows shown by the current update */
+	int			row_count;
+
+	/* cost of taking samples since the last screen update */
+	int			samples;
+	double		elapsed;
+	double		elapsed_max;
+
+	/* the same, as shown by the current update */
+	int			disp_samples;
+	double		disp_elapsed;
+	double		disp_elapsed_max;
+};
+
+int			samplecmp(struct sample_t *, struct sample_t *);
+int			print_sample_header(void);
+void		print_sample(void);
+int			read_sample(void);
+int			sample_sample(void);
+int			select_sample(void);
+void		sort_sample(void);
+int			sort_sample_name_callback(const void *, const void *);
+int			sort_sample_last_callback(const void *, const void *);
+int			sort_sample_min_callback(const void *, const void *);
+int			sort_sample_avg_callback(const void *, const void *);
+int			sort_sample_max_callback(const void *, const void *);
+
+RB_PROTOTYPE(sample, sample_t, entry, samplecmp)
+RB_GENERATE(sample, sample_t, entry, samplecmp)
+
+field_def	fields_sample[] =
+{
+	{
+		"DATABASE", 9, NAMEDATALEN, 1, FLD_ALIGN_LEFT, -1, 0, 0, 0
+	},
+	{
+		"QUERYID", 8, NAMEDATALEN, 1, FLD_ALIGN_LEFT, -1, 0, 0, 0
+	},
+	{
+		"SAMPLES", 8, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"LAST/s", 7, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"MIN/s", 7, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"AVG/s", 7, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"MAX/s", 7, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+};
+
+#define FLD_SAMPLE_DATNAME FIELD_ADDR(fields_sample, 0)
+#define FLD_SAMPLE_QUERYID FIELD_ADDR(fields_sample, 1)
+#define FLD_SAMPLE_SAMPLES FIELD_ADDR(fields_sample, 2)
+#define FLD_SAMPLE_LAST    FIELD_ADDR(fields_sample, 3)
+#define FLD_SAMPLE_MIN     FIELD_ADDR(fields_sample, 4)
+#define FLD_SAMPLE_AVG     FIELD_ADDR(fields_sample, 5)
+#define FLD_SAMPLE_MAX     FIELD_ADDR(fields_sample, 6)
+
+/* Define views */
+field_def  *view_sample_db[] = {
+	FLD_SAMPLE_DATNAME, FLD_SAMPLE_SAMPLES, FLD_SAMPLE_LAST, FLD_SAMPLE_MIN,
+	FLD_SAMPLE_AVG, FLD_SAMPLE_MAX, NULL
+};
+
+field_def  *view_sample_stmt[] = {
+	FLD_SAMPLE_QUERYID, FLD_SAMPLE_SAMPLES, FLD_SAMPLE_LAST, FLD_SAMPLE_MIN,
+	FLD_SAMPLE_AVG, FLD_SAMPLE_MAX, NULL
+};
+
+order_type	sample_order_list[] = {
+	{"name", "name", 'n', sort_sample_name_callback},
+	{"last", "last", 'L', sort_sample_last_callback},
+	{"min", "min", 'm', sort_sample_min_callback},
+	{"avg", "avg", 'a', sort_sample_avg_callback},
+	{"max", "max", 'x', sort_sample_max_callback},
+	{NULL, NULL, 0, NULL}
+};
+
+/* Define view managers */
+struct view_manager sampledb_mgr = {
+	"sampledb", select_sample, read_sample, sort_sample,
+	print_sample_header, print_sample, keyboard_callback, sample_order_list,
+	sample_order_list, sample_sample
+};
+
+struct view_manager samplestmt_mgr = {
+	"samplestmt", select_sample, read_sample, sort_sample,
+	print_sample_header, print_sample, keyboard_callback, sample_order_list,
+	sample_order_list, sample_sample
+};
+
+field_view	views_sample[] = {
+	{view_sample_db, "sampledb", 'H', &sampledb_mgr},
+	{view_sample_stmt, "samplestmt", 'J', &samplestmt_mgr},
+	{NULL, NULL, 0, NULL}
+};
+
+struct sampler sampler_db = {QUERY_SAMPLE_DB, RB_INITIALIZER(&sampler_db.head)};
+struct sampler sampler_stmt = {QUERY_SAMPLE_STMT,
+RB_INITIALIZER(&sampler_stmt.head)};
+
+static struct sampler *
+curr_sampler(void)
+{
+	if (curr_mgr == &samplestmt_mgr)
+		return &sampler_stmt;
+	return &sampler_db;
+}
+
+static double
+elapsed(const struct timespec *from, const struct timespec *to)
+{
+	return (to->tv_sec - from->tv_sec) +
+		(to->tv_nsec - from->tv_nsec) / 1000000000.0;
+}
+
+static void
+sample_info(struct sampler *s)
+{
+	int			i;
+	PGresult   *pgresult = NULL;
+	struct timespec start,
+				now;
+	double		rate,
+				interval;
+	void	   *tmp;
+
+	struct sample_t *n,
+			   *p;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	connect_to_db();
+	if (!pg_connected())
+	{
+		error("Cannot connect to database");
+		return;
+	}
+
+	pgresult = pg_exec(s->query);
+	if (PQresultStatus(pgresult) != PGRES_TUPLES_OK)
+	{
+		PQclear(pgresult);
+		disconnect_from_db();
+		return;
+	}
+	pg_taken(&now);
+
+	for (i = 0; i < PQntuples(pgresult); i++)
+	{
+		n = malloc(sizeof(struct sample_t));
+		if (n == NULL)
+		{
+			error("malloc error");
+			break;
+		}
+		strncpy(n->name, PQgetvalue(pgresult, i, 0), NAMEDATALEN);
+		n->name[NAMEDATALEN] = '\0';
+		p = RB_INSERT(sample, &s->head, n);
+		if (p == NULL)
+		{
+			tmp = reallocarray(s->nodes, s->node_count + 1,
+							   sizeof(struct sample_t *));
+			if (tmp == NULL)
+			{
+				error("reallocarray error");
+				RB_REMOVE(sample, &s->head, n);
+				free(n);
+				break;
+			}
+			s->nodes = tmp;
+			s->nodes[s->node_count++] = n;
+
+			n->order.node = n;
+			n->order.rank = -1;
+			n->samples = 0;
+			n->value = atoll(PQgetvalue(pgresult, i, 1));
+			n->taken = now;
+			continue;
+		}
+		free(n);
+		n = p;
+
+		interval = elapsed(&n->taken, &now);
+		rate = (atoll(PQgetvalue(pgresult, i, 1)) - n->value) / interval;
+		n->value = atoll(PQgetvalue(pgresult, i, 1));
+		n->taken = now;
+
+		/* a counter that went backwards was reset, skip this sample */
+		if (interval <= 0 || rate < 0)
+			continue;
+
+		if (n->samples == 0 || rate < n->min)
+			n->min = rate;
+		if (n->samples == 0 || rate > n->max)
+			n->max = rate;
+		n->sum = n->samples == 0 ? rate : n->sum + rate;
+		n->last = rate;
+		n->samples++;
+	}
+
+	PQclear(pgresult);
+	disconnect_from_db();
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	interval = elapsed(&start, &now);
+	s->elapsed += interval;
+	if (interval > s->elapsed_max)
+		s->elapsed_max = interval;
+	s->samples++;
+}
+
+/*
+ * Turn what was accumulated since the previous screen update into the rows
+ * shown by this one and start accumulating afresh.
+ */
+static void
+sample_update(struct sampler *s)
+{
+	struct sample_t *n,
+			   *p;
+	int			i;
+
+	if (s->node_count > s->row_count)
+	{
+		p = reallocarray(s->rows, s->node_count, sizeof(struct sample_t));
+		if (p == NULL)
+		{
+			error("reallocarray error");
+			return;
+		}
+		s->rows = p;
+	}
+
+	s->row_count = 0;
+	for (i = 0; i < s->node_count; i++)
+	{
+		n = s->nodes[i];
+		if (n->samples == 0)
+			continue;
+
+		n->disp_samples = n->samples;
+		n->disp_last = n->last;
+		n->disp_min = n->min;
+		n->disp_avg = n->sum / n->samples;
+		n->disp_max = n->max;
+		n->samples = 0;
+
+		memcpy(&s->rows[s->row_count++], n, sizeof(struct sample_t));
+	}
+
+	s->disp_samples = s->samples;
+	s->disp_elapsed = s->elapsed;
+	s->disp_elapsed_max = s->elapsed_max;
+	s->samples = 0;
+	s->elapsed = 0;
+	s->elapsed_max = 0;
+}
+
+int
+samplecmp(struct sample_t *e1, struct sample_t *e2)
+{
+	return strcmp(e1->name, e2->name);
+}
+
+int
+select_sample(void)
+{
+	/* Reconnecting several times a second would cost more than sampling. */
+	keep_connection();
+	return (0);
+}
+
+int
+sample_sample(void)
+{
+	sample_info(curr_sampler());
+	return (0);
+}
+
+int
+read_sample(void)
+{
+	struct sampler *s = curr_sampler();
+
+	sample_update(s);
+	num_disp = s->row_count;
+	return (0);
+}
+
+int
+initsample(void)
+{
+	field_view *v;
+	PGresult   *pgresult;
+	int			stmt_exist = 0;
+
+	serve_allow(QUERY_STAT_STMT_EXIST);
+	serve_allow(QUERY_SAMPLE_DB);
+	serve_allow(QUERY_SAMPLE_STMT);
+
+	connect_to_db();
+	if (pg_connected())
+	{
+		pgresult = pg_exec(QUERY_STAT_STMT_EXIST);
+		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK &&
+			PQntuples(pgresult) > 0)
+			stmt_exist = 1;
+		PQclear(pgresult);
+	}
+	disconnect_from_db();
+
+	for (v = views_sample; v->name != NULL; v++)
+		if (v->mgr != &samplestmt_mgr || stmt_exist)
+			add_view(v);
+
+	return (1);
+}
+
+int
+print_sample_header(void)
+{
+	struct sampler *s = curr_sampler();
+	char		buf[MAX_LINE_BUF];
+
+	print_header();
+
+	snprintf(buf, sizeof(buf),
+			 "sampling every %gs: %d samples, %.2f ms avg, %.2f ms max, "
+			 "%.1f%% of the interval",
+			 (double) usample / 1000000.0, s->disp_samples,
+			 s->disp_samples > 0 ?
+			 s->disp_elapsed * 1000.0 / s->disp_samples : 0,
+			 s->disp_elapsed_max * 1000.0,
+			 s->disp_samples > 0 ?
+			 s->disp_elapsed * 100000000.0 / s->disp_samples / usample : 0);
+
+	print_line(1, buf);
+
+	return (1);
+}
+
+void
+print_sample(void)
+{
+	struct sampler *s = curr_sampler();
+	struct sample_t *n;
+	int			cur = 0,
+				i;
+	int			end = dispstart + maxprint;
+
+	if (end > num_disp)
+		end = num_disp;
+
+	for (i = 0; i < s->row_count; i++)
+	{
+		do
+		{
+			if (cur >= dispstart && cur < end)
+			{
+				n = &s->rows[i];
+				print_fld_str(FLD_SAMPLE_DATNAME, n->name);
+				print_fld_str(FLD_SAMPLE_QUERYID, n->name);
+				print_fld_uint(FLD_SAMPLE_SAMPLES, n->disp_samples);
+				print_fld_rate(FLD_SAMPLE_LAST, n->disp_last);
+				print_fld_rate(FLD_SAMPLE_MIN, n->disp_min);
+				print_fld_rate(FLD_SAMPLE_AVG, n->disp_avg);
+				print_fld_rate(FLD_SAMPLE_MAX, n->disp_max);
+				end_line();
+			}
+			if (++cur >= end)
+				return;
+		} while (0);
+	}
+
+	do
+	{
+		if (cur >= dispstart && cur < end)
+			end_line();
+		if (++cur >= end)
+			return;
+	} while (0);
+}
+
+void
+sort_sample(void)
+{
+	struct sampler *s = curr_sampler();
+	order_type *ordering;
+
+	if (curr_mgr == NULL)
+		return;
+
+	ordering = curr_mgr->order_curr;
+
+	if (ordering == NULL)
+		return;
+	if (ordering->func == NULL)
+		return;
+	if (s->rows == NULL)
+		return;
+	if (s->row_count <= 0)
+		return;
+
+	sort_rows(s->rows, s->row_count, sizeof(struct sample_t),
+			  offsetof(struct sample_t, order), ordering->func);
+}
+
+int
+sort_sample_name_callback(const void *v1, const void *v2)
+{
+	struct sample_t *n1,
+			   *n2;
+
+	n1 = (struct sample_t *) v1;
+	n2 = (struct sample_t *) v2;
+
+	return strcmp(n1->name, n2->name) * sortdir;
+}
+
+static int
+sort_sample_rate(const void *v1, const void *v2, double r1, double r2)
+{
+	if (r1 < r2)
+		return sortdir;
+	if (r1 > r2)
+		return -sortdir;
+
+	return sort_sample_name_callback(v1, v2);
+}
+
+int
+sort_sample_last_callback(const void *v1, const void *v2)
+{
+	return sort_sample_rate(v1, v2, ((struct sample_t *) v1)->disp_last,
+							((struct sample_t *) v2)->disp_last);
+}
+
+int
+sort_sample_min_callback(const void *v1, const void *v2)
+{
+	return sort_sample_rate(v1, v2, ((struct sample_t *) v1)->disp_min,
+							((struct sample_t *) v2)->disp_min);
+}
+
+int
+sort_sample_avg_callback(const void *v1, const void *v2)
+{
+	return sort_sample_rate(v1, v2, ((struct sample_t *) v1)->disp_avg,
+							((struct sample_t *) v2)->disp_avg);
+}
+
+int
+sort_sample_max_callback(const void *v1, const void *v2)
+{
+	return sort_sample_rate(v1, v2, ((struct sample_t *) v1)->disp_max,
+							((struct sample_t *) v2)->disp_max);
+}
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#include <sys/types.h>
+
+#include <curses.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <bsd/stdlib.h>
+#endif							/* __linux__ */
+
+#include "engine.h"
+#include "pg_systat.h"
+#include "search.h"
+
+struct search_name
+{
+	char	   *name;
+	int			pos;			/* first row shown with the name */
+	unsigned int gen;			/* search the row was last seen at */
+};
+
+static void search_edit(const char *);
+static void search_exec(const char *);
+
+struct command cm_search = {"Search", search_exec, search_edit};
+
+/* the view the names are of */
+static struct view_manager *search_mgr = NULL;
+static unsigned int search_gen = 0;
+
+/* the names interned, in the order they were first seen */
+static struct search_name *names = NULL;
+static int	nnames = 0;
+static int	names_size = 0;
+
+/* open addressing table of indexes into names, plus one, 0 if free */
+static int *slots = NULL;
+static int	nslots = 0;
+
+/* indexes into names in the order of the names, the prefix index */
+static int *byname = NULL;
+
+/* the first row shown before the search, to go back to */
+static int	origin = 0;
+
+static unsigned int
+search_hash(const char *s)
+{
+	unsigned int h = 2166136261u;
+
+	while (*s != '\0')
+		h = (h ^ (unsigned char) *s++) * 16777619u;
+	return h;
+}
+
+static void
+search_reset(void)
+{
+	int			i;
+
+	for (i = 0; i < nnames; i++)
+		free(names[i].name);
+	free(names);
+	free(slots);
+	free(byname);
+	names = NULL;
+	slots = NULL;
+	byname = NULL;
+	nnames = names_size = nslots = 0;
+}
+
+static void
+search_insert_slot(int i)
+{
+	unsigned int h = search_hash(names[i].name) & (nslots - 1);
+
+	while (slots[h] != 0)
+		h = (h + 1) & (nslots - 1);
+	slots[h] = i + 1;
+}
+
+/*
+ * Make the hash table big enough to stay at most half full with n names, and
+ * fill it again if it had to grow.
+ */
+static int
+search_rehash(int n, int force)
+{
+	int			size = nslots > 0 ? nslots : 64;
+	int			i;
+
+	while (size < 2 * n)
+		size *= 2;
+	if (size == nslots && !force)
+		return 0;
+
+	free(slots);
+	if ((slots = calloc(size, sizeof(int))) == NULL)
+		return -1;
+	nslots = size;
+	for (i = 0; i < nnames; i++)
+		search_insert_slot(i);
+	return 0;
+}
+
+/*
+ * The index of the name, interning it if it is new.
+ */
+static int
+search_intern(const char *s)
+{
+	struct search_name *n;
+	unsigned int h;
+	int		   *b;
+	int			size;
+
+	for (h = search_hash(s) & (nslots - 1); slots[h] != 0;
+		 h = (h + 1) & (nslots - 1))
+		if (strcmp(names[slots[h] - 1].name, s) == 0)
+			return slots[h] - 1;
+
+	if (nnames == names_size)
+	{
+		size = names_size > 0 ? names_size * 2 : 256;
+		if ((n = reallocarray(names, size, sizeof(*n))) == NULL)
+			return -1;
+		names = n;
+		if ((b = reallocarray(byname, size, sizeof(int))) == NULL)
+			return -1;
+		byname = b;
+		names_size = size;
+	}
+	if ((names[nnames].name = strdup(s)) == NULL)
+		return -1;
+	names[nnames].gen = 0;
+
+	if (2 * (nnames + 1) > nslots)
+	{
+		nnames++;
+		return search_rehash(nnames, 0) == -1 ? -1 : nnames - 1;
+	}
+	slots[h] = ++nnames;
+	return nnames - 1;
+}
+
+static int
+search_cmp(const void *v1, const void *v2)
+{
+	return strcmp(names[*(const int *) v1].name,
+				  names[*(const int *) v2].name);
+}
+
+/*
+ * Drop the names of rows that are gone and index the rest again from scratch.
+ */
+static int
+search_rebuild(void)
+{
+	int			i,
+				j;
+
+	for (i = j = 0; i < nnames; i++)
+	{
+		if (names[i].gen != search_gen)
+		{
+			free(names[i].name);
+			continue;
+		}
+		names[j++] = names[i];
+	}
+	nnames = j;
+	for (i = 0; i < nnames; i++)
+		byname[i] = i;
+	qsort(byname, nnames, sizeof(int), search_cmp);
+	return search_rehash(nnames, 1);
+}
+
+/*
+ * Merge the names interned since the index was last brought up to date, from
+ * first on, into the index.  There are usually few if any, so they are sorted
+ * on their own and merged from the end, which moves each entry at most once.
+ */
+static int
+search_merge(int first)
+{
+	int		   *new;
+	int			nnew = nnames - first,
+				i,
+				j,
+				k;
+
+	if (nnew == 0)
+		return 0;
+	if ((new = reallocarray(NULL, nnew, sizeof(int))) == NULL)
+		return -1;
+	for (i = 0; i < nnew; i++)
+		new[i] = first + i;
+	qsort(new, nnew, sizeof(int), search_cmp);
+
+	i = first - 1;
+	j = nnew - 1;
+	for (k = nnames - 1; j >= 0; k--)
+	{
+		if (i >= 0 && search_cmp(&byname[i], &new[j]) > 0)
+			byname[k] = byname[i--];
+		else
+			byname[k] = new[j--];
+	}
+	free(new);
+	return 0;
+}
+
+/*
+ * Bring the names up to date with the rows of the current view, noting where
+ * each is shown.  The names of rows that went away are kept, as they often
+ * come back, unless they outnumber the rows there are.
+ */
+static int
+search_update(void)
+{
+	const char *s;
+	int			first,
+				live = 0,
+				i,
+				k;
+
+	if (search_mgr != curr_mgr)
+	{
+		search_reset();
+		search_mgr = curr_mgr;
+	}
+	if (nslots == 0 && search_rehash(0, 1) == -1)
+		return -1;
+
+	search_gen++;
+	first = nnames;
+	for (i = 0; (s = curr_mgr->name_fn(i)) != NULL; i++)
+	{
+		if ((k = search_intern(s)) == -1)
+			return -1;
+		if (names[k].gen == search_gen)
+			continue;
+		names[k].gen = search_gen;
+		names[k].pos = i;
+		live++;
+	}
+
+	if (nnames - live > live)
+		return search_rebuild();
+	return search_merge(first);
+}
+
+/*
+ * The first row shown whose name starts with prefix, or -1 if there is none.
+ */
+static int
+search_lookup(const char *prefix)
+{
+	size_t		len = strlen(prefix);
+	int			lo = 0,
+				hi = nnames,
+				mid,
+				pos = -1;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (strcmp(names[byname[mid]].name, prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < nnames && strncmp(names[byname[lo]].name, prefix, len) == 0;
+		 lo++)
+	{
+		if (names[byname[lo]].gen != search_gen)
+			continue;
+		if (pos == -1 || names[byname[lo]].pos < pos)
+			pos = names[byname[lo]].pos;
+	}
+	return pos;
+}
+
+static void
+search_edit(const char *prefix)
+{
+	int			pos;
+
+	if (*prefix == '\0')
+		pos = origin;
+	else if ((pos = search_lookup(prefix)) == -1)
+	{
+		beep();
+		return;
+	}
+	dispstart = pos;
+	need_update = 1;
+}
+
+static void
+search_exec(const char *prefix)
+{
+	if (*prefix != '\0' && search_lookup(prefix) == -1)
+		error("Not found: %s", prefix);
+}
+
+void
+search_start(void)
+{
+	if (curr_mgr == NULL || curr_mgr->name_fn == NULL)
+	{
+		error("Cannot search the %s view",
+			  curr_view != NULL ? curr_view->name : "current");
+		return;
+	}
+	if (search_update() == -1)
+	{
+		search_reset();
+		error("Cannot search, out of memory");
+		return;
+	}
+	origin = dispstart;
+	command_set(&cm_search, NULL);
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#ifndef _SEARCH_H_
+#define _SEARCH_H_
+
+/*
+ * Incremental search of the rows of a view by name, started with /.  Every
+ * keystroke moves the display to the first row whose name starts with what
+ * was typed so far; Enter stays there, and clearing the line with Escape goes
+ * back to where the search started.
+ *
+ * The names of the rows, as the name_fn of the view gives them, are interned
+ * in a hash table and kept sorted in a prefix index, with the position of
+ * each in the order shown.  Starting a search only looks up the names of the
+ * current rows and merges the few new ones into the index, and a keystroke
+ * is a binary search of the index.  The view is not read or sorted again
+ * while the search is being typed, so the positions stay valid.
+ */
+void		search_start(void);
+
+#endif							/* _SEARCH_H_ */
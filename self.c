@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "pg.h"
+#include "pg_systat.h"
+#include "self.h"
+
+/*
+ * The self view shows what pg_systat costs, per view that was read: how long
+ * its queries took, at the median and the 99th percentile of the last ones,
+ * how many rows and bytes the last read received, and how long reading,
+ * sorting and drawing took on average.  The header adds the memory used and
+ * the share of one core the queries took since the start, which is what they
+ * cost the server, the network aside.
+ */
+
+#define SELF_MAX_VIEWS	64
+#define SELF_LATENCIES	64		/* last queries the percentiles are of */
+
+struct self_t
+{
+	row_order	order;
+
+	struct view_manager *mgr;
+	const char *name;
+
+	int64_t		reads;
+	int64_t		read_usec;		/* queries included */
+	int64_t		queries;
+	int64_t		query_usec;		/* connecting and transactions included */
+	int64_t		rows;			/* received by the last read */
+	int64_t		bytes;
+	int64_t		sorts;
+	int64_t		sort_usec;
+	int64_t		draws;
+	int64_t		draw_usec;
+
+	/* how long the last queries took, oldest overwritten first */
+	int64_t		latency[SELF_LATENCIES];
+	int			nlatency;
+
+	/* the percentiles, computed when the view is read */
+	double		p50;
+	double		p99;
+};
+
+static void print_self(void);
+static int	print_self_header(void);
+static int	read_self(void);
+static int	select_self(void);
+static void sort_self(void);
+static int	sort_self_name_callback(const void *, const void *);
+static int	sort_self_p99_callback(const void *, const void *);
+static int	sort_self_query_callback(const void *, const void *);
+static int	sort_self_read_callback(const void *, const void *);
+
+field_def	fields_self[] =
+{
+	{
+		"VIEW", 5, NAMEDATALEN, 1, FLD_ALIGN_LEFT, -1, 0, 0, 0
+	},
+	{
+		"READS", 6, 10, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"P50_MS", 7, 10, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"P99_MS", 7, 10, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"ROWS", 5, 10, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"BYTES", 6, 10, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"QUERY_MS", 9, 10, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"PARSE_MS", 9, 10, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"SORT_MS", 8, 10, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"DRAW_MS", 8, 10, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+};
+
+#define FLD_SELF_VIEW		FIELD_ADDR(fields_self, 0)
+#define FLD_SELF_READS		FIELD_ADDR(fields_self, 1)
+#define FLD_SELF_P50		FIELD_ADDR(fields_self, 2)
+#define FLD_SELF_P99		FIELD_ADDR(fields_self, 3)
+#define FLD_SELF_ROWS		FIELD_ADDR(fields_self, 4)
+#define FLD_SELF_BYTES		FIELD_ADDR(fields_self, 5)
+#define FLD_SELF_QUERY		FIELD_ADDR(fields_self, 6)
+#define FLD_SELF_PARSE		FIELD_ADDR(fields_self, 7)
+#define FLD_SELF_SORT		FIELD_ADDR(fields_self, 8)
+#define FLD_SELF_DRAW		FIELD_ADDR(fields_self, 9)
+
+/* Define views */
+field_def  *view_self_0[] = {
+	FLD_SELF_VIEW, FLD_SELF_READS, FLD_SELF_P50, FLD_SELF_P99, FLD_SELF_ROWS,
+	FLD_SELF_BYTES, FLD_SELF_QUERY, FLD_SELF_PARSE, FLD_SELF_SORT,
+	FLD_SELF_DRAW, NULL
+};
+
+order_type	self_order_list[] = {
+	{"name", "name", 'n', sort_self_name_callback},
+	{"query", "query", 't', sort_self_query_callback},
+	{"p99", "p99", '9', sort_self_p99_callback},
+	{"read", "read", 'e', sort_self_read_callback},
+	{NULL, NULL, 0, NULL}
+};
+
+/* Define view managers */
+struct view_manager self_mgr = {
+	"self", select_self, read_self, sort_self, print_self_header,
+	print_self, keyboard_callback, self_order_list, self_order_list
+};
+
+field_view	views_self[] = {
+	{view_self_0, "self", 'I', &self_mgr},
+	{NULL, NULL, 0, NULL}
+};
+
+/* every view read so far, and the copies of them shown */
+static struct self_t stats[SELF_MAX_VIEWS];
+static int	nstats = 0;
+static struct self_t selfs[SELF_MAX_VIEWS];
+static int	self_count = 0;
+
+/* the view being read, that queries are counted against */
+static struct self_t *reading = NULL;
+
+static struct timespec started;
+
+static struct self_t *
+self_find(struct view_manager *mgr, const char *name)
+{
+	struct self_t *s;
+	int			i;
+
+	for (i = 0; i < nstats; i++)
+		if (stats[i].mgr == mgr)
+			return &stats[i];
+	if (name == NULL || nstats == SELF_MAX_VIEWS)
+		return NULL;
+
+	s = &stats[nstats++];
+	s->mgr = mgr;
+	s->name = name;
+	s->order.node = s;
+	s->order.rank = -1;
+	return s;
+}
+
+void
+self_read_start(field_view * v)
+{
+	if ((reading = self_find(v->mgr, v->name)) == NULL)
+		return;
+	reading->rows = 0;
+	reading->bytes = 0;
+}
+
+/*
+ * Count a read of "usec" microseconds, "query_usec" of which were spent
+ * connecting and waiting for the server, as pg_query_usec() counts them.
+ */
+void
+self_read_end(int64_t usec, int64_t query_usec)
+{
+	if (reading == NULL)
+		return;
+	reading->reads++;
+	reading->read_usec += usec;
+	reading->query_usec += query_usec;
+	reading = NULL;
+}
+
+/*
+ * Count a query against the view being read.  Queries made outside of a read,
+ * for the header, are not counted.
+ */
+void
+self_query(int64_t usec, const PGresult *pgresult)
+{
+	int			nrows,
+				ncols,
+				i,
+				j;
+
+	if (reading == NULL)
+		return;
+
+	reading->queries++;
+	reading->latency[reading->nlatency++ % SELF_LATENCIES] = usec;
+
+	if (PQresultStatus(pgresult) != PGRES_TUPLES_OK)
+		return;
+	nrows = PQntuples(pgresult);
+	ncols = PQnfields(pgresult);
+	reading->rows += nrows;
+	for (i = 0; i < nrows; i++)
+		for (j = 0; j < ncols; j++)
+			reading->bytes += PQgetlength(pgresult, i, j);
+}
+
+void
+self_sort(struct view_manager *mgr, int64_t usec)
+{
+	struct self_t *s;
+
+	if ((s = self_find(mgr, NULL)) == NULL)
+		return;
+	s->sorts++;
+	s->sort_usec += usec;
+}
+
+void
+self_draw(struct view_manager *mgr, int64_t usec)
+{
+	struct self_t *s;
+
+	if ((s = self_find(mgr, NULL)) == NULL)
+		return;
+	s->draws++;
+	s->draw_usec += usec;
+}
+
+static int
+latency_cmp(const void *v1, const void *v2)
+{
+	int64_t		a = *(const int64_t *) v1,
+				b = *(const int64_t *) v2;
+
+	return (a > b) - (a < b);
+}
+
+/*
+ * The median and 99th percentile of the last queries, in milliseconds.
+ */
+static void
+self_percentiles(struct self_t *s)
+{
+	int64_t		sorted[SELF_LATENCIES];
+	int			n = s->nlatency < SELF_LATENCIES ? s->nlatency :
+	SELF_LATENCIES;
+
+	s->p50 = s->p99 = 0;
+	if (n == 0)
+		return;
+	memcpy(sorted, s->latency, n * sizeof(int64_t));
+	qsort(sorted, n, sizeof(int64_t), latency_cmp);
+	s->p50 = sorted[(n - 1) / 2] / 1000.0;
+	s->p99 = sorted[(n - 1) * 99 / 100] / 1000.0;
+}
+
+static double
+per_ms(int64_t usec, int64_t n)
+{
+	return n > 0 ? usec / 1000.0 / n : 0;
+}
+
+static int
+select_self(void)
+{
+	return (0);
+}
+
+static int
+read_self(void)
+{
+	int			i;
+
+	for (i = 0; i < nstats; i++)
+	{
+		self_percentiles(&stats[i]);
+		memcpy(&selfs[i], &stats[i], sizeof(struct self_t));
+	}
+	self_count = nstats;
+	num_disp = self_count;
+	return (0);
+}
+
+/*
+ * The resident set size of the process now and at its largest, in bytes, or
+ * 0 if it cannot be told.
+ */
+static void
+self_rss(long long *rss, long long *maxrss)
+{
+	struct rusage ru;
+	FILE	   *f;
+	long long	size,
+				resident;
+
+	*rss = *maxrss = 0;
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		*maxrss = ru.ru_maxrss * 1024LL;	/* in kilobytes */
+
+	/* the current size only where there is a /proc to tell it */
+	if ((f = fopen("/proc/self/statm", "r")) == NULL)
+		return;
+	if (fscanf(f, "%lld %lld", &size, &resident) == 2)
+		*rss = resident * sysconf(_SC_PAGESIZE);
+	fclose(f);
+}
+
+static int
+print_self_header(void)
+{
+	struct timespec now;
+	char		buf[MAX_LINE_BUF];
+	long long	rss,
+				maxrss;
+	int64_t		elapsed;
+
+	print_header();
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - started.tv_sec) * 1000000LL +
+		(now.tv_nsec - started.tv_nsec) / 1000;
+	self_rss(&rss, &maxrss);
+
+	snprintf(buf, sizeof(buf),
+			 "queries %.3f%% of one core since start, rss %lld kB, "
+			 "max rss %lld kB",
+			 elapsed > 0 ? pg_query_usec() * 100.0 / elapsed : 0,
+			 rss / 1024, maxrss / 1024);
+	print_line(1, buf);
+
+	return (1);
+}
+
+static void
+print_self(void)
+{
+	struct self_t *s;
+	int			cur = 0,
+				i;
+	int			end = dispstart + maxprint;
+
+	if (end > num_disp)
+		end = num_disp;
+
+	for (i = 0; i < self_count; i++)
+	{
+		s = &selfs[i];
+		if (cur >= dispstart && cur < end)
+		{
+			print_fld_str(FLD_SELF_VIEW, s->name);
+			print_fld_sdiv(FLD_SELF_READS, s->reads, 1000);
+			print_fld_float(FLD_SELF_P50, s->p50, 2);
+			print_fld_float(FLD_SELF_P99, s->p99, 2);
+			print_fld_sdiv(FLD_SELF_ROWS, s->rows, 1000);
+			print_fld_size(FLD_SELF_BYTES, s->bytes);
+			print_fld_float(FLD_SELF_QUERY, per_ms(s->query_usec, s->reads),
+							2);
+			print_fld_float(FLD_SELF_PARSE,
+							per_ms(s->read_usec - s->query_usec, s->reads), 2);
+			print_fld_float(FLD_SELF_SORT, per_ms(s->sort_usec, s->sorts), 2);
+			print_fld_float(FLD_SELF_DRAW, per_ms(s->draw_usec, s->draws), 2);
+			end_line();
+		}
+		if (++cur >= end)
+			return;
+	}
+}
+
+static void
+sort_self(void)
+{
+	order_type *ordering;
+
+	if (curr_mgr == NULL)
+		return;
+
+	ordering = curr_mgr->order_curr;
+
+	if (ordering == NULL)
+		return;
+	if (ordering->func == NULL)
+		return;
+	if (self_count <= 0)
+		return;
+
+	sort_rows(selfs, self_count, sizeof(struct self_t),
+			  offsetof(struct self_t, order), ordering->func);
+}
+
+static int
+sort_self_name_callback(const void *v1, const void *v2)
+{
+	const struct self_t *n1 = v1,
+			   *n2 = v2;
+
+	return strcmp(n1->name, n2->name) * sortdir;
+}
+
+static int
+sort_self_query_callback(const void *v1, const void *v2)
+{
+	const struct self_t *n1 = v1,
+			   *n2 = v2;
+
+	if (n1->query_usec < n2->query_usec)
+		return sortdir;
+	if (n1->query_usec > n2->query_usec)
+		return -sortdir;
+
+	return sort_self_name_callback(v1, v2);
+}
+
+static int
+sort_self_p99_callback(const void *v1, const void *v2)
+{
+	const struct self_t *n1 = v1,
+			   *n2 = v2;
+
+	if (n1->p99 < n2->p99)
+		return sortdir;
+	if (n1->p99 > n2->p99)
+		return -sortdir;
+
+	return sort_self_name_callback(v1, v2);
+}
+
+static int
+sort_self_read_callback(const void *v1, const void *v2)
+{
+	const struct self_t *n1 = v1,
+			   *n2 = v2;
+
+	if (n1->read_usec < n2->read_usec)
+		return sortdir;
+	if (n1->read_usec > n2->read_usec)
+		return -sortdir;
+
+	return sort_self_name_callback(v1, v2);
+}
+
+int
+initself(void)
+{
+	field_view *v;
+
+	clock_gettime(CLOCK_MONOTONIC, &started);
+
+	for (v = views_self; v->name != NULL; v++)
+		add_view(v);
+
+	return (1);
+}
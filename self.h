@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#ifndef _SELF_H_
+#define _SELF_H_
+
+#include <stdint.h>
+
+#include <libpq-fe.h>
+
+#include "engine.h"
+
+/*
+ * What pg_systat itself costs, per view, for the self view: the engine and
+ * pg_exec() report the time each read, query, sort and redraw took, and the
+ * queries are counted against the view being read.
+ */
+void		self_read_start(field_view *);
+void		self_read_end(int64_t, int64_t);
+void		self_query(int64_t, const PGresult *);
+void		self_sort(struct view_manager *, int64_t);
+void		self_draw(struct view_manager *, int64_t);
+
+#endif							/* _SELF_H_ */
@@ -0,0 +1,924 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif							/* __linux__ */
+
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <bsd/string.h>
+#include <bsd/sys/tree.h>
+#endif							/* __linux__ */
+
+#include "filter.h"
+#include "pg.h"
+#include "pg_systat.h"
+#include "recorder.h"
+#include "serve.h"
+
+#define SERVE_MAX_CLIENTS	64
+#define SERVE_TIMEOUT		1000	/* milliseconds a daemon may take */
+#define SERVE_STALL			60000000	/* usec a viewer may take */
+#define SERVE_IDLE			600000000	/* usec a result is kept unasked */
+
+/* asked by a viewer attaching, to learn the version of the server */
+#define SERVE_HELLO "SELECT 1;"
+
+/* the last result of a query, answered with while it is recent enough */
+struct serve_result
+{
+	RB_ENTRY(serve_result) entry;
+	TAILQ_ENTRY(serve_result) list;
+	char	   *query;
+	PGresult   *res;
+	int64_t		taken;
+	int64_t		asked;
+};
+
+/* a query of the views, with the filters of the viewer when "filtered" */
+struct serve_query
+{
+	char	   *query;
+	int			filtered;
+	enum filter_target target;
+	const char *id;
+};
+
+struct serve_buf
+{
+	char	   *data;
+	size_t		len;
+	size_t		size;
+	int			failed;
+};
+
+/*
+ * A viewer, with the request it is sending or the response it is reading.
+ * Neither blocks the daemon: a viewer is only read from or written to when
+ * poll() says it will not wait.
+ */
+struct serve_client
+{
+	int			fd;
+	struct serve_request req;
+	size_t		got;			/* bytes of the request read */
+	char	   *body;			/* the query and the filters that follow */
+	char	   *out;			/* the response, while being written */
+	size_t		outlen;
+	size_t		sent;
+	int64_t		since;			/* when the request or response began */
+};
+
+int			serve_result_cmp(struct serve_result *, struct serve_result *);
+
+RB_HEAD(serve_results, serve_result) head_serve_results =
+RB_INITIALIZER(&head_serve_results);
+RB_PROTOTYPE(serve_results, serve_result, entry, serve_result_cmp)
+RB_GENERATE(serve_results, serve_result, entry, serve_result_cmp)
+
+TAILQ_HEAD(serve_result_list, serve_result) serve_result_list =
+TAILQ_HEAD_INITIALIZER(serve_result_list);
+
+int			attached = 0;
+
+static char sock_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+
+/* the daemon */
+static int	listen_fd = -1;
+static gid_t serve_gid = (gid_t) -1;
+static struct serve_client clients[SERVE_MAX_CLIENTS];
+static int	nclients = 0;
+static struct serve_buf reply;
+static struct serve_query *queries;
+static int	nqueries = 0;
+static int	queries_size = 0;
+
+/* an attached pg_systat */
+static int	serve_fd = -1;
+static int	server_version = 0;
+static int64_t taken = 0;
+
+int
+serve_result_cmp(struct serve_result *e1, struct serve_result *e2)
+{
+	return strcmp(e1->query, e2->query);
+}
+
+static int64_t
+monotonic_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int
+read_all(int fd, void *buf, size_t len, int timeout)
+{
+	char	   *p = buf;
+	ssize_t		n;
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (len > 0)
+	{
+		if (poll(&pfd, 1, timeout) <= 0)
+			return -1;
+		if ((n = read(fd, p, len)) <= 0)
+		{
+			if (n == -1 && errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t		n;
+
+	while (len > 0)
+	{
+		if ((n = write(fd, p, len)) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int
+sock_addr(const char *path, struct sockaddr_un *sun)
+{
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	if (strlcpy(sun->sun_path, path, sizeof(sun->sun_path)) >=
+		sizeof(sun->sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strlcpy(sock_path, path, sizeof(sock_path));
+	return 0;
+}
+
+static void
+serve_allow_query(const char *query, int filtered, enum filter_target target,
+				  const char *id)
+{
+	struct serve_query *grown;
+	int			i;
+	int			size;
+
+	/* only the daemon runs the queries of others */
+	if (listen_fd == -1)
+		return;
+
+	for (i = 0; i < nqueries; i++)
+		if (strcmp(queries[i].query, query) == 0 &&
+			queries[i].filtered == filtered)
+			return;
+
+	if (nqueries == queries_size)
+	{
+		size = queries_size > 0 ? queries_size * 2 : 64;
+		grown = reallocarray(queries, size, sizeof(struct serve_query));
+		if (grown == NULL)
+			return;
+		queries = grown;
+		queries_size = size;
+	}
+	if ((queries[nqueries].query = strdup(query)) == NULL)
+		return;
+	queries[nqueries].filtered = filtered;
+	queries[nqueries].target = target;
+	queries[nqueries].id = id;
+	nqueries++;
+}
+
+/*
+ * Let viewers have the daemon run "query".  The daemon runs the queries of
+ * the views only, never SQL of a viewer's own, so every query a view may run
+ * is allowed when it is initialized.
+ */
+void
+serve_allow(const char *query)
+{
+	serve_allow_query(query, 0, 0, NULL);
+}
+
+/*
+ * Let viewers have the daemon run "query" with their filters, as
+ * filter_query() makes it.
+ */
+void
+serve_allow_filtered(const char *query, enum filter_target target,
+					 const char *id)
+{
+	serve_allow_query(query, 1, target, id);
+}
+
+/*
+ * Whether "query" is one of the views', as it is with the filters "spec" of
+ * the viewer.  The filters are compiled by the daemon itself, and the query
+ * must come out the same.
+ */
+static int
+serve_allowed(const char *query, const char *spec)
+{
+	int			i;
+
+	for (i = 0; i < nqueries; i++)
+		if (!queries[i].filtered && strcmp(queries[i].query, query) == 0)
+			return 1;
+
+	if (strcmp(spec, filter_get()) != 0 && filter_set(spec) == -1)
+		return 0;
+	for (i = 0; i < nqueries; i++)
+		if (queries[i].filtered &&
+			strcmp(filter_query(queries[i].query, queries[i].target,
+								queries[i].id), query) == 0)
+			return 1;
+	return 0;
+}
+
+/*
+ * Whether the peer on "fd" may attach: the user the daemon runs as, root, or
+ * a member of the group given with --serve-group.
+ */
+static int
+serve_peer(int fd)
+{
+	struct passwd *pw;
+	struct group *gr;
+	char	  **m;
+	uid_t		uid;
+	gid_t		gid;
+#ifdef __linux__
+	struct ucred cred;
+	socklen_t	len = sizeof(cred);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1)
+		return 0;
+	uid = cred.uid;
+	gid = cred.gid;
+#else
+	if (getpeereid(fd, &uid, &gid) == -1)
+		return 0;
+#endif							/* __linux__ */
+
+	if (uid == 0 || uid == geteuid())
+		return 1;
+	if (serve_gid == (gid_t) -1)
+		return 0;
+	if (gid == serve_gid)
+		return 1;
+	if ((pw = getpwuid(uid)) == NULL || (gr = getgrgid(serve_gid)) == NULL)
+		return 0;
+	for (m = gr->gr_mem; *m != NULL; m++)
+		if (strcmp(*m, pw->pw_name) == 0)
+			return 1;
+	return 0;
+}
+
+static void
+reply_append(const void *s, size_t len)
+{
+	char	   *p;
+	size_t		size;
+
+	if (reply.failed)
+		return;
+
+	if (reply.len + len > reply.size)
+	{
+		size = reply.size > 0 ? reply.size : 65536;
+		while (reply.len + len > size)
+			size *= 2;
+		if (size > SERVE_MAX_RESPONSE ||
+			(p = realloc(reply.data, size)) == NULL)
+		{
+			reply.failed = 1;
+			return;
+		}
+		reply.data = p;
+		reply.size = size;
+	}
+	memcpy(reply.data + reply.len, s, len);
+	reply.len += len;
+}
+
+/*
+ * Make the response of viewer "c" "res", taken at "when", or an error if it
+ * is NULL, failed or is too large to send.  It is written as the viewer reads
+ * it.  Returns -1 if there is no memory for even an error.
+ */
+static int
+serve_reply(struct serve_client *c, const PGresult *res, int64_t when)
+{
+	struct serve_response resp;
+	int32_t		len;
+	int			r,
+				f;
+
+	memset(&resp, 0, sizeof(resp));
+	resp.status = -1;
+	resp.server_version = options.connection != NULL ?
+		PQserverVersion(options.connection) : 0;
+	resp.taken = when;
+
+	/* the header goes first, filled in once the length is known */
+	reply.len = 0;
+	reply.failed = 0;
+	reply_append(&resp, sizeof(resp));
+	if (res != NULL && PQresultStatus(res) == PGRES_TUPLES_OK)
+	{
+		for (f = 0; f < PQnfields(res); f++)
+			reply_append(PQfname(res, f), strlen(PQfname(res, f)) + 1);
+		for (r = 0; r < PQntuples(res); r++)
+			for (f = 0; f < PQnfields(res); f++)
+			{
+				len = PQgetisnull(res, r, f) ? -1 : PQgetlength(res, r, f);
+				reply_append(&len, sizeof(len));
+				if (len > 0)
+					reply_append(PQgetvalue(res, r, f), len);
+			}
+		if (!reply.failed)
+		{
+			resp.status = 0;
+			resp.nrows = PQntuples(res);
+			resp.ncols = PQnfields(res);
+			resp.len = reply.len - sizeof(resp);
+		}
+	}
+	if (resp.status != 0)
+	{
+		reply.len = 0;
+		reply.failed = 0;
+		reply_append(&resp, sizeof(resp));
+		if (reply.failed)
+			return -1;
+	}
+	memcpy(reply.data, &resp, sizeof(resp));
+
+	/* the viewer takes the buffer, a new one is made for the next */
+	c->out = reply.data;
+	c->outlen = reply.len;
+	c->sent = 0;
+	c->since = monotonic_usec();
+	reply.data = NULL;
+	reply.len = 0;
+	reply.size = 0;
+	return 0;
+}
+
+/*
+ * Answer the request of viewer "c", from the last result of the query if it
+ * is recent enough.  A query that is not one of the views' is answered with
+ * an error.
+ */
+static int
+serve_request(struct serve_client *c)
+{
+	struct serve_result key,
+			   *sr;
+	char	   *query = c->body,
+			   *spec = c->body + c->req.len + 1;
+	PGresult   *res;
+	int64_t		now;
+
+	c->body = NULL;
+	c->got = 0;
+	now = monotonic_usec();
+	if (memchr(query, '\0', c->req.len) != NULL ||
+		memchr(spec, '\0', c->req.filter_len) != NULL ||
+		!serve_allowed(query, spec))
+	{
+		free(query);
+		return serve_reply(c, NULL, now);
+	}
+
+	key.query = query;
+	sr = RB_FIND(serve_results, &head_serve_results, &key);
+	if (sr != NULL && now - sr->taken <= c->req.max_age * 1000LL)
+	{
+		free(query);
+		sr->asked = now;
+		return serve_reply(c, sr->res, sr->taken);
+	}
+
+	connect_to_db();
+	if (!pg_connected())
+	{
+		free(query);
+		return serve_reply(c, NULL, now);
+	}
+	/* a failure is kept too, for viewers not to retry it all at once */
+	res = pg_exec(query);
+	now = monotonic_usec();
+
+	if (sr == NULL && (sr = calloc(1, sizeof(*sr))) == NULL)
+	{
+		/* answered all the same, only not kept */
+		free(query);
+		if (serve_reply(c, res, now) == -1)
+		{
+			PQclear(res);
+			return -1;
+		}
+		PQclear(res);
+		return 0;
+	}
+	if (sr->query == NULL)
+	{
+		sr->query = query;
+		RB_INSERT(serve_results, &head_serve_results, sr);
+		TAILQ_INSERT_TAIL(&serve_result_list, sr, list);
+	}
+	else
+	{
+		free(query);
+		PQclear(sr->res);
+	}
+	sr->res = res;
+	sr->taken = now;
+	sr->asked = now;
+	return serve_reply(c, sr->res, sr->taken);
+}
+
+/*
+ * Read what viewer "c" has sent of its request, and answer it once it is all
+ * there.  Returns -1 when the viewer is gone or talks nonsense.
+ */
+static int
+serve_read(struct serve_client *c)
+{
+	size_t		total = sizeof(c->req) + c->req.len + c->req.filter_len;
+	char	   *p;
+	size_t		want;
+	ssize_t		n;
+
+	if (c->got == 0)
+		c->since = monotonic_usec();
+	if (c->got < sizeof(c->req))
+	{
+		p = (char *) &c->req + c->got;
+		want = sizeof(c->req) - c->got;
+	}
+	else
+	{
+		p = c->body + c->got - sizeof(c->req);
+		want = total - c->got;
+	}
+
+	if ((n = read(c->fd, p, want)) <= 0)
+		return n == -1 && (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+	c->got += n;
+	if (c->got < sizeof(c->req))
+		return 0;
+
+	if (c->body == NULL)
+	{
+		if (c->req.len == 0 || c->req.len > SERVE_MAX_QUERY ||
+			c->req.filter_len > SERVE_MAX_FILTER)
+			return -1;
+		/* the query and the filters, each ending in a NUL */
+		if ((c->body = malloc(c->req.len + 1 + c->req.filter_len + 1)) == NULL)
+			return -1;
+	}
+	if (c->got < sizeof(c->req) + c->req.len + c->req.filter_len)
+		return 0;
+
+	memmove(c->body + c->req.len + 1, c->body + c->req.len,
+			c->req.filter_len);
+	c->body[c->req.len] = '\0';
+	c->body[c->req.len + 1 + c->req.filter_len] = '\0';
+	return serve_request(c);
+}
+
+/*
+ * Write what viewer "c" can take of its response.  Returns -1 when the viewer
+ * is gone.
+ */
+static int
+serve_write(struct serve_client *c)
+{
+	ssize_t		n;
+
+	if ((n = write(c->fd, c->out + c->sent, c->outlen - c->sent)) == -1)
+		return errno == EINTR || errno == EAGAIN ? 0 : -1;
+	c->sent += n;
+	if (c->sent == c->outlen)
+	{
+		free(c->out);
+		c->out = NULL;
+		c->since = 0;
+	}
+	return 0;
+}
+
+static void
+serve_drop(int i)
+{
+	close(clients[i].fd);
+	free(clients[i].body);
+	free(clients[i].out);
+	clients[i] = clients[--nclients];
+}
+
+/*
+ * Forget the results no viewer asked for in a while, as of views no longer
+ * watched or filters no longer used.
+ */
+static void
+serve_expire(void)
+{
+	struct serve_result *sr,
+			   *next;
+	int64_t		now = monotonic_usec();
+
+	for (sr = TAILQ_FIRST(&serve_result_list); sr != NULL; sr = next)
+	{
+		next = TAILQ_NEXT(sr, list);
+		if (now - sr->asked < SERVE_IDLE)
+			continue;
+		RB_REMOVE(serve_results, &head_serve_results, sr);
+		TAILQ_REMOVE(&serve_result_list, sr, list);
+		PQclear(sr->res);
+		free(sr->query);
+		free(sr);
+	}
+}
+
+/*
+ * Bind "fd" to "sun" as a socket only its owner, or the group given, can
+ * connect to.  The mode is set as the socket is created, so that there is no
+ * moment when others could.
+ */
+static int
+serve_bind(int fd, struct sockaddr_un *sun)
+{
+	mode_t		mask;
+	int			rc;
+
+	mask = umask(0177);
+	rc = bind(fd, (struct sockaddr *) sun, sizeof(*sun));
+	umask(mask);
+	if (rc == -1 || serve_gid == (gid_t) -1)
+		return rc;
+
+	if (chown(sun->sun_path, (uid_t) -1, serve_gid) == -1 ||
+		chmod(sun->sun_path, 0660) == -1)
+	{
+		rc = errno;
+		unlink(sun->sun_path);
+		errno = rc;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Listen on the socket at "path" for pg_systat to attach to, only for the
+ * user it runs as unless a group "gid" other than -1 is to share it.  A socket
+ * left behind by a daemon that is gone is replaced, one still answered is
+ * not.
+ */
+int
+serve_open(const char *path, gid_t gid)
+{
+	struct sockaddr_un sun;
+	struct stat st;
+	int			fd,
+				probe;
+
+	if (sock_addr(path, &sun) == -1)
+		return -1;
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		return -1;
+	serve_gid = gid;
+
+	if (serve_bind(fd, &sun) == -1)
+	{
+		if (errno != EADDRINUSE || lstat(path, &st) == -1 ||
+			!S_ISSOCK(st.st_mode))
+			goto fail;
+		if ((probe = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+			goto fail;
+		if (connect(probe, (struct sockaddr *) &sun, sizeof(sun)) == 0)
+		{
+			close(probe);
+			errno = EADDRINUSE;
+			goto fail;
+		}
+		close(probe);
+		if (unlink(path) == -1 || serve_bind(fd, &sun) == -1)
+			goto fail;
+	}
+	if (listen(fd, 16) == -1 || fcntl(fd, F_SETFL, O_NONBLOCK) == -1)
+	{
+		unlink(path);
+		goto fail;
+	}
+
+	listen_fd = fd;
+	serve_allow(SERVE_HELLO);
+
+	/* for good, as the views select one another to initialize */
+	options.persistent = 1;
+
+	/* a viewer going away must not kill us */
+	signal(SIGPIPE, SIG_IGN);
+	return 0;
+
+fail:
+	probe = errno;
+	close(fd);
+	errno = probe;
+	return -1;
+}
+
+static void
+serve_accept(void)
+{
+	int			fd;
+
+	while ((fd = accept(listen_fd, NULL, NULL)) != -1)
+	{
+		if (nclients == SERVE_MAX_CLIENTS || !serve_peer(fd) ||
+			fcntl(fd, F_SETFL, O_NONBLOCK) == -1)
+		{
+			close(fd);
+			continue;
+		}
+		memset(&clients[nclients], 0, sizeof(struct serve_client));
+		clients[nclients++].fd = fd;
+	}
+}
+
+/*
+ * Answer the viewers until told to quit.  The queries run one at a time, so
+ * a viewer whose query is not answered from the last result waits for those
+ * of the others to run first.
+ */
+void
+serve_loop(void)
+{
+	struct pollfd pfds[1 + SERVE_MAX_CLIENTS];
+	struct serve_client *c;
+	int64_t		now;
+	int			i,
+				n,
+				rc;
+
+	while (!gotsig_close)
+	{
+		if (gotsig_dump)
+		{
+			gotsig_dump = 0;
+			recorder_dump();
+		}
+		recorder_poll();
+		serve_expire();
+
+		/* a viewer stuck in the middle of a request only holds its slot */
+		now = monotonic_usec();
+		for (i = nclients - 1; i >= 0; i--)
+			if (clients[i].since != 0 && now - clients[i].since > SERVE_STALL)
+				serve_drop(i);
+
+		pfds[0].fd = listen_fd;
+		pfds[0].events = POLLIN;
+		for (i = 0; i < nclients; i++)
+		{
+			pfds[i + 1].fd = clients[i].fd;
+			pfds[i + 1].events = clients[i].out != NULL ? POLLOUT : POLLIN;
+		}
+		n = nclients;
+		if (poll(pfds, n + 1, 1000) <= 0)
+			continue;
+
+		/* serve the viewers polled, dropping those gone, before new ones */
+		for (i = n - 1; i >= 0; i--)
+		{
+			c = &clients[i];
+			if (pfds[i + 1].revents == 0)
+				continue;
+			if (c->out != NULL)
+				rc = serve_write(c);
+			else if ((rc = serve_read(c)) == 0 && c->out != NULL)
+				rc = serve_write(c);
+			if (rc == -1)
+				serve_drop(i);
+		}
+		if (pfds[0].revents & POLLIN)
+			serve_accept();
+	}
+
+	for (i = nclients - 1; i >= 0; i--)
+		serve_drop(i);
+	close(listen_fd);
+	unlink(sock_path);
+}
+
+static int
+serve_connect(void)
+{
+	struct sockaddr_un sun;
+	struct timeval tv = {SERVE_TIMEOUT / 1000, 0};
+
+	if (sock_addr(sock_path, &sun) == -1)
+		return -1;
+	if ((serve_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		return -1;
+	if (connect(serve_fd, (struct sockaddr *) &sun, sizeof(sun)) == -1)
+	{
+		close(serve_fd);
+		serve_fd = -1;
+		return -1;
+	}
+	setsockopt(serve_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	return 0;
+}
+
+/*
+ * Have the views query the daemon listening at "path" rather than the server.
+ */
+int
+serve_attach(const char *path)
+{
+	if (strlcpy(sock_path, path, sizeof(sock_path)) >= sizeof(sock_path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if (serve_connect() == -1)
+		return -1;
+
+	attached = 1;
+	signal(SIGPIPE, SIG_IGN);
+
+	/* learn the version of the server, which views choose queries by */
+	PQclear(serve_exec(SERVE_HELLO));
+	return 0;
+}
+
+const char *
+serve_path(void)
+{
+	return sock_path;
+}
+
+int
+serve_server_version(void)
+{
+	return server_version;
+}
+
+/*
+ * When the result last returned by serve_exec() was taken by the daemon.
+ */
+void
+serve_taken(struct timespec *ts)
+{
+	ts->tv_sec = taken / 1000000;
+	ts->tv_nsec = (taken % 1000000) * 1000;
+}
+
+static PGresult *
+serve_fail(void)
+{
+	close(serve_fd);
+	serve_fd = -1;
+	return PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+}
+
+/*
+ * Answer a query with a result from the daemon no older than the interval the
+ * current view is read at, or with an error if the daemon cannot be reached.
+ * A daemon restarted is attached to again at the next query.
+ */
+PGresult *
+serve_exec(const char *query)
+{
+	struct serve_request req;
+	struct serve_response resp;
+	useconds_t	max_age;
+	PGresAttDesc *attrs = NULL;
+	PGresult   *res = NULL;
+	char	   *data = NULL,
+			   *p,
+			   *end,
+			   *nul;
+	int32_t		len;
+	uint32_t	r,
+				c;
+
+	if (serve_fd == -1 && serve_connect() == -1)
+		return PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+
+	max_age = sampling() ? usample :
+		curr_mgr != NULL ? view_interval(curr_mgr) : udelay;
+	req.len = strlen(query);
+	req.max_age = max_age / 1000;
+	req.filter_len = strlen(filter_get());
+	if (req.len > SERVE_MAX_QUERY || req.filter_len > SERVE_MAX_FILTER ||
+		write_all(serve_fd, &req, sizeof(req)) == -1 ||
+		write_all(serve_fd, query, req.len) == -1 ||
+		write_all(serve_fd, filter_get(), req.filter_len) == -1)
+		return serve_fail();
+
+	/* the daemon may have to wait for the server, up to its timeout */
+	if (read_all(serve_fd, &resp, sizeof(resp), statement_timeout > 0 ?
+				 statement_timeout + SERVE_TIMEOUT : -1) == -1 ||
+		resp.len > SERVE_MAX_RESPONSE)
+		return serve_fail();
+	if (resp.len > 0 && ((data = malloc(resp.len)) == NULL ||
+						 read_all(serve_fd, data, resp.len,
+								  SERVE_TIMEOUT) == -1))
+	{
+		free(data);
+		return serve_fail();
+	}
+
+	server_version = resp.server_version;
+	taken = resp.taken;
+	if (resp.status != 0)
+	{
+		free(data);
+		return PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+	}
+
+	res = PQmakeEmptyPGresult(NULL, PGRES_TUPLES_OK);
+	attrs = calloc(resp.ncols > 0 ? resp.ncols : 1, sizeof(PGresAttDesc));
+	if (res == NULL || attrs == NULL)
+		goto fail;
+
+	p = data;
+	end = data + resp.len;
+	for (c = 0; c < resp.ncols; c++)
+	{
+		if ((nul = memchr(p, '\0', end - p)) == NULL)
+			goto fail;
+		attrs[c].name = p;
+		attrs[c].typlen = -1;
+		attrs[c].atttypmod = -1;
+		p = nul + 1;
+	}
+	if (!PQsetResultAttrs(res, resp.ncols, attrs))
+		goto fail;
+
+	for (r = 0; r < resp.nrows; r++)
+		for (c = 0; c < resp.ncols; c++)
+		{
+			if ((size_t) (end - p) < sizeof(len))
+				goto fail;
+			memcpy(&len, p, sizeof(len));
+			p += sizeof(len);
+			if (len > end - p)
+				goto fail;
+			if (!PQsetvalue(res, r, c, len < 0 ? NULL : p, len < 0 ? -1 : len))
+				goto fail;
+			if (len > 0)
+				p += len;
+		}
+
+	free(attrs);
+	free(data);
+	return res;
+
+fail:
+	free(attrs);
+	free(data);
+	PQclear(res);
+	return PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2021 PostgreSQL Global Development Group
+ */
+
+#ifndef _SERVE_H_
+#define _SERVE_H_
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <time.h>
+#include <libpq-fe.h>
+
+#include "filter.h"
+
+/*
+ * One pg_systat run with --serve queries the server for any number of others
+ * attached to it with --attach, over a Unix-domain socket, so that the load
+ * on the server does not grow with the number of people watching it.
+ *
+ * An attached pg_systat sends every statistics query of its views to the
+ * daemon instead of the server, along with how old a result it accepts: the
+ * refresh interval of the view, or the sampling interval when sampling.  The
+ * daemon keeps the last result of every query and answers with it while it
+ * is recent enough, and queries the server only when it is not.  Viewers of
+ * the same view at the same interval thus share one query between them.
+ *
+ * The daemon only runs the queries of its own views, which they allow when
+ * they are initialized, as they are with the filters of the viewer asking.
+ * Only the user the daemon runs as, root and the members of the group given
+ * with --serve-group can attach to it.
+ *
+ * Both ends are on the same host and the protocol is in its byte order.  A
+ * request is a struct serve_request, the query text and the filters of the
+ * viewer, as given with -f.  The response is a struct serve_response and, if
+ * the query succeeded, the column names, each ending in a NUL, then every
+ * cell as an int32_t length, -1 for NULL, and its bytes.
+ */
+#define SERVE_MAX_QUERY		65536
+#define SERVE_MAX_FILTER	4096
+#define SERVE_MAX_RESPONSE	(1 << 30)
+
+struct serve_request
+{
+	uint32_t	len;			/* of the query text that follows */
+	uint32_t	max_age;		/* milliseconds */
+	uint32_t	filter_len;		/* of the filters that follow the query */
+};
+
+struct serve_response
+{
+	int32_t		status;			/* 0, or -1 if the query failed */
+	int32_t		server_version;
+	int64_t		taken;			/* CLOCK_MONOTONIC microseconds */
+	uint32_t	nrows;
+	uint32_t	ncols;
+	uint32_t	len;			/* of the names and cells that follow */
+};
+
+extern int	attached;
+
+int			serve_open(const char *, gid_t);
+void		serve_allow(const char *);
+void		serve_allow_filtered(const char *, enum filter_target,
+								 const char *);
+void		serve_loop(void);
+
+int			serve_attach(const char *);
+const char *serve_path(void);
+int			serve_server_version(void);
+void		serve_taken(struct timespec *);
+PGresult   *serve_exec(const char *);
+
+#endif							/* _SERVE_H_ */
@@ -11,30 +11,50 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "history.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
-#define QUERY_STAT_EXEC_13 \
-		"SELECT queryid, calls, total_exec_time, min_exec_time, max_exec_time,\n" \
-		"       mean_exec_time, stddev_exec_time\n" \
+#define QUERY_STAT_EXEC_13(key, epoch) \
+		"SELECT " key ", queryid, calls, total_exec_time,\n" \
+		"       min_exec_time, max_exec_time, mean_exec_time,\n" \
+		"       stddev_exec_time, " epoch "\n" \
 		"FROM pg_stat_statements;"
 #define QUERY_STAT_EXEC_12 \
-		"SELECT queryid, calls, total_time, min_time, max_time,\n" \
-		"       mean_time, stddev_time\n" \
+		"SELECT " STMT_KEY ", queryid, calls, total_time, min_time,\n" \
+		"       max_time, mean_time, stddev_time,\n" \
+		"       " STATS_EPOCH_STATEMENTS "\n" \
 		"FROM pg_stat_statements;"
 
 struct stmtexec_t
 {
 	RB_ENTRY(stmtexec_t) entry;
+	row_order	order;
 
+	char		key[NAMEDATALEN + 1];
 	char		queryid[NAMEDATALEN + 1];
 	int64_t		calls;
+	int64_t		calls_old;
 	double		total_exec_time;
+	double		total_exec_time_old;
 	double		min_exec_time;
 	double		max_exec_time;
 	double		mean_exec_time;
 	double		stddev_exec_time;
 
+	/* over the interval since the previous refresh */
+	double		calls_rate;
+	double		exec_time_rate;
+	double		interval_mean_exec_time;
+	double		exec_time_share;
+
+	/* moving averages of execution milliseconds per second */
+	struct ewma	exec_time_avg;
+
+	/* recent execution microseconds per refresh, for the sparkline */
+	int			hist;
 };
 
 int			stmtexec_cmp(struct stmtexec_t *, struct stmtexec_t *);
@@ -50,6 +70,13 @@ int			sort_stmtexec_min_exec_time_callback(const void *, const void *);
 int			sort_stmtexec_max_exec_time_callback(const void *, const void *);
 int			sort_stmtexec_mean_exec_time_callback(const void *, const void *);
 int			sort_stmtexec_stddev_exec_time_callback(const void *, const void *);
+int			sort_stmtexec_calls_rate_callback(const void *, const void *);
+int			sort_stmtexec_exec_time_rate_callback(const void *, const void *);
+int			sort_stmtexec_interval_mean_callback(const void *, const void *);
+int			sort_stmtexec_exec_time_share_callback(const void *, const void *);
+int			sort_stmtexec_exec_time_1m_callback(const void *, const void *);
+int			sort_stmtexec_exec_time_5m_callback(const void *, const void *);
+int			sort_stmtexec_exec_time_15m_callback(const void *, const void *);
 
 RB_HEAD(stmtexec, stmtexec_t) head_stmtexecs =
 RB_INITIALIZER(&head_stmtexecs);
@@ -61,6 +88,18 @@ field_def fields_stmtexec[] =
 	{
 		"QUERYID", 8, NAMEDATALEN, 1, FLD_ALIGN_LEFT, -1, 0, 0, 0
 	},
+	{
+		"CALLS/s", 8, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"EXEC_MS/s", 10, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"INTERVAL_MEAN", 14, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"EXEC%", 6, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
 	{
 		"CALLS", 6, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
 	},
@@ -79,21 +118,43 @@ field_def fields_stmtexec[] =
 	{
 		"STDDEV_EXEC_TIME", 17, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
 	},
+	{
+		"EXEC_MS_1M", 11, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"EXEC_MS_5M", 11, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"EXEC_MS_15M", 12, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"TREND", HISTORY_LEN, HISTORY_LEN, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
 };
 
 #define FLD_STMT_QUERYID        FIELD_ADDR(fields_stmtexec, 0)
-#define FLD_STMT_CALLS          FIELD_ADDR(fields_stmtexec, 1)
-#define FLD_STMT_TOTAL_EXEC_TIME      FIELD_ADDR(fields_stmtexec, 2)
-#define FLD_STMT_MIN_EXEC_TIME  FIELD_ADDR(fields_stmtexec, 3)
-#define FLD_STMT_MAX_EXEC_TIME      FIELD_ADDR(fields_stmtexec, 4)
-#define FLD_STMT_MEAN_EXEC_TIME FIELD_ADDR(fields_stmtexec, 5)
-#define FLD_STMT_STDDEV_EXEC_TIME FIELD_ADDR(fields_stmtexec, 6)
+#define FLD_STMT_CALLS_RATE     FIELD_ADDR(fields_stmtexec, 1)
+#define FLD_STMT_EXEC_TIME_RATE FIELD_ADDR(fields_stmtexec, 2)
+#define FLD_STMT_INTERVAL_MEAN  FIELD_ADDR(fields_stmtexec, 3)
+#define FLD_STMT_EXEC_TIME_SHARE FIELD_ADDR(fields_stmtexec, 4)
+#define FLD_STMT_CALLS          FIELD_ADDR(fields_stmtexec, 5)
+#define FLD_STMT_TOTAL_EXEC_TIME      FIELD_ADDR(fields_stmtexec, 6)
+#define FLD_STMT_MIN_EXEC_TIME  FIELD_ADDR(fields_stmtexec, 7)
+#define FLD_STMT_MAX_EXEC_TIME      FIELD_ADDR(fields_stmtexec, 8)
+#define FLD_STMT_MEAN_EXEC_TIME FIELD_ADDR(fields_stmtexec, 9)
+#define FLD_STMT_STDDEV_EXEC_TIME FIELD_ADDR(fields_stmtexec, 10)
+#define FLD_STMT_EXEC_MS_1M           FIELD_ADDR(fields_stmtexec, 11)
+#define FLD_STMT_EXEC_MS_5M           FIELD_ADDR(fields_stmtexec, 12)
+#define FLD_STMT_EXEC_MS_15M          FIELD_ADDR(fields_stmtexec, 13)
+#define FLD_STMT_TREND                FIELD_ADDR(fields_stmtexec, 14)
 
 /* Define views */
 field_def  *view_stmtexec_0[] = {
-	FLD_STMT_QUERYID, FLD_STMT_CALLS, FLD_STMT_TOTAL_EXEC_TIME,
-	FLD_STMT_MIN_EXEC_TIME, FLD_STMT_MAX_EXEC_TIME, FLD_STMT_MEAN_EXEC_TIME,
-	FLD_STMT_STDDEV_EXEC_TIME, NULL
+	FLD_STMT_QUERYID, FLD_STMT_CALLS_RATE, FLD_STMT_EXEC_TIME_RATE,
+	FLD_STMT_TREND, FLD_STMT_INTERVAL_MEAN, FLD_STMT_EXEC_TIME_SHARE,
+	FLD_STMT_CALLS, FLD_STMT_TOTAL_EXEC_TIME, FLD_STMT_MIN_EXEC_TIME,
+	FLD_STMT_MAX_EXEC_TIME, FLD_STMT_MEAN_EXEC_TIME, FLD_STMT_STDDEV_EXEC_TIME,
+	FLD_STMT_EXEC_MS_1M, FLD_STMT_EXEC_MS_5M, FLD_STMT_EXEC_MS_15M, NULL
 };
 
 order_type	stmtexec_order_list[] = {
@@ -105,6 +166,16 @@ order_type	stmtexec_order_list[] = {
 	{"max_exec_time", "max_exec_time", 'm', sort_stmtexec_max_exec_time_callback},
 	{"mean_exec_time", "mean_exec_time", 'e', sort_stmtexec_mean_exec_time_callback},
 	{"stddev_exec_time", "stddev_exec_time", 'd', sort_stmtexec_stddev_exec_time_callback},
+	{"calls/s", "calls/s", 'R', sort_stmtexec_calls_rate_callback},
+	{"exec_time/s", "exec_time/s", 'M', sort_stmtexec_exec_time_rate_callback},
+	{"interval_mean", "interval_mean", 'E',
+	sort_stmtexec_interval_mean_callback},
+	{"exec_time_share", "exec_time_share", '%',
+	sort_stmtexec_exec_time_share_callback},
+	{"exec_time_1m", "exec_time_1m", '1', sort_stmtexec_exec_time_1m_callback},
+	{"exec_time_5m", "exec_time_5m", '5', sort_stmtexec_exec_time_5m_callback},
+	{"exec_time_15m", "exec_time_15m", 'F',
+	sort_stmtexec_exec_time_15m_callback},
 	{NULL, NULL, 0, NULL}
 };
 
@@ -112,7 +183,7 @@ order_type	stmtexec_order_list[] = {
 struct view_manager stmtexec_mgr = {
 	"stmtexec", select_stmtexec, read_stmtexec, sort_stmtexec,
 	print_header, print_stmtexec, keyboard_callback, stmtexec_order_list,
-	stmtexec_order_list
+	stmtexec_order_list, NULL, NULL, NULL, TIER_RELATION
 };
 
 field_view	views_stmtexec[] = {
@@ -123,20 +194,28 @@ field_view	views_stmtexec[] = {
 int			stmtexec_exist = 1;
 int			stmtexec_count;
 struct stmtexec_t *stmtexecs;
+struct snapshot_clock stmtexec_clock;
+struct stats_epoch stmtexec_epoch;
+struct history stmtexec_history = HISTORY_INITIALIZER;
 
 static void
 stmtexec_info(void)
 {
 	int			i;
+	int			reset = 0;
+	double		decay[EWMA_NAVG];
+	double		exec_time_total = 0;
+	int64_t		calls;
+	double		exec_time;
 	PGresult   *pgresult = NULL;
 
 	struct stmtexec_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_STMT_EXIST);
+		pgresult = pg_exec(QUERY_STAT_STMT_EXIST);
 		if (PQresultStatus(pgresult) != PGRES_TUPLES_OK || PQntuples(pgresult) == 0)
 		{
 			stmtexec_exist = 0;
@@ -144,19 +223,35 @@ stmtexec_info(void)
 			return;
 		}
 
-		if (PQserverVersion(options.connection) / 100 < 1300)
+		if (pg_server_version() / 100 < 1300)
 		{
-			pgresult = PQexec(options.connection, QUERY_STAT_EXEC_12);
+			pgresult = pg_exec(QUERY_STAT_EXEC_12);
+		}
+		else if (pg_server_version() / 100 < 1400)
+		{
+			pgresult = pg_exec(QUERY_STAT_EXEC_13(STMT_KEY,
+												 STATS_EPOCH_STATEMENTS));
 		}
 		else
 		{
-			pgresult = PQexec(options.connection, QUERY_STAT_EXEC_13);
+			pgresult = pg_exec(QUERY_STAT_EXEC_13(STMT_KEY_14,
+												 STATS_EPOCH_STATEMENTS_14));
 		}
 
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = stmtexec_count;
 			stmtexec_count = PQntuples(pgresult);
+			reset = stats_reset(&stmtexec_epoch, pgresult, 8);
+			snapshot_clock_tick(&stmtexec_clock);
+			ewma_decay(&stmtexec_clock, decay);
+			history_advance(&stmtexec_history);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -191,23 +286,55 @@ stmtexec_info(void)
 			disconnect_from_db();
 			return;
 		}
-		strncpy(n->queryid, PQgetvalue(pgresult, i, 0), NAMEDATALEN);
+		strncpy(n->key, PQgetvalue(pgresult, i, 0), NAMEDATALEN);
+		n->key[NAMEDATALEN] = '\0';
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(stmtexec, &head_stmtexecs, n);
-		if (p != NULL)
+		if (p == NULL)
+			n->hist = history_slot(&stmtexec_history);
+		else
 		{
 			free(n);
 			n = p;
 		}
-		n->calls = atoll(PQgetvalue(pgresult, i, 1));
-		n->total_exec_time = atof(PQgetvalue(pgresult, i, 2));
-		n->min_exec_time = atof(PQgetvalue(pgresult, i, 3));
-		n->max_exec_time = atof(PQgetvalue(pgresult, i, 4));
-		n->mean_exec_time = atof(PQgetvalue(pgresult, i, 5));
-		n->stddev_exec_time = atof(PQgetvalue(pgresult, i, 6));
+		strncpy(n->queryid, PQgetvalue(pgresult, i, 1), NAMEDATALEN);
+		n->queryid[NAMEDATALEN] = '\0';
+
+		n->calls_old = n->calls;
+		n->calls = atoll(PQgetvalue(pgresult, i, 2));
+		n->total_exec_time_old = n->total_exec_time;
+		n->total_exec_time = atof(PQgetvalue(pgresult, i, 3));
+		n->min_exec_time = atof(PQgetvalue(pgresult, i, 4));
+		n->max_exec_time = atof(PQgetvalue(pgresult, i, 5));
+		n->mean_exec_time = atof(PQgetvalue(pgresult, i, 6));
+		n->stddev_exec_time = atof(PQgetvalue(pgresult, i, 7));
+
+		calls = COUNTER_DELTA(n->calls, n->calls_old, p == NULL || reset);
+		exec_time = COUNTER_DELTA(n->total_exec_time, n->total_exec_time_old,
+								  p == NULL || reset);
+		n->calls_rate = snapshot_rate(&stmtexec_clock, calls);
+		n->exec_time_rate = stmtexec_clock.interval > 0 ?
+			exec_time / stmtexec_clock.interval : 0;
+		n->interval_mean_exec_time = calls > 0 ? exec_time / calls : 0;
+		n->exec_time_share = exec_time;
+		exec_time_total += exec_time;
+
+		if (p == NULL)
+			ewma_init(&n->exec_time_avg);
+		ewma_update(&n->exec_time_avg, n->exec_time_rate, decay,
+					p == NULL || reset);
+		history_put(&stmtexec_history, n->hist,
+					(int64_t) (exec_time * 1000));
 
 		memcpy(&stmtexecs[i], n, sizeof(struct stmtexec_t));
 	}
 
+	/* share of the time spent by all statements over the interval */
+	for (i = 0; i < stmtexec_count; i++)
+		stmtexecs[i].exec_time_share = exec_time_total > 0 ?
+			100.0 * stmtexecs[i].exec_time_share / exec_time_total : 0;
+
 	if (pgresult != NULL)
 		PQclear(pgresult);
 	disconnect_from_db();
@@ -216,7 +343,7 @@ stmtexec_info(void)
 int
 stmtexec_cmp(struct stmtexec_t *e1, struct stmtexec_t *e2)
 {
-	return (e1->queryid < e2->queryid ? -1 : e1->queryid > e2->queryid);
+	return strcmp(e1->key, e2->key);
 }
 
 int
@@ -241,6 +368,11 @@ initstmtexec(void)
 	stmtexecs = NULL;
 	stmtexec_count = 0;
 
+	serve_allow(QUERY_STAT_STMT_EXIST);
+	serve_allow(QUERY_STAT_EXEC_12);
+	serve_allow(QUERY_STAT_EXEC_13(STMT_KEY, STATS_EPOCH_STATEMENTS));
+	serve_allow(QUERY_STAT_EXEC_13(STMT_KEY_14, STATS_EPOCH_STATEMENTS_14));
+
 	read_stmtexec();
 	if (stmtexec_exist == 0)
 	{
@@ -259,6 +391,7 @@ print_stmtexec(void)
 	int			cur = 0,
 				i;
 	int			end = dispstart + maxprint;
+	unsigned char levels[HISTORY_LEN];
 
 	if (end > num_disp)
 		end = num_disp;
@@ -270,6 +403,16 @@ print_stmtexec(void)
 			if (cur >= dispstart && cur < end)
 			{
 				print_fld_str(FLD_STMT_QUERYID, stmtexecs[i].queryid);
+				print_fld_rate(FLD_STMT_CALLS_RATE, stmtexecs[i].calls_rate);
+				print_fld_float(FLD_STMT_EXEC_TIME_RATE,
+								stmtexecs[i].exec_time_rate, 2);
+				print_fld_spark(FLD_STMT_TREND, levels,
+								history_levels(&stmtexec_history,
+											   stmtexecs[i].hist, levels));
+				print_fld_float(FLD_STMT_INTERVAL_MEAN,
+								stmtexecs[i].interval_mean_exec_time, 2);
+				print_fld_float(FLD_STMT_EXEC_TIME_SHARE,
+								stmtexecs[i].exec_time_share, 1);
 				print_fld_uint(FLD_STMT_CALLS, stmtexecs[i].calls);
 				print_fld_float(FLD_STMT_TOTAL_EXEC_TIME,
 								stmtexecs[i].total_exec_time, 2);
@@ -281,6 +424,12 @@ print_stmtexec(void)
 								stmtexecs[i].mean_exec_time, 2);
 				print_fld_float(FLD_STMT_STDDEV_EXEC_TIME,
 								stmtexecs[i].stddev_exec_time, 2);
+				print_fld_float(FLD_STMT_EXEC_MS_1M,
+								stmtexecs[i].exec_time_avg.avg[EWMA_1M], 2);
+				print_fld_float(FLD_STMT_EXEC_MS_5M,
+								stmtexecs[i].exec_time_avg.avg[EWMA_5M], 2);
+				print_fld_float(FLD_STMT_EXEC_MS_15M,
+								stmtexecs[i].exec_time_avg.avg[EWMA_15M], 2);
 				end_line();
 			}
 			if (++cur >= end)
@@ -316,8 +465,8 @@ sort_stmtexec(void)
 	if (stmtexec_count <= 0)
 		return;
 
-	mergesort(stmtexecs, stmtexec_count, sizeof(struct stmtexec_t),
-			  ordering->func);
+	sort_rows(stmtexecs, stmtexec_count, sizeof(struct stmtexec_t),
+			  offsetof(struct stmtexec_t, order), ordering->func);
 }
 
 int
@@ -433,3 +582,106 @@ sort_stmtexec_stddev_exec_time_callback(const void *v1, const void *v2)
 
 	return sort_stmtexec_queryid_callback(v1, v2);
 }
+
+int
+sort_stmtexec_calls_rate_callback(const void *v1, const void *v2)
+{
+	struct stmtexec_t *n1,
+			   *n2;
+
+	n1 = (struct stmtexec_t *) v1;
+	n2 = (struct stmtexec_t *) v2;
+
+	if (n1->calls_rate < n2->calls_rate)
+		return sortdir;
+	if (n1->calls_rate > n2->calls_rate)
+		return -sortdir;
+
+	return sort_stmtexec_queryid_callback(v1, v2);
+}
+
+int
+sort_stmtexec_exec_time_rate_callback(const void *v1, const void *v2)
+{
+	struct stmtexec_t *n1,
+			   *n2;
+
+	n1 = (struct stmtexec_t *) v1;
+	n2 = (struct stmtexec_t *) v2;
+
+	if (n1->exec_time_rate < n2->exec_time_rate)
+		return sortdir;
+	if (n1->exec_time_rate > n2->exec_time_rate)
+		return -sortdir;
+
+	return sort_stmtexec_queryid_callback(v1, v2);
+}
+
+int
+sort_stmtexec_interval_mean_callback(const void *v1, const void *v2)
+{
+	struct stmtexec_t *n1,
+			   *n2;
+
+	n1 = (struct stmtexec_t *) v1;
+	n2 = (struct stmtexec_t *) v2;
+
+	if (n1->interval_mean_exec_time < n2->interval_mean_exec_time)
+		return sortdir;
+	if (n1->interval_mean_exec_time > n2->interval_mean_exec_time)
+		return -sortdir;
+
+	return sort_stmtexec_queryid_callback(v1, v2);
+}
+
+int
+sort_stmtexec_exec_time_share_callback(const void *v1, const void *v2)
+{
+	struct stmtexec_t *n1,
+			   *n2;
+
+	n1 = (struct stmtexec_t *) v1;
+	n2 = (struct stmtexec_t *) v2;
+
+	if (n1->exec_time_share < n2->exec_time_share)
+		return sortdir;
+	if (n1->exec_time_share > n2->exec_time_share)
+		return -sortdir;
+
+	return sort_stmtexec_queryid_callback(v1, v2);
+}
+
+static int
+sort_stmtexec_exec_time(const void *v1, const void *v2, int avg)
+{
+	struct stmtexec_t *n1,
+			   *n2;
+
+	n1 = (struct stmtexec_t *) v1;
+	n2 = (struct stmtexec_t *) v2;
+
+	if (n1->exec_time_avg.avg[avg] < n2->exec_time_avg.avg[avg])
+		return sortdir;
+	if (n1->exec_time_avg.avg[avg] > n2->exec_time_avg.avg[avg])
+		return -sortdir;
+
+	return sort_stmtexec_queryid_callback(v1, v2);
+}
+
+int
+sort_stmtexec_exec_time_1m_callback(const void *v1, const void *v2)
+{
+	return sort_stmtexec_exec_time(v1, v2, EWMA_1M);
+}
+
+int
+sort_stmtexec_exec_time_5m_callback(const void *v1, const void *v2)
+{
+	return sort_stmtexec_exec_time(v1, v2, EWMA_5M);
+}
+
+int
+sort_stmtexec_exec_time_15m_callback(const void *v1, const void *v2)
+{
+	return sort_stmtexec_exec_time(v1, v2, EWMA_15M);
+}
@@ -13,6 +13,7 @@
 
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_LOCAL_BLK \
 		"SELECT queryid, rows, local_blks_hit, local_blks_read, local_blks_dirtied,\n" \
@@ -22,6 +23,7 @@
 struct stmtlocalblk_t
 {
 	RB_ENTRY(stmtlocalblk_t) entry;
+	row_order	order;
 
 	char		queryid[NAMEDATALEN + 1];
 	int64_t		rows;
@@ -100,7 +102,7 @@ order_type	stmtlocalblk_order_list[] = {
 struct view_manager stmtlocalblk_mgr = {
 	"stmtlocalblk", select_stmtlocalblk, read_stmtlocalblk, sort_stmtlocalblk,
 	print_header, print_stmtlocalblk, keyboard_callback, stmtlocalblk_order_list,
-	stmtlocalblk_order_list
+	stmtlocalblk_order_list, NULL, NULL, NULL, TIER_RELATION
 };
 
 field_view	views_stmtlocalblk[] = {
@@ -122,9 +124,9 @@ stmtlocalblk_info(void)
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_STMT_EXIST);
+		pgresult = pg_exec(QUERY_STAT_STMT_EXIST);
 		if (PQresultStatus(pgresult) != PGRES_TUPLES_OK || PQntuples(pgresult) == 0)
 		{
 			stmtlocalblk_exist = 0;
@@ -132,12 +134,18 @@ stmtlocalblk_info(void)
 			return;
 		}
 
-		pgresult = PQexec(options.connection, QUERY_STAT_LOCAL_BLK);
+		pgresult = pg_exec(QUERY_STAT_LOCAL_BLK);
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = stmtlocalblk_count;
 			stmtlocalblk_count = PQntuples(pgresult);
 		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
+		}
 	}
 	else
 	{
@@ -172,6 +180,8 @@ stmtlocalblk_info(void)
 			return;
 		}
 		strncpy(n->queryid, PQgetvalue(pgresult, i, 0), NAMEDATALEN);
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(stmtlocalblk, &head_stmtlocalblks, n);
 		if (p != NULL)
 		{
@@ -220,6 +230,9 @@ initstmtlocalblk(void)
 	stmtlocalblks = NULL;
 	stmtlocalblk_count = 0;
 
+	serve_allow(QUERY_STAT_STMT_EXIST);
+	serve_allow(QUERY_STAT_LOCAL_BLK);
+
 	read_stmtlocalblk();
 	if (stmtlocalblk_exist == 0)
 	{
@@ -293,8 +306,8 @@ sort_stmtlocalblk(void)
 	if (stmtlocalblk_count <= 0)
 		return;
 
-	mergesort(stmtlocalblks, stmtlocalblk_count, sizeof(struct stmtlocalblk_t),
-			  ordering->func);
+	sort_rows(stmtlocalblks, stmtlocalblk_count, sizeof(struct stmtlocalblk_t),
+			  offsetof(struct stmtlocalblk_t, order), ordering->func);
 }
 
 int
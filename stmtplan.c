@@ -11,26 +11,45 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "history.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
-#define QUERY_STAT_PLAN \
-		"SELECT queryid, plans, total_plan_time, min_plan_time, max_plan_time,\n" \
-		"       mean_plan_time, stddev_plan_time\n" \
+#define QUERY_STAT_PLAN(key, epoch) \
+		"SELECT " key ", queryid, plans, total_plan_time,\n" \
+		"       min_plan_time, max_plan_time, mean_plan_time,\n" \
+		"       stddev_plan_time, " epoch "\n" \
 		"FROM pg_stat_statements;"
 
 struct stmtplan_t
 {
 	RB_ENTRY(stmtplan_t) entry;
+	row_order	order;
 
+	char		key[NAMEDATALEN + 1];
 	char		queryid[NAMEDATALEN + 1];
 	int64_t		plans;
+	int64_t		plans_old;
 	double		total_plan_time;
+	double		total_plan_time_old;
 	double		min_plan_time;
 	double		max_plan_time;
 	double		mean_plan_time;
 	double		stddev_plan_time;
 
+	/* over the interval since the previous refresh */
+	double		plans_rate;
+	double		plan_time_rate;
+	double		interval_mean_plan_time;
+	double		plan_time_share;
+
+	/* moving averages of planning milliseconds per second */
+	struct ewma	plan_time_avg;
+
+	/* recent planning microseconds per refresh, for the sparkline */
+	int			hist;
 };
 
 int			stmtplan_cmp(struct stmtplan_t *, struct stmtplan_t *);
@@ -46,6 +65,13 @@ int			sort_stmtplan_min_plan_time_callback(const void *, const void *);
 int			sort_stmtplan_max_plan_time_callback(const void *, const void *);
 int			sort_stmtplan_mean_plan_time_callback(const void *, const void *);
 int			sort_stmtplan_stddev_plan_time_callback(const void *, const void *);
+int			sort_stmtplan_plans_rate_callback(const void *, const void *);
+int			sort_stmtplan_plan_time_rate_callback(const void *, const void *);
+int			sort_stmtplan_interval_mean_callback(const void *, const void *);
+int			sort_stmtplan_plan_time_share_callback(const void *, const void *);
+int			sort_stmtplan_plan_time_1m_callback(const void *, const void *);
+int			sort_stmtplan_plan_time_5m_callback(const void *, const void *);
+int			sort_stmtplan_plan_time_15m_callback(const void *, const void *);
 
 RB_HEAD(stmtplan, stmtplan_t) head_stmtplans =
 RB_INITIALIZER(&head_stmtplans);
@@ -57,6 +83,18 @@ field_def fields_stmtplan[] =
 	{
 		"QUERYID", 8, NAMEDATALEN, 1, FLD_ALIGN_LEFT, -1, 0, 0, 0
 	},
+	{
+		"PLANS/s", 8, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"PLAN_MS/s", 10, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"INTERVAL_MEAN", 14, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
+	{
+		"PLAN%", 6, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
 	{
 		"PLANS", 6, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
 	},
@@ -75,21 +113,43 @@ field_def fields_stmtplan[] =
 	{
 		"STDDEV_PLAN_TIME", 17, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
 	},
+	{
+		"PLAN_MS_1M", 11, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"PLAN_MS_5M", 11, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"PLAN_MS_15M", 12, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"TREND", HISTORY_LEN, HISTORY_LEN, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
 };
 
 #define FLD_STMT_QUERYID        FIELD_ADDR(fields_stmtplan, 0)
-#define FLD_STMT_PLANS          FIELD_ADDR(fields_stmtplan, 1)
-#define FLD_STMT_TOTAL_PLAN_TIME      FIELD_ADDR(fields_stmtplan, 2)
-#define FLD_STMT_MIN_PLAN_TIME  FIELD_ADDR(fields_stmtplan, 3)
-#define FLD_STMT_MAX_PLAN_TIME      FIELD_ADDR(fields_stmtplan, 4)
-#define FLD_STMT_MEAN_PLAN_TIME FIELD_ADDR(fields_stmtplan, 5)
-#define FLD_STMT_STDDEV_PLAN_TIME FIELD_ADDR(fields_stmtplan, 6)
+#define FLD_STMT_PLANS_RATE     FIELD_ADDR(fields_stmtplan, 1)
+#define FLD_STMT_PLAN_TIME_RATE FIELD_ADDR(fields_stmtplan, 2)
+#define FLD_STMT_INTERVAL_MEAN  FIELD_ADDR(fields_stmtplan, 3)
+#define FLD_STMT_PLAN_TIME_SHARE FIELD_ADDR(fields_stmtplan, 4)
+#define FLD_STMT_PLANS          FIELD_ADDR(fields_stmtplan, 5)
+#define FLD_STMT_TOTAL_PLAN_TIME      FIELD_ADDR(fields_stmtplan, 6)
+#define FLD_STMT_MIN_PLAN_TIME  FIELD_ADDR(fields_stmtplan, 7)
+#define FLD_STMT_MAX_PLAN_TIME      FIELD_ADDR(fields_stmtplan, 8)
+#define FLD_STMT_MEAN_PLAN_TIME FIELD_ADDR(fields_stmtplan, 9)
+#define FLD_STMT_STDDEV_PLAN_TIME FIELD_ADDR(fields_stmtplan, 10)
+#define FLD_STMT_PLAN_MS_1M           FIELD_ADDR(fields_stmtplan, 11)
+#define FLD_STMT_PLAN_MS_5M           FIELD_ADDR(fields_stmtplan, 12)
+#define FLD_STMT_PLAN_MS_15M          FIELD_ADDR(fields_stmtplan, 13)
+#define FLD_STMT_TREND                FIELD_ADDR(fields_stmtplan, 14)
 
 /* Define views */
 field_def  *view_stmtplan_0[] = {
-	FLD_STMT_QUERYID, FLD_STMT_PLANS, FLD_STMT_TOTAL_PLAN_TIME,
-	FLD_STMT_MIN_PLAN_TIME, FLD_STMT_MAX_PLAN_TIME, FLD_STMT_MEAN_PLAN_TIME,
-	FLD_STMT_STDDEV_PLAN_TIME, NULL
+	FLD_STMT_QUERYID, FLD_STMT_PLANS_RATE, FLD_STMT_PLAN_TIME_RATE,
+	FLD_STMT_TREND, FLD_STMT_INTERVAL_MEAN, FLD_STMT_PLAN_TIME_SHARE,
+	FLD_STMT_PLANS, FLD_STMT_TOTAL_PLAN_TIME, FLD_STMT_MIN_PLAN_TIME,
+	FLD_STMT_MAX_PLAN_TIME, FLD_STMT_MEAN_PLAN_TIME, FLD_STMT_STDDEV_PLAN_TIME,
+	FLD_STMT_PLAN_MS_1M, FLD_STMT_PLAN_MS_5M, FLD_STMT_PLAN_MS_15M, NULL
 };
 
 order_type	stmtplan_order_list[] = {
@@ -101,6 +161,16 @@ order_type	stmtplan_order_list[] = {
 	{"max_plan_time", "max_plan_time", 'm', sort_stmtplan_max_plan_time_callback},
 	{"mean_plan_time", "mean_plan_time", 'e', sort_stmtplan_mean_plan_time_callback},
 	{"stddev_plan_time", "stddev_plan_time", 'd', sort_stmtplan_stddev_plan_time_callback},
+	{"plans/s", "plans/s", 'L', sort_stmtplan_plans_rate_callback},
+	{"plan_time/s", "plan_time/s", 'M', sort_stmtplan_plan_time_rate_callback},
+	{"interval_mean", "interval_mean", 'E',
+	sort_stmtplan_interval_mean_callback},
+	{"plan_time_share", "plan_time_share", '%',
+	sort_stmtplan_plan_time_share_callback},
+	{"plan_time_1m", "plan_time_1m", '1', sort_stmtplan_plan_time_1m_callback},
+	{"plan_time_5m", "plan_time_5m", '5', sort_stmtplan_plan_time_5m_callback},
+	{"plan_time_15m", "plan_time_15m", 'F',
+	sort_stmtplan_plan_time_15m_callback},
 	{NULL, NULL, 0, NULL}
 };
 
@@ -108,7 +178,7 @@ order_type	stmtplan_order_list[] = {
 struct view_manager stmtplan_mgr = {
 	"stmtplan", select_stmtplan, read_stmtplan, sort_stmtplan,
 	print_header, print_stmtplan, keyboard_callback, stmtplan_order_list,
-	stmtplan_order_list
+	stmtplan_order_list, NULL, NULL, NULL, TIER_RELATION
 };
 
 field_view	views_stmtplan[] = {
@@ -119,20 +189,28 @@ field_view	views_stmtplan[] = {
 int			stmtplan_exist = 1;
 int			stmtplan_count;
 struct stmtplan_t *stmtplans;
+struct snapshot_clock stmtplan_clock;
+struct stats_epoch stmtplan_epoch;
+struct history stmtplan_history = HISTORY_INITIALIZER;
 
 static void
 stmtplan_info(void)
 {
 	int			i;
+	int			reset = 0;
+	double		decay[EWMA_NAVG];
+	double		plan_time_total = 0;
+	int64_t		plans;
+	double		plan_time;
 	PGresult   *pgresult = NULL;
 
 	struct stmtplan_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_STMT_EXIST);
+		pgresult = pg_exec(QUERY_STAT_STMT_EXIST);
 		if (PQresultStatus(pgresult) != PGRES_TUPLES_OK || PQntuples(pgresult) == 0)
 		{
 			stmtplan_exist = 0;
@@ -140,17 +218,32 @@ stmtplan_info(void)
 			return;
 		}
 
-		if (PQserverVersion(options.connection) / 100 < 1300)
+		if (pg_server_version() / 100 < 1300)
 		{
 			stmtplan_exist = 0;
 			return;
 		}
 
-		pgresult = PQexec(options.connection, QUERY_STAT_PLAN);
+		if (pg_server_version() / 100 < 1400)
+			pgresult = pg_exec(QUERY_STAT_PLAN(STMT_KEY,
+											  STATS_EPOCH_STATEMENTS));
+		else
+			pgresult = pg_exec(QUERY_STAT_PLAN(STMT_KEY_14,
+											  STATS_EPOCH_STATEMENTS_14));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = stmtplan_count;
 			stmtplan_count = PQntuples(pgresult);
+			reset = stats_reset(&stmtplan_epoch, pgresult, 8);
+			snapshot_clock_tick(&stmtplan_clock);
+			ewma_decay(&stmtplan_clock, decay);
+			history_advance(&stmtplan_history);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -185,23 +278,55 @@ stmtplan_info(void)
 			disconnect_from_db();
 			return;
 		}
-		strncpy(n->queryid, PQgetvalue(pgresult, i, 0), NAMEDATALEN);
+		strncpy(n->key, PQgetvalue(pgresult, i, 0), NAMEDATALEN);
+		n->key[NAMEDATALEN] = '\0';
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(stmtplan, &head_stmtplans, n);
-		if (p != NULL)
+		if (p == NULL)
+			n->hist = history_slot(&stmtplan_history);
+		else
 		{
 			free(n);
 			n = p;
 		}
-		n->plans = atoll(PQgetvalue(pgresult, i, 1));
-		n->total_plan_time = atof(PQgetvalue(pgresult, i, 2));
-		n->min_plan_time = atof(PQgetvalue(pgresult, i, 3));
-		n->max_plan_time = atof(PQgetvalue(pgresult, i, 4));
-		n->mean_plan_time = atof(PQgetvalue(pgresult, i, 5));
-		n->stddev_plan_time = atof(PQgetvalue(pgresult, i, 6));
+		strncpy(n->queryid, PQgetvalue(pgresult, i, 1), NAMEDATALEN);
+		n->queryid[NAMEDATALEN] = '\0';
+
+		n->plans_old = n->plans;
+		n->plans = atoll(PQgetvalue(pgresult, i, 2));
+		n->total_plan_time_old = n->total_plan_time;
+		n->total_plan_time = atof(PQgetvalue(pgresult, i, 3));
+		n->min_plan_time = atof(PQgetvalue(pgresult, i, 4));
+		n->max_plan_time = atof(PQgetvalue(pgresult, i, 5));
+		n->mean_plan_time = atof(PQgetvalue(pgresult, i, 6));
+		n->stddev_plan_time = atof(PQgetvalue(pgresult, i, 7));
+
+		plans = COUNTER_DELTA(n->plans, n->plans_old, p == NULL || reset);
+		plan_time = COUNTER_DELTA(n->total_plan_time, n->total_plan_time_old,
+								  p == NULL || reset);
+		n->plans_rate = snapshot_rate(&stmtplan_clock, plans);
+		n->plan_time_rate = stmtplan_clock.interval > 0 ?
+			plan_time / stmtplan_clock.interval : 0;
+		n->interval_mean_plan_time = plans > 0 ? plan_time / plans : 0;
+		n->plan_time_share = plan_time;
+		plan_time_total += plan_time;
+
+		if (p == NULL)
+			ewma_init(&n->plan_time_avg);
+		ewma_update(&n->plan_time_avg, n->plan_time_rate, decay,
+					p == NULL || reset);
+		history_put(&stmtplan_history, n->hist,
+					(int64_t) (plan_time * 1000));
 
 		memcpy(&stmtplans[i], n, sizeof(struct stmtplan_t));
 	}
 
+	/* share of the time spent by all statements over the interval */
+	for (i = 0; i < stmtplan_count; i++)
+		stmtplans[i].plan_time_share = plan_time_total > 0 ?
+			100.0 * stmtplans[i].plan_time_share / plan_time_total : 0;
+
 	if (pgresult != NULL)
 		PQclear(pgresult);
 	disconnect_from_db();
@@ -210,7 +335,7 @@ stmtplan_info(void)
 int
 stmtplan_cmp(struct stmtplan_t *e1, struct stmtplan_t *e2)
 {
-	return (e1->queryid < e2->queryid ? -1 : e1->queryid > e2->queryid);
+	return strcmp(e1->key, e2->key);
 }
 
 int
@@ -240,6 +365,10 @@ initstmtplan(void)
 	stmtplans = NULL;
 	stmtplan_count = 0;
 
+	serve_allow(QUERY_STAT_STMT_EXIST);
+	serve_allow(QUERY_STAT_PLAN(STMT_KEY, STATS_EPOCH_STATEMENTS));
+	serve_allow(QUERY_STAT_PLAN(STMT_KEY_14, STATS_EPOCH_STATEMENTS_14));
+
 	read_stmtplan();
 	if (stmtplan_exist == 0)
 	{
@@ -258,6 +387,7 @@ print_stmtplan(void)
 	int			cur = 0,
 				i;
 	int			end = dispstart + maxprint;
+	unsigned char levels[HISTORY_LEN];
 
 	if (end > num_disp)
 		end = num_disp;
@@ -269,6 +399,16 @@ print_stmtplan(void)
 			if (cur >= dispstart && cur < end)
 			{
 				print_fld_str(FLD_STMT_QUERYID, stmtplans[i].queryid);
+				print_fld_rate(FLD_STMT_PLANS_RATE, stmtplans[i].plans_rate);
+				print_fld_float(FLD_STMT_PLAN_TIME_RATE,
+								stmtplans[i].plan_time_rate, 2);
+				print_fld_spark(FLD_STMT_TREND, levels,
+								history_levels(&stmtplan_history,
+											   stmtplans[i].hist, levels));
+				print_fld_float(FLD_STMT_INTERVAL_MEAN,
+								stmtplans[i].interval_mean_plan_time, 2);
+				print_fld_float(FLD_STMT_PLAN_TIME_SHARE,
+								stmtplans[i].plan_time_share, 1);
 				print_fld_uint(FLD_STMT_PLANS, stmtplans[i].plans);
 				print_fld_float(FLD_STMT_TOTAL_PLAN_TIME,
 								stmtplans[i].total_plan_time, 2);
@@ -280,6 +420,12 @@ print_stmtplan(void)
 								stmtplans[i].mean_plan_time, 2);
 				print_fld_float(FLD_STMT_STDDEV_PLAN_TIME,
 								stmtplans[i].stddev_plan_time, 2);
+				print_fld_float(FLD_STMT_PLAN_MS_1M,
+								stmtplans[i].plan_time_avg.avg[EWMA_1M], 2);
+				print_fld_float(FLD_STMT_PLAN_MS_5M,
+								stmtplans[i].plan_time_avg.avg[EWMA_5M], 2);
+				print_fld_float(FLD_STMT_PLAN_MS_15M,
+								stmtplans[i].plan_time_avg.avg[EWMA_15M], 2);
 				end_line();
 			}
 			if (++cur >= end)
@@ -315,8 +461,8 @@ sort_stmtplan(void)
 	if (stmtplan_count <= 0)
 		return;
 
-	mergesort(stmtplans, stmtplan_count, sizeof(struct stmtplan_t),
-			  ordering->func);
+	sort_rows(stmtplans, stmtplan_count, sizeof(struct stmtplan_t),
+			  offsetof(struct stmtplan_t, order), ordering->func);
 }
 
 int
@@ -432,3 +578,106 @@ sort_stmtplan_stddev_plan_time_callback(const void *v1, const void *v2)
 
 	return sort_stmtplan_queryid_callback(v1, v2);
 }
+
+int
+sort_stmtplan_plans_rate_callback(const void *v1, const void *v2)
+{
+	struct stmtplan_t *n1,
+			   *n2;
+
+	n1 = (struct stmtplan_t *) v1;
+	n2 = (struct stmtplan_t *) v2;
+
+	if (n1->plans_rate < n2->plans_rate)
+		return sortdir;
+	if (n1->plans_rate > n2->plans_rate)
+		return -sortdir;
+
+	return sort_stmtplan_queryid_callback(v1, v2);
+}
+
+int
+sort_stmtplan_plan_time_rate_callback(const void *v1, const void *v2)
+{
+	struct stmtplan_t *n1,
+			   *n2;
+
+	n1 = (struct stmtplan_t *) v1;
+	n2 = (struct stmtplan_t *) v2;
+
+	if (n1->plan_time_rate < n2->plan_time_rate)
+		return sortdir;
+	if (n1->plan_time_rate > n2->plan_time_rate)
+		return -sortdir;
+
+	return sort_stmtplan_queryid_callback(v1, v2);
+}
+
+int
+sort_stmtplan_interval_mean_callback(const void *v1, const void *v2)
+{
+	struct stmtplan_t *n1,
+			   *n2;
+
+	n1 = (struct stmtplan_t *) v1;
+	n2 = (struct stmtplan_t *) v2;
+
+	if (n1->interval_mean_plan_time < n2->interval_mean_plan_time)
+		return sortdir;
+	if (n1->interval_mean_plan_time > n2->interval_mean_plan_time)
+		return -sortdir;
+
+	return sort_stmtplan_queryid_callback(v1, v2);
+}
+
+int
+sort_stmtplan_plan_time_share_callback(const void *v1, const void *v2)
+{
+	struct stmtplan_t *n1,
+			   *n2;
+
+	n1 = (struct stmtplan_t *) v1;
+	n2 = (struct stmtplan_t *) v2;
+
+	if (n1->plan_time_share < n2->plan_time_share)
+		return sortdir;
+	if (n1->plan_time_share > n2->plan_time_share)
+		return -sortdir;
+
+	return sort_stmtplan_queryid_callback(v1, v2);
+}
+
+static int
+sort_stmtplan_plan_time(const void *v1, const void *v2, int avg)
+{
+	struct stmtplan_t *n1,
+			   *n2;
+
+	n1 = (struct stmtplan_t *) v1;
+	n2 = (struct stmtplan_t *) v2;
+
+	if (n1->plan_time_avg.avg[avg] < n2->plan_time_avg.avg[avg])
+		return sortdir;
+	if (n1->plan_time_avg.avg[avg] > n2->plan_time_avg.avg[avg])
+		return -sortdir;
+
+	return sort_stmtplan_queryid_callback(v1, v2);
+}
+
+int
+sort_stmtplan_plan_time_1m_callback(const void *v1, const void *v2)
+{
+	return sort_stmtplan_plan_time(v1, v2, EWMA_1M);
+}
+
+int
+sort_stmtplan_plan_time_5m_callback(const void *v1, const void *v2)
+{
+	return sort_stmtplan_plan_time(v1, v2, EWMA_5M);
+}
+
+int
+sort_stmtplan_plan_time_15m_callback(const void *v1, const void *v2)
+{
+	return sort_stmtplan_plan_time(v1, v2, EWMA_15M);
+}
@@ -13,6 +13,7 @@
 
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_SHARED_BLK \
 		"SELECT queryid, rows, shared_blks_hit, shared_blks_read, shared_blks_dirtied,\n" \
@@ -22,6 +23,7 @@
 struct stmtsharedblk_t
 {
 	RB_ENTRY(stmtsharedblk_t) entry;
+	row_order	order;
 
 	char		queryid[NAMEDATALEN + 1];
 	int64_t		rows;
@@ -100,7 +102,7 @@ order_type	stmtsharedblk_order_list[] = {
 struct view_manager stmtsharedblk_mgr = {
 	"stmtsharedblk", select_stmtsharedblk, read_stmtsharedblk, sort_stmtsharedblk,
 	print_header, print_stmtsharedblk, keyboard_callback, stmtsharedblk_order_list,
-	stmtsharedblk_order_list
+	stmtsharedblk_order_list, NULL, NULL, NULL, TIER_RELATION
 };
 
 field_view	views_stmtsharedblk[] = {
@@ -122,9 +124,9 @@ stmtsharedblk_info(void)
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_STMT_EXIST);
+		pgresult = pg_exec(QUERY_STAT_STMT_EXIST);
 		if (PQresultStatus(pgresult) != PGRES_TUPLES_OK || PQntuples(pgresult) == 0)
 		{
 			stmtsharedblk_exist = 0;
@@ -132,12 +134,18 @@ stmtsharedblk_info(void)
 			return;
 		}
 
-		pgresult = PQexec(options.connection, QUERY_STAT_SHARED_BLK);
+		pgresult = pg_exec(QUERY_STAT_SHARED_BLK);
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = stmtsharedblk_count;
 			stmtsharedblk_count = PQntuples(pgresult);
 		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
+		}
 	}
 	else
 	{
@@ -172,6 +180,8 @@ stmtsharedblk_info(void)
 			return;
 		}
 		strncpy(n->queryid, PQgetvalue(pgresult, i, 0), NAMEDATALEN);
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(stmtsharedblk, &head_stmtsharedblks, n);
 		if (p != NULL)
 		{
@@ -220,6 +230,9 @@ initstmtsharedblk(void)
 	stmtsharedblks = NULL;
 	stmtsharedblk_count = 0;
 
+	serve_allow(QUERY_STAT_STMT_EXIST);
+	serve_allow(QUERY_STAT_SHARED_BLK);
+
 	read_stmtsharedblk();
 	if (stmtsharedblk_exist == 0)
 	{
@@ -293,8 +306,9 @@ sort_stmtsharedblk(void)
 	if (stmtsharedblk_count <= 0)
 		return;
 
-	mergesort(stmtsharedblks, stmtsharedblk_count, sizeof(struct stmtsharedblk_t),
-			  ordering->func);
+	sort_rows(stmtsharedblks, stmtsharedblk_count,
+			  sizeof(struct stmtsharedblk_t),
+			  offsetof(struct stmtsharedblk_t, order), ordering->func);
 }
 
 int
@@ -13,6 +13,7 @@
 
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_TEMP_BLK \
 		"SELECT queryid, rows, temp_blks_read, temp_blks_written, blk_read_time,\n" \
@@ -22,6 +23,7 @@
 struct stmttempblk_t
 {
 	RB_ENTRY(stmttempblk_t) entry;
+	row_order	order;
 
 	char		queryid[NAMEDATALEN + 1];
 	int64_t		rows;
@@ -100,7 +102,7 @@ order_type	stmttempblk_order_list[] = {
 struct view_manager stmttempblk_mgr = {
 	"stmttempblk", select_stmttempblk, read_stmttempblk, sort_stmttempblk,
 	print_header, print_stmttempblk, keyboard_callback, stmttempblk_order_list,
-	stmttempblk_order_list
+	stmttempblk_order_list, NULL, NULL, NULL, TIER_RELATION
 };
 
 field_view	views_stmttempblk[] = {
@@ -122,9 +124,9 @@ stmttempblk_info(void)
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_STMT_EXIST);
+		pgresult = pg_exec(QUERY_STAT_STMT_EXIST);
 		if (PQresultStatus(pgresult) != PGRES_TUPLES_OK || PQntuples(pgresult) == 0)
 		{
 			stmttempblk_exist = 0;
@@ -132,12 +134,18 @@ stmttempblk_info(void)
 			return;
 		}
 
-		pgresult = PQexec(options.connection, QUERY_STAT_TEMP_BLK);
+		pgresult = pg_exec(QUERY_STAT_TEMP_BLK);
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = stmttempblk_count;
 			stmttempblk_count = PQntuples(pgresult);
 		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
+		}
 	}
 	else
 	{
@@ -172,6 +180,8 @@ stmttempblk_info(void)
 			return;
 		}
 		strncpy(n->queryid, PQgetvalue(pgresult, i, 0), NAMEDATALEN);
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(stmttempblk, &head_stmttempblks, n);
 		if (p != NULL)
 		{
@@ -220,6 +230,9 @@ initstmttempblk(void)
 	stmttempblks = NULL;
 	stmttempblk_count = 0;
 
+	serve_allow(QUERY_STAT_STMT_EXIST);
+	serve_allow(QUERY_STAT_TEMP_BLK);
+
 	read_stmttempblk();
 	if (stmttempblk_exist == 0)
 	{
@@ -293,8 +306,8 @@ sort_stmttempblk(void)
 	if (stmttempblk_count <= 0)
 		return;
 
-	mergesort(stmttempblks, stmttempblk_count, sizeof(struct stmttempblk_t),
-			  ordering->func);
+	sort_rows(stmttempblks, stmttempblk_count, sizeof(struct stmttempblk_t),
+			  offsetof(struct stmttempblk_t, order), ordering->func);
 }
 
 int
@@ -13,6 +13,7 @@
 
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_WAL \
 		"SELECT queryid, wal_records, wal_fpi, wal_bytes\n" \
@@ -21,6 +22,7 @@
 struct stmtwal_t
 {
 	RB_ENTRY(stmtwal_t) entry;
+	row_order	order;
 
 	char		queryid[NAMEDATALEN + 1];
 	int64_t		wal_records;
@@ -83,7 +85,7 @@ order_type	stmtwal_order_list[] = {
 struct view_manager stmtwal_mgr = {
 	"stmtwal", select_stmtwal, read_stmtwal, sort_stmtwal,
 	print_header, print_stmtwal, keyboard_callback, stmtwal_order_list,
-	stmtwal_order_list
+	stmtwal_order_list, NULL, NULL, NULL, TIER_RELATION
 };
 
 field_view	views_stmtwal[] = {
@@ -105,15 +107,15 @@ stmtwal_info(void)
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		if (PQserverVersion(options.connection) / 100 < 1300)
+		if (pg_server_version() / 100 < 1300)
 		{
 			stmtwal_exist = 0;
 			return;
 		}
 
-		pgresult = PQexec(options.connection, QUERY_STAT_STMT_EXIST);
+		pgresult = pg_exec(QUERY_STAT_STMT_EXIST);
 		if (PQresultStatus(pgresult) != PGRES_TUPLES_OK || PQntuples(pgresult) == 0)
 		{
 			stmtwal_exist = 0;
@@ -121,12 +123,18 @@ stmtwal_info(void)
 			return;
 		}
 
-		pgresult = PQexec(options.connection, QUERY_STAT_WAL);
+		pgresult = pg_exec(QUERY_STAT_WAL);
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = stmtwal_count;
 			stmtwal_count = PQntuples(pgresult);
 		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
+		}
 	}
 	else
 	{
@@ -161,6 +169,8 @@ stmtwal_info(void)
 			return;
 		}
 		strncpy(n->queryid, PQgetvalue(pgresult, i, 0), NAMEDATALEN);
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(stmtwal, &head_stmtwals, n);
 		if (p != NULL)
 		{
@@ -212,6 +222,9 @@ initstmtwal(void)
 	stmtwals = NULL;
 	stmtwal_count = 0;
 
+	serve_allow(QUERY_STAT_STMT_EXIST);
+	serve_allow(QUERY_STAT_WAL);
+
 	read_stmtwal();
 	if (stmtwal_exist == 0)
 	{
@@ -279,8 +292,8 @@ sort_stmtwal(void)
 	if (stmtwal_count <= 0)
 		return;
 
-	mergesort(stmtwals, stmtwal_count, sizeof(struct stmtwal_t),
-			  ordering->func);
+	sort_rows(stmtwals, stmtwal_count, sizeof(struct stmtwal_t),
+			  offsetof(struct stmtwal_t, order), ordering->func);
 }
 
 int
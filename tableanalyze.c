@@ -11,18 +11,21 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "filter.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_TABLES \
 		"SELECT relid, schemaname, relname, n_mod_since_analyze,\n" \
 		"       last_analyze, last_autoanalyze, analyze_count,\n" \
 		"       autoanalyze_count\n" \
-		"FROM pg_stat_all_tables;"
+		"FROM pg_stat_all_tables"
 
 struct tableanalyze_t
 {
 	RB_ENTRY(tableanalyze_t) entry;
+	row_order	order;
 
 	long long	relid;
 	char		schemaname[NAMEDATALEN + 1];
@@ -39,6 +42,7 @@ struct tableanalyze_t
 
 int			tableanalyzecmp(struct tableanalyze_t *, struct tableanalyze_t *);
 static void tableanalyze_info(void);
+const char *tableanalyze_name(int);
 void		print_tableanalyze(void);
 int			read_tableanalyze(void);
 int			select_tableanalyze(void);
@@ -112,7 +116,8 @@ order_type	tableanalyze_order_list[] = {
 struct view_manager tableanalyze_mgr = {
 	"tableanalyze", select_tableanalyze, read_tableanalyze, sort_tableanalyze,
 	print_header, print_tableanalyze, keyboard_callback,
-	tableanalyze_order_list, tableanalyze_order_list
+	tableanalyze_order_list, tableanalyze_order_list,
+	NULL, NULL, tableanalyze_name, TIER_RELATION
 };
 
 field_view	views_tableanalyze[] = {
@@ -133,14 +138,21 @@ tableanalyze_info(void)
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_TABLES);
+		pgresult = pg_exec(filter_query(QUERY_STAT_TABLES, FILTER_TABLES,
+										"relid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = tableanalyze_count;
 			tableanalyze_count = PQntuples(pgresult);
 		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
+		}
 	}
 	else
 	{
@@ -175,6 +187,8 @@ tableanalyze_info(void)
 			return;
 		}
 		n->relid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(tableanalyze, &head_tableanalyze, n);
 		if (p != NULL)
 		{
@@ -228,6 +242,8 @@ inittableanalyze(void)
 	tableanalyzes = NULL;
 	tableanalyze_count = 0;
 
+	serve_allow_filtered(QUERY_STAT_TABLES, FILTER_TABLES, "relid");
+
 	for (v = views_tableanalyze; v->name != NULL; v++)
 		add_view(v);
 
@@ -281,6 +297,14 @@ print_tableanalyze(void)
 	} while (0);
 }
 
+const char *
+tableanalyze_name(int i)
+{
+	if (i >= tableanalyze_count)
+		return NULL;
+	return tableanalyzes[i].relname;
+}
+
 void
 sort_tableanalyze(void)
 {
@@ -300,8 +324,8 @@ sort_tableanalyze(void)
 	if (tableanalyze_count <= 0)
 		return;
 
-	mergesort(tableanalyzes, tableanalyze_count, sizeof(struct tableanalyze_t),
-			  ordering->func);
+	sort_rows(tableanalyzes, tableanalyze_count, sizeof(struct tableanalyze_t),
+			  offsetof(struct tableanalyze_t, order), ordering->func);
 }
 
 int
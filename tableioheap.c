@@ -11,16 +11,21 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "filter.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STATIO_TABLES_HEAP \
-		"SELECT relid, schemaname, relname, heap_blks_read, heap_blks_hit\n" \
-		"FROM pg_statio_all_tables;"
+		"SELECT relid, schemaname, relname, heap_blks_read, heap_blks_hit,\n" \
+		"       " STATS_EPOCH_DATABASE "\n" \
+		"FROM pg_statio_all_tables"
 
 struct tableio_heap_t
 {
 	RB_ENTRY(tableio_heap_t) entry;
+	row_order	order;
 
 	long long	relid;
 	char		schemaname[NAMEDATALEN + 1];
@@ -37,6 +42,7 @@ struct tableio_heap_t
 
 int			tableio_heapcmp(struct tableio_heap_t *, struct tableio_heap_t *);
 static void tableio_heap_info(void);
+const char *tableio_heap_name(int);
 void		print_tableio_heap(void);
 int			read_tableio_heap(void);
 int			select_tableio_heap(void);
@@ -92,7 +98,8 @@ order_type	tableio_heap_order_list[] = {
 struct view_manager tableio_heap_mgr = {
 	"tableioheap", select_tableio_heap, read_tableio_heap, sort_tableio_heap,
 	print_header, print_tableio_heap, keyboard_callback,
-	tableio_heap_order_list, tableio_heap_order_list
+	tableio_heap_order_list, tableio_heap_order_list,
+	NULL, NULL, tableio_heap_name, TIER_RELATION
 };
 
 field_view	views_tableio_heap[] = {
@@ -102,24 +109,34 @@ field_view	views_tableio_heap[] = {
 
 int			tableio_heap_count;
 struct tableio_heap_t *tableio_heaps;
+struct stats_epoch tableio_heap_epoch;
 
 static void
 tableio_heap_info(void)
 {
 	int			i;
+	int			reset = 0;
 	PGresult   *pgresult = NULL;
 
 	struct tableio_heap_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STATIO_TABLES_HEAP);
+		pgresult = pg_exec(filter_query(QUERY_STATIO_TABLES_HEAP,
+										FILTER_TABLES, "relid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = tableio_heap_count;
 			tableio_heap_count = PQntuples(pgresult);
+			reset = stats_reset(&tableio_heap_epoch, pgresult, 5);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -155,6 +172,8 @@ tableio_heap_info(void)
 			return;
 		}
 		n->relid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(tableio_heap, &head_tableio_heaps, n);
 		if (p != NULL)
 		{
@@ -166,11 +185,15 @@ tableio_heap_info(void)
 
 		n->heap_blks_read_old = n->heap_blks_read;
 		n->heap_blks_read = atoll(PQgetvalue(pgresult, i, 3));
-		n->heap_blks_read_diff = n->heap_blks_read - n->heap_blks_read_old;
+		n->heap_blks_read_diff = COUNTER_DELTA(n->heap_blks_read,
+											   n->heap_blks_read_old,
+											   p == NULL || reset);
 
 		n->heap_blks_hit_old = n->heap_blks_hit;
 		n->heap_blks_hit = atoll(PQgetvalue(pgresult, i, 4));
-		n->heap_blks_hit_diff = n->heap_blks_hit - n->heap_blks_hit_old;
+		n->heap_blks_hit_diff = COUNTER_DELTA(n->heap_blks_hit,
+											  n->heap_blks_hit_old,
+											  p == NULL || reset);
 
 		memcpy(&tableio_heaps[i], n, sizeof(struct tableio_heap_t));
 	}
@@ -208,6 +231,8 @@ inittableioheap(void)
 	tableio_heaps = NULL;
 	tableio_heap_count = 0;
 
+	serve_allow_filtered(QUERY_STATIO_TABLES_HEAP, FILTER_TABLES, "relid");
+
 	for (v = views_tableio_heap; v->name != NULL; v++)
 		add_view(v);
 
@@ -254,6 +279,14 @@ print_tableio_heap(void)
 	} while (0);
 }
 
+const char *
+tableio_heap_name(int i)
+{
+	if (i >= tableio_heap_count)
+		return NULL;
+	return tableio_heaps[i].relname;
+}
+
 void
 sort_tableio_heap(void)
 {
@@ -273,8 +306,8 @@ sort_tableio_heap(void)
 	if (tableio_heap_count <= 0)
 		return;
 
-	mergesort(tableio_heaps, tableio_heap_count, sizeof(struct tableio_heap_t),
-			  ordering->func);
+	sort_rows(tableio_heaps, tableio_heap_count, sizeof(struct tableio_heap_t),
+			  offsetof(struct tableio_heap_t, order), ordering->func);
 }
 
 int
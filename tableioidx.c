@@ -11,16 +11,21 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "filter.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STATIO_TABLES_IDX \
-		"SELECT relid, schemaname, relname, idx_blks_read, idx_blks_hit\n" \
-		"FROM pg_statio_all_tables;"
+		"SELECT relid, schemaname, relname, idx_blks_read, idx_blks_hit,\n" \
+		"       " STATS_EPOCH_DATABASE "\n" \
+		"FROM pg_statio_all_tables"
 
 struct tableio_idx_t
 {
 	RB_ENTRY(tableio_idx_t) entry;
+	row_order	order;
 
 	long long	relid;
 	char		schemaname[NAMEDATALEN + 1];
@@ -37,6 +42,7 @@ struct tableio_idx_t
 
 int			tableio_idxcmp(struct tableio_idx_t *, struct tableio_idx_t *);
 static void tableio_idx_info(void);
+const char *tableio_idx_name(int);
 void		print_tableio_idx(void);
 int			read_tableio_idx(void);
 int			select_tableio_idx(void);
@@ -91,7 +97,7 @@ order_type	tableio_idx_order_list[] = {
 struct view_manager tableio_idx_mgr = {
 	"tableioidx", select_tableio_idx, read_tableio_idx, sort_tableio_idx,
 	print_header, print_tableio_idx, keyboard_callback, tableio_idx_order_list,
-	tableio_idx_order_list
+	tableio_idx_order_list, NULL, NULL, tableio_idx_name, TIER_RELATION
 };
 
 field_view	views_tableio_idx[] = {
@@ -101,24 +107,34 @@ field_view	views_tableio_idx[] = {
 
 int			tableio_idx_count;
 struct tableio_idx_t *tableio_idxs;
+struct stats_epoch tableio_idx_epoch;
 
 static void
 tableio_idx_info(void)
 {
 	int			i;
+	int			reset = 0;
 	PGresult   *pgresult = NULL;
 
 	struct tableio_idx_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STATIO_TABLES_IDX);
+		pgresult = pg_exec(filter_query(QUERY_STATIO_TABLES_IDX, FILTER_TABLES,
+										"relid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = tableio_idx_count;
 			tableio_idx_count = PQntuples(pgresult);
+			reset = stats_reset(&tableio_idx_epoch, pgresult, 5);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -154,6 +170,8 @@ tableio_idx_info(void)
 			return;
 		}
 		n->relid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(tableioidx, &head_tableio_idxs, n);
 		if (p != NULL)
 		{
@@ -165,11 +183,15 @@ tableio_idx_info(void)
 
 		n->idx_blks_read_old = n->idx_blks_read;
 		n->idx_blks_read = atoll(PQgetvalue(pgresult, i, 3));
-		n->idx_blks_read_diff = n->idx_blks_read - n->idx_blks_read_old;
+		n->idx_blks_read_diff = COUNTER_DELTA(n->idx_blks_read,
+											  n->idx_blks_read_old,
+											  p == NULL || reset);
 
 		n->idx_blks_hit_old = n->idx_blks_hit;
 		n->idx_blks_hit = atoll(PQgetvalue(pgresult, i, 4));
-		n->idx_blks_hit_diff = n->idx_blks_hit - n->idx_blks_hit_old;
+		n->idx_blks_hit_diff = COUNTER_DELTA(n->idx_blks_hit,
+											 n->idx_blks_hit_old,
+											 p == NULL || reset);
 
 		memcpy(&tableio_idxs[i], n, sizeof(struct tableio_idx_t));
 	}
@@ -207,6 +229,8 @@ inittableioidx(void)
 	tableio_idxs = NULL;
 	tableio_idx_count = 0;
 
+	serve_allow_filtered(QUERY_STATIO_TABLES_IDX, FILTER_TABLES, "relid");
+
 	for (v = views_tableio_idx; v->name != NULL; v++)
 		add_view(v);
 
@@ -254,6 +278,14 @@ print_tableio_idx(void)
 	} while (0);
 }
 
+const char *
+tableio_idx_name(int i)
+{
+	if (i >= tableio_idx_count)
+		return NULL;
+	return tableio_idxs[i].relname;
+}
+
 void
 sort_tableio_idx(void)
 {
@@ -273,8 +305,8 @@ sort_tableio_idx(void)
 	if (tableio_idx_count <= 0)
 		return;
 
-	mergesort(tableio_idxs, tableio_idx_count, sizeof(struct tableio_idx_t),
-			  ordering->func);
+	sort_rows(tableio_idxs, tableio_idx_count, sizeof(struct tableio_idx_t),
+			  offsetof(struct tableio_idx_t, order), ordering->func);
 }
 
 int
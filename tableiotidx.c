@@ -11,16 +11,21 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "filter.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STATIO_TABLE_TIDX \
-		"SELECT relid, schemaname, relname, tidx_blks_read, tidx_blks_hit\n" \
-		"FROM pg_statio_all_tables;"
+		"SELECT relid, schemaname, relname, tidx_blks_read, tidx_blks_hit,\n" \
+		"       " STATS_EPOCH_DATABASE "\n" \
+		"FROM pg_statio_all_tables"
 
 struct tableio_tidx_t
 {
 	RB_ENTRY(tableio_tidx_t) entry;
+	row_order	order;
 
 	long long	relid;
 	char		schemaname[NAMEDATALEN + 1];
@@ -37,6 +42,7 @@ struct tableio_tidx_t
 
 int			tableio_tidxcmp(struct tableio_tidx_t *, struct tableio_tidx_t *);
 static void tableio_tidx_info(void);
+const char *tableio_tidx_name(int);
 void		print_tableio_tidx(void);
 int			read_tableio_tidx(void);
 int			select_tableio_tidx(void);
@@ -91,7 +97,7 @@ order_type	tableio_tidx_order_list[] = {
 struct view_manager tableio_tidx_mgr = {
 	"tableiotidx", select_tableio_tidx, read_tableio_tidx, sort_tableio_tidx,
 	print_header, print_tableio_tidx, keyboard_callback, tableio_tidx_order_list,
-	tableio_tidx_order_list
+	tableio_tidx_order_list, NULL, NULL, tableio_tidx_name, TIER_RELATION
 };
 
 field_view	views_tableio_tidx[] = {
@@ -101,24 +107,34 @@ field_view	views_tableio_tidx[] = {
 
 int			tableio_tidx_count;
 struct tableio_tidx_t *tableio_tidxs;
+struct stats_epoch tableio_tidx_epoch;
 
 static void
 tableio_tidx_info(void)
 {
 	int			i;
+	int			reset = 0;
 	PGresult   *pgresult = NULL;
 
 	struct tableio_tidx_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STATIO_TABLE_TIDX);
+		pgresult = pg_exec(filter_query(QUERY_STATIO_TABLE_TIDX, FILTER_TABLES,
+										"relid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = tableio_tidx_count;
 			tableio_tidx_count = PQntuples(pgresult);
+			reset = stats_reset(&tableio_tidx_epoch, pgresult, 5);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -154,6 +170,8 @@ tableio_tidx_info(void)
 			return;
 		}
 		n->relid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(tableiotidx, &head_tableio_tidxs, n);
 		if (p != NULL)
 		{
@@ -165,11 +183,15 @@ tableio_tidx_info(void)
 
 		n->tidx_blks_read_old = n->tidx_blks_read;
 		n->tidx_blks_read = atoll(PQgetvalue(pgresult, i, 3));
-		n->tidx_blks_read_diff = n->tidx_blks_read - n->tidx_blks_read_old;
+		n->tidx_blks_read_diff = COUNTER_DELTA(n->tidx_blks_read,
+											   n->tidx_blks_read_old,
+											   p == NULL || reset);
 
 		n->tidx_blks_hit_old = n->tidx_blks_hit;
 		n->tidx_blks_hit = atoll(PQgetvalue(pgresult, i, 4));
-		n->tidx_blks_hit_diff = n->tidx_blks_hit - n->tidx_blks_hit_old;
+		n->tidx_blks_hit_diff = COUNTER_DELTA(n->tidx_blks_hit,
+											  n->tidx_blks_hit_old,
+											  p == NULL || reset);
 
 		memcpy(&tableio_tidxs[i], n, sizeof(struct tableio_tidx_t));
 	}
@@ -207,6 +229,8 @@ inittableiotidx(void)
 	tableio_tidxs = NULL;
 	tableio_tidx_count = 0;
 
+	serve_allow_filtered(QUERY_STATIO_TABLE_TIDX, FILTER_TABLES, "relid");
+
 	for (v = views_tableio_tidx; v->name != NULL; v++)
 		add_view(v);
 
@@ -254,6 +278,14 @@ print_tableio_tidx(void)
 	} while (0);
 }
 
+const char *
+tableio_tidx_name(int i)
+{
+	if (i >= tableio_tidx_count)
+		return NULL;
+	return tableio_tidxs[i].relname;
+}
+
 void
 sort_tableio_tidx(void)
 {
@@ -273,8 +305,8 @@ sort_tableio_tidx(void)
 	if (tableio_tidx_count <= 0)
 		return;
 
-	mergesort(tableio_tidxs, tableio_tidx_count, sizeof(struct tableio_tidx_t),
-			  ordering->func);
+	sort_rows(tableio_tidxs, tableio_tidx_count, sizeof(struct tableio_tidx_t),
+			  offsetof(struct tableio_tidx_t, order), ordering->func);
 }
 
 int
@@ -11,17 +11,22 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "filter.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STATIO_TABLE_TOAST \
 		"SELECT relid, schemaname, relname, toast_blks_read,\n" \
-		"       toast_blks_hit\n" \
-		"FROM pg_statio_all_tables;"
+		"       toast_blks_hit,\n" \
+		"       " STATS_EPOCH_DATABASE "\n" \
+		"FROM pg_statio_all_tables"
 
 struct tableio_toast_t
 {
 	RB_ENTRY(tableio_toast_t) entry;
+	row_order	order;
 
 	long long	relid;
 	char		schemaname[NAMEDATALEN + 1];
@@ -38,6 +43,7 @@ struct tableio_toast_t
 
 int			tableio_toastcmp(struct tableio_toast_t *, struct tableio_toast_t *);
 static void tableio_toast_info(void);
+const char *tableio_toast_name(int);
 void		print_tableio_toast(void);
 int			read_tableio_toast(void);
 int			select_tableio_toast(void);
@@ -93,7 +99,8 @@ order_type	tableio_toast_order_list[] = {
 struct view_manager tableio_toast_mgr = {
 	"tableiotoast", select_tableio_toast, read_tableio_toast,
 	sort_tableio_toast, print_header, print_tableio_toast, keyboard_callback,
-	tableio_toast_order_list, tableio_toast_order_list
+	tableio_toast_order_list, tableio_toast_order_list,
+	NULL, NULL, tableio_toast_name, TIER_RELATION
 };
 
 field_view	views_tableio_toast[] = {
@@ -103,24 +110,34 @@ field_view	views_tableio_toast[] = {
 
 int			tableio_toast_count;
 struct tableio_toast_t *tableio_toasts;
+struct stats_epoch tableio_toast_epoch;
 
 static void
 tableio_toast_info(void)
 {
 	int			i;
+	int			reset = 0;
 	PGresult   *pgresult = NULL;
 
 	struct tableio_toast_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STATIO_TABLE_TOAST);
+		pgresult = pg_exec(filter_query(QUERY_STATIO_TABLE_TOAST,
+										FILTER_TABLES, "relid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = tableio_toast_count;
 			tableio_toast_count = PQntuples(pgresult);
+			reset = stats_reset(&tableio_toast_epoch, pgresult, 5);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -156,6 +173,8 @@ tableio_toast_info(void)
 			return;
 		}
 		n->relid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(tableio_toast, &head_tableio_toasts, n);
 		if (p != NULL)
 		{
@@ -167,11 +186,15 @@ tableio_toast_info(void)
 
 		n->toast_blks_read_old = n->toast_blks_read;
 		n->toast_blks_read = atoll(PQgetvalue(pgresult, i, 3));
-		n->toast_blks_read_diff = n->toast_blks_read - n->toast_blks_read_old;
+		n->toast_blks_read_diff = COUNTER_DELTA(n->toast_blks_read,
+												n->toast_blks_read_old,
+												p == NULL || reset);
 
 		n->toast_blks_hit_old = n->toast_blks_hit;
 		n->toast_blks_hit = atoll(PQgetvalue(pgresult, i, 4));
-		n->toast_blks_hit_diff = n->toast_blks_hit - n->toast_blks_hit_old;
+		n->toast_blks_hit_diff = COUNTER_DELTA(n->toast_blks_hit,
+											   n->toast_blks_hit_old,
+											   p == NULL || reset);
 
 		memcpy(&tableio_toasts[i], n, sizeof(struct tableio_toast_t));
 	}
@@ -209,6 +232,8 @@ inittableiotoast(void)
 	tableio_toasts = NULL;
 	tableio_toast_count = 0;
 
+	serve_allow_filtered(QUERY_STATIO_TABLE_TOAST, FILTER_TABLES, "relid");
+
 	for (v = views_tableio_toast; v->name != NULL; v++)
 		add_view(v);
 
@@ -255,6 +280,14 @@ print_tableio_toast(void)
 	} while (0);
 }
 
+const char *
+tableio_toast_name(int i)
+{
+	if (i >= tableio_toast_count)
+		return NULL;
+	return tableio_toasts[i].relname;
+}
+
 void
 sort_tableio_toast(void)
 {
@@ -274,8 +307,9 @@ sort_tableio_toast(void)
 	if (tableio_toast_count <= 0)
 		return;
 
-	mergesort(tableio_toasts, tableio_toast_count,
-			  sizeof(struct tableio_toast_t), ordering->func);
+	sort_rows(tableio_toasts, tableio_toast_count,
+			  sizeof(struct tableio_toast_t),
+			  offsetof(struct tableio_toast_t, order), ordering->func);
 }
 
 int
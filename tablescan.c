@@ -2,6 +2,7 @@
  * Copyright (c) 2019 PostgreSQL Global Development Group
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #ifdef __linux__
 #include <bsd/stdlib.h>
@@ -11,17 +12,65 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "bookmark.h"
+#include "filter.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_TABLES \
 		"SELECT relid, schemaname, relname, seq_scan, seq_tup_read,\n" \
-		"       idx_scan, idx_tup_fetch\n" \
-		"FROM pg_stat_all_tables;"
+		"       idx_scan, idx_tup_fetch,\n" \
+		"       " STATS_EPOCH_DATABASE "\n" \
+		"FROM pg_stat_all_tables"
+
+/*
+ * In top mode the server keeps the counters of the previous refresh in a
+ * temporary table of the session and computes the changes itself, returning
+ * only the top rows by the current ordering followed by the totals of all.
+ * The statement reads the previous counters before it replaces them.
+ */
+/* no change for a new row or a counter that went back, as COUNTER_DELTA */
+#define TOP_DELTA(c) \
+		"CASE WHEN c." #c " >= p." #c " THEN c." #c " - p." #c \
+		" ELSE 0 END AS " #c
+
+#define QUERY_TOP_TABLES_CREATE \
+		"CREATE TEMPORARY TABLE IF NOT EXISTS pg_systat_tablescan (\n" \
+		"    relid oid PRIMARY KEY, seq_scan bigint, seq_tup_read bigint,\n" \
+		"    idx_scan bigint, idx_tup_fetch bigint);"
+#define QUERY_TOP_TABLES_HEAD \
+		"WITH cur AS (\n"
+#define QUERY_TOP_TABLES_TAIL \
+		"),\n" \
+		"prev AS (\n" \
+		"    INSERT INTO pg_temp.pg_systat_tablescan\n" \
+		"    SELECT relid, seq_scan, seq_tup_read, idx_scan, idx_tup_fetch\n" \
+		"    FROM cur\n" \
+		"    ON CONFLICT (relid) DO UPDATE\n" \
+		"    SET seq_scan = excluded.seq_scan,\n" \
+		"        seq_tup_read = excluded.seq_tup_read,\n" \
+		"        idx_scan = excluded.idx_scan,\n" \
+		"        idx_tup_fetch = excluded.idx_tup_fetch),\n" \
+		"diff AS (\n" \
+		"    SELECT c.relid, c.schemaname, c.relname,\n" \
+		"           " TOP_DELTA(seq_scan) ",\n" \
+		"           " TOP_DELTA(seq_tup_read) ",\n" \
+		"           " TOP_DELTA(idx_scan) ",\n" \
+		"           " TOP_DELTA(idx_tup_fetch) ", c.stats_epoch\n" \
+		"    FROM cur c LEFT JOIN pg_temp.pg_systat_tablescan p\n" \
+		"         USING (relid))\n" \
+		"(SELECT * FROM diff ORDER BY %s LIMIT %d)\n" \
+		"UNION ALL\n" \
+		"SELECT NULL, NULL, NULL, sum(seq_scan), sum(seq_tup_read),\n" \
+		"       sum(idx_scan), sum(idx_tup_fetch), min(stats_epoch)\n" \
+		"FROM diff;"
 
 struct tablescan_t
 {
 	RB_ENTRY(tablescan_t) entry;
+	row_order	order;
 
 	long long	relid;
 	char		schemaname[NAMEDATALEN + 1];
@@ -42,6 +91,7 @@ struct tablescan_t
 
 int			tablescancmp(struct tablescan_t *, struct tablescan_t *);
 static void tablescan_info(void);
+const char *tablescan_name(int);
 void		print_tablescan(void);
 int			read_tablescan(void);
 int			select_tablescan(void);
@@ -99,7 +149,8 @@ order_type	tablescan_order_list[] = {
 	{"seq_tup_read", "seq_tup_read", 't',
 	sort_tablescan_seq_tup_read_callback},
 	{"idx_scan", "idx_scan", 'i', sort_tablescan_idx_scan_callback},
-	{"idx_tup_fetch", "idx_tup_fetch", 'f', sort_tablescan_idx_scan_callback},
+	{"idx_tup_fetch", "idx_tup_fetch", 'f',
+	sort_tablescan_idx_tup_fetch_callback},
 	{NULL, NULL, 0, NULL}
 };
 
@@ -107,7 +158,7 @@ order_type	tablescan_order_list[] = {
 struct view_manager tablescan_mgr = {
 	"tablescan", select_tablescan, read_tablescan, sort_tablescan,
 	print_header, print_tablescan, keyboard_callback, tablescan_order_list,
-	tablescan_order_list
+	tablescan_order_list, NULL, NULL, tablescan_name, TIER_RELATION
 };
 
 field_view	views_tablescan[] = {
@@ -117,24 +168,102 @@ field_view	views_tablescan[] = {
 
 int			tablescan_count;
 struct tablescan_t *tablescans;
+struct stats_epoch tablescan_epoch;
+
+/* the totals of all rows in top mode, shown after the top rows */
+static struct tablescan_t tablescan_total;
+static int	tablescan_has_total = 0;
+
+/* backend the temporary table of top mode was created in, -1 if it cannot */
+static int	tablescan_top_pid = 0;
+
+/*
+ * The top mode statement for the current ordering, or NULL to fetch every
+ * row.  The filters apply to the rows the server keeps and sums as well.
+ */
+static char *
+tablescan_top_query(void)
+{
+	const char *cur,
+			   *dir = sortdir == 1 ? "DESC" : "ASC";
+	char		order[128];
+	char	   *query;
+	size_t		len;
+	order_type *o;
+
+	if (top_rows <= 0 || since_bookmark || tablescan_top_pid == -1)
+		return NULL;
+	if (pg_session_table(&tablescan_top_pid, QUERY_TOP_TABLES_CREATE) == -1)
+	{
+		tablescan_top_pid = -1;
+		return NULL;
+	}
+
+	/* the names of the orderings by a counter are those of its column */
+	o = tablescan_mgr.order_curr;
+	if (o == NULL || o->func == sort_tablescan_relname_callback)
+		snprintf(order, sizeof(order), "relname %s, schemaname %s", dir,
+				 dir);
+	else if (o->func == sort_tablescan_schemaname_callback)
+		snprintf(order, sizeof(order), "schemaname %s, relname %s", dir,
+				 dir);
+	else
+		snprintf(order, sizeof(order), "%s %s, relname %s, schemaname %s",
+				 o->name, dir, dir, dir);
+
+	/* the filtered query of every row, without its semicolon */
+	cur = filter_query(QUERY_STAT_TABLES, FILTER_TABLES, "relid");
+	len = strlen(QUERY_TOP_TABLES_HEAD QUERY_TOP_TABLES_TAIL) + strlen(cur) +
+		strlen(order) + 16;
+	if ((query = malloc(len)) == NULL)
+		return NULL;
+	snprintf(query, len, QUERY_TOP_TABLES_HEAD "%.*s" QUERY_TOP_TABLES_TAIL,
+			 (int) strlen(cur) - 1, cur, order, top_rows);
+	return query;
+}
 
 static void
 tablescan_info(void)
 {
-	int			i;
+	int			i,
+				j;
+	int			reset = 0;
 	PGresult   *pgresult = NULL;
+	char	   *top;
+	int			topmode;
 
 	struct tablescan_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_TABLES);
+		top = tablescan_top_query();
+		topmode = top != NULL;
+		if (topmode)
+			pgresult = pg_exec(top);
+		else
+			pgresult = pg_exec(filter_query(QUERY_STAT_TABLES, FILTER_TABLES,
+											"relid"));
+		free(top);
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = tablescan_count;
 			tablescan_count = PQntuples(pgresult);
+			reset = stats_reset(&tablescan_epoch, pgresult, 7);
+		}
+		else
+		{
+			/*
+			 * The session may have ended with its table, so make sure of it
+			 * again.  The statement may as well have been cancelled, with the
+			 * table still there.
+			 */
+			if (topmode)
+				tablescan_top_pid = 0;
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -158,8 +287,50 @@ tablescan_info(void)
 		tablescans = p;
 	}
 
-	for (i = 0; i < tablescan_count; i++)
+	tablescan_has_total = 0;
+	for (i = j = 0; i < tablescan_count; i++)
 	{
+		/* in top mode the server computed the changes */
+		if (topmode)
+		{
+			n = &tablescan_total;
+			if (!PQgetisnull(pgresult, i, 0))
+			{
+				n = malloc(sizeof(struct tablescan_t));
+				if (n == NULL)
+				{
+					error("malloc error");
+					if (pgresult != NULL)
+						PQclear(pgresult);
+					disconnect_from_db();
+					return;
+				}
+				n->relid = atoll(PQgetvalue(pgresult, i, 0));
+				n->order.node = n;
+				n->order.rank = -1;
+				p = RB_INSERT(tablescan, &head_tablescans, n);
+				if (p != NULL)
+				{
+					free(n);
+					n = p;
+				}
+			}
+			else
+				tablescan_has_total = 1;
+			strncpy(n->schemaname, PQgetvalue(pgresult, i, 1), NAMEDATALEN);
+			strncpy(n->relname, n == &tablescan_total ? "total" :
+					PQgetvalue(pgresult, i, 2), NAMEDATALEN);
+			n->seq_scan_diff = reset ? 0 : atoll(PQgetvalue(pgresult, i, 3));
+			n->seq_tup_read_diff =
+				reset ? 0 : atoll(PQgetvalue(pgresult, i, 4));
+			n->idx_scan_diff = reset ? 0 : atoll(PQgetvalue(pgresult, i, 5));
+			n->idx_tup_fetch_diff =
+				reset ? 0 : atoll(PQgetvalue(pgresult, i, 6));
+			if (n != &tablescan_total)
+				memcpy(&tablescans[j++], n, sizeof(struct tablescan_t));
+			continue;
+		}
+
 		n = malloc(sizeof(struct tablescan_t));
 		if (n == NULL)
 		{
@@ -170,6 +341,8 @@ tablescan_info(void)
 			return;
 		}
 		n->relid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(tablescan, &head_tablescans, n);
 		if (p != NULL)
 		{
@@ -181,22 +354,29 @@ tablescan_info(void)
 
 		n->seq_scan_old = n->seq_scan;
 		n->seq_scan = atoll(PQgetvalue(pgresult, i, 3));
-		n->seq_scan_diff = n->seq_scan - n->seq_scan_old;
+		n->seq_scan_diff = COUNTER_DELTA(n->seq_scan, n->seq_scan_old,
+										 p == NULL || reset);
 
 		n->seq_tup_read_old = n->seq_tup_read;
 		n->seq_tup_read = atoll(PQgetvalue(pgresult, i, 4));
-		n->seq_tup_read_diff = n->seq_tup_read - n->seq_tup_read_old;
+		n->seq_tup_read_diff = COUNTER_DELTA(n->seq_tup_read,
+											 n->seq_tup_read_old,
+											 p == NULL || reset);
 
 		n->idx_scan_old = n->idx_scan;
 		n->idx_scan = atoll(PQgetvalue(pgresult, i, 5));
-		n->idx_scan_diff = n->idx_scan - n->idx_scan_old;
+		n->idx_scan_diff = COUNTER_DELTA(n->idx_scan, n->idx_scan_old,
+										 p == NULL || reset);
 
 		n->idx_tup_fetch_old = n->idx_tup_fetch;
 		n->idx_tup_fetch = atoll(PQgetvalue(pgresult, i, 6));
-		n->idx_tup_fetch_diff = n->idx_tup_fetch - n->idx_tup_fetch_old;
+		n->idx_tup_fetch_diff = COUNTER_DELTA(n->idx_tup_fetch,
+											  n->idx_tup_fetch_old,
+											  p == NULL || reset);
 
-		memcpy(&tablescans[i], n, sizeof(struct tablescan_t));
+		memcpy(&tablescans[j++], n, sizeof(struct tablescan_t));
 	}
+	tablescan_count = j;
 
 	if (pgresult != NULL)
 		PQclear(pgresult);
@@ -212,6 +392,9 @@ tablescancmp(struct tablescan_t *e1, struct tablescan_t *e2)
 int
 select_tablescan(void)
 {
+	/* the previous counters of top mode live in the session */
+	if (top_rows > 0)
+		keep_connection();
 	return (0);
 }
 
@@ -220,6 +403,9 @@ read_tablescan(void)
 {
 	tablescan_info();
 	num_disp = tablescan_count;
+	/* a blank line, then the totals */
+	if (tablescan_has_total)
+		num_disp += 2;
 	return (0);
 }
 
@@ -231,6 +417,8 @@ inittablescan(void)
 	tablescans = NULL;
 	tablescan_count = 0;
 
+	serve_allow_filtered(QUERY_STAT_TABLES, FILTER_TABLES, "relid");
+
 	for (v = views_tablescan; v->name != NULL; v++)
 		add_view(v);
 
@@ -239,6 +427,18 @@ inittablescan(void)
 	return (1);
 }
 
+static void
+print_tablescan_row(struct tablescan_t *t)
+{
+	print_fld_str(FLD_TABLE_SCHEMA, t->schemaname);
+	print_fld_str(FLD_TABLE_NAME, t->relname);
+	print_fld_uint(FLD_TABLE_SEQ_SCAN, t->seq_scan_diff);
+	print_fld_uint(FLD_TABLE_SEQ_TUP_READ, t->seq_tup_read_diff);
+	print_fld_uint(FLD_TABLE_IDX_SCAN, t->idx_scan_diff);
+	print_fld_uint(FLD_TABLE_IDX_TUP_FETCH, t->idx_tup_fetch_diff);
+	end_line();
+}
+
 void
 print_tablescan(void)
 {
@@ -254,19 +454,7 @@ print_tablescan(void)
 		do
 		{
 			if (cur >= dispstart && cur < end)
-			{
-				print_fld_str(FLD_TABLE_SCHEMA, tablescans[i].schemaname);
-				print_fld_str(FLD_TABLE_NAME, tablescans[i].relname);
-				print_fld_uint(FLD_TABLE_SEQ_SCAN,
-							   tablescans[i].seq_scan_diff);
-				print_fld_uint(FLD_TABLE_SEQ_TUP_READ,
-							   tablescans[i].seq_tup_read_diff);
-				print_fld_uint(FLD_TABLE_IDX_SCAN,
-							   tablescans[i].idx_scan_diff);
-				print_fld_uint(FLD_TABLE_IDX_TUP_FETCH,
-							   tablescans[i].idx_tup_fetch_diff);
-				end_line();
-			}
+				print_tablescan_row(&tablescans[i]);
 			if (++cur >= end)
 				return;
 		} while (0);
@@ -279,6 +467,17 @@ print_tablescan(void)
 		if (++cur >= end)
 			return;
 	} while (0);
+
+	if (tablescan_has_total && cur >= dispstart && cur < end)
+		print_tablescan_row(&tablescan_total);
+}
+
+const char *
+tablescan_name(int i)
+{
+	if (i >= tablescan_count)
+		return NULL;
+	return tablescans[i].relname;
 }
 
 void
@@ -300,8 +499,8 @@ sort_tablescan(void)
 	if (tablescan_count <= 0)
 		return;
 
-	mergesort(tablescans, tablescan_count, sizeof(struct tablescan_t),
-			  ordering->func);
+	sort_rows(tablescans, tablescan_count, sizeof(struct tablescan_t),
+			  offsetof(struct tablescan_t, order), ordering->func);
 }
 
 int
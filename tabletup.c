@@ -11,44 +11,51 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "counter.h"
+#include "filter.h"
+#include "history.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_TABLES \
 		"SELECT relid, schemaname, relname, n_tup_ins, n_tup_upd,\n" \
-		"       n_tup_del, n_tup_hot_upd, n_live_tup, n_dead_tup\n" \
-		"FROM pg_stat_all_tables;"
+		"       n_tup_del, n_tup_hot_upd, n_live_tup, n_dead_tup,\n" \
+		"       " STATS_EPOCH_DATABASE "\n" \
+		"FROM pg_stat_all_tables"
+
+/* Columns of the tabletup counter set. */
+enum
+{
+	TABLETUP_N_TUP_INS,
+	TABLETUP_N_TUP_UPD,
+	TABLETUP_N_TUP_DEL,
+	TABLETUP_N_TUP_HOT_UPD,
+	TABLETUP_N_LIVE_TUP,
+	TABLETUP_N_DEAD_TUP,
+	TABLETUP_NCOUNTERS
+};
 
 struct tabletup_t
 {
 	RB_ENTRY(tabletup_t) entry;
+	row_order	order;
 
 	long long	relid;
 	char		schemaname[NAMEDATALEN + 1];
 	char		relname[NAMEDATALEN + 1];
+	int			slot;
 
-	int64_t		n_tup_ins;
-	int64_t		n_tup_ins_diff;
-	int64_t		n_tup_ins_old;
-
-	int64_t		n_tup_upd;
-	int64_t		n_tup_upd_diff;
-	int64_t		n_tup_upd_old;
+	/* moving averages of rows written per second */
+	struct ewma	write_avg;
 
-	int64_t		n_tup_del;
-	int64_t		n_tup_del_diff;
-	int64_t		n_tup_del_old;
-
-	int64_t		n_tup_hot_upd;
-	int64_t		n_tup_hot_upd_diff;
-	int64_t		n_tup_hot_upd_old;
-
-	int64_t		n_live_tup;
-	int64_t		n_dead_tup;
+	/* recent rows written per refresh, for the sparkline */
+	int			hist;
 };
 
 int			tabletupcmp(struct tabletup_t *, struct tabletup_t *);
 static void tabletup_info(void);
+const char *tabletup_name(int);
 void		print_tabletup(void);
 int			read_tabletup(void);
 int			select_tabletup(void);
@@ -61,6 +68,9 @@ int			sort_tabletup_n_tup_del_callback(const void *, const void *);
 int			sort_tabletup_n_tup_hot_upd_callback(const void *, const void *);
 int			sort_tabletup_n_tup_ins_callback(const void *, const void *);
 int			sort_tabletup_n_tup_upd_callback(const void *, const void *);
+int			sort_tabletup_writes_1m_callback(const void *, const void *);
+int			sort_tabletup_writes_5m_callback(const void *, const void *);
+int			sort_tabletup_writes_15m_callback(const void *, const void *);
 
 RB_HEAD(tabletup, tabletup_t) head_tabletups = RB_INITIALIZER(&head_tabletups);
 RB_PROTOTYPE(tabletup, tabletup_t, entry, tabletupcmp)
@@ -92,6 +102,18 @@ field_def fields_tabletup[] =
 	{
 		"DEAD", 5, 19, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
 	},
+	{
+		"W_1M", 5, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"W_5M", 5, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"W_15M", 6, 19, 1, FLD_ALIGN_RIGHT, -1, 0, FLD_FLAG_AVERAGE, 0
+	},
+	{
+		"TREND", HISTORY_LEN, HISTORY_LEN, 1, FLD_ALIGN_RIGHT, -1, 0, 0, 0
+	},
 };
 
 #define FLD_TABLE_SCHEMA        FIELD_ADDR(fields_tabletup, 0)
@@ -102,12 +124,17 @@ field_def fields_tabletup[] =
 #define FLD_TABLE_N_TUP_HOT_UPD FIELD_ADDR(fields_tabletup, 5)
 #define FLD_TABLE_N_LIVE_TUP    FIELD_ADDR(fields_tabletup, 6)
 #define FLD_TABLE_N_DEAD_TUP    FIELD_ADDR(fields_tabletup, 7)
+#define FLD_TABLE_W_1M          FIELD_ADDR(fields_tabletup, 8)
+#define FLD_TABLE_W_5M          FIELD_ADDR(fields_tabletup, 9)
+#define FLD_TABLE_W_15M         FIELD_ADDR(fields_tabletup, 10)
+#define FLD_TABLE_TREND         FIELD_ADDR(fields_tabletup, 11)
 
 /* Define views */
 field_def  *view_tabletup_0[] = {
 	FLD_TABLE_SCHEMA, FLD_TABLE_NAME, FLD_TABLE_N_TUP_INS, FLD_TABLE_N_TUP_UPD,
-	FLD_TABLE_N_TUP_DEL, FLD_TABLE_N_TUP_HOT_UPD, FLD_TABLE_N_LIVE_TUP,
-	FLD_TABLE_N_DEAD_TUP, NULL
+	FLD_TABLE_N_TUP_DEL, FLD_TABLE_TREND, FLD_TABLE_N_TUP_HOT_UPD,
+	FLD_TABLE_N_LIVE_TUP, FLD_TABLE_N_DEAD_TUP, FLD_TABLE_W_1M, FLD_TABLE_W_5M,
+	FLD_TABLE_W_15M, NULL
 };
 
 order_type	tabletup_order_list[] = {
@@ -116,16 +143,20 @@ order_type	tabletup_order_list[] = {
 	{"n_tup_ins", "n_tup_ins", 'i', sort_tabletup_n_tup_ins_callback},
 	{"n_tup_upd", "n_tup_upd", 'u', sort_tabletup_n_tup_upd_callback},
 	{"n_tup_del", "n_tup_del", 'd', sort_tabletup_n_tup_del_callback},
-	{"n_tup_hot_upd", "n_tup_hot_upd", 'h', sort_tabletup_n_tup_upd_callback},
+	{"n_tup_hot_upd", "n_tup_hot_upd", 'h', sort_tabletup_n_tup_hot_upd_callback},
 	{"n_live_tup", "n_live_tup", 'V', sort_tabletup_n_live_tup_callback},
 	{"n_dead_tup", "n_dead_tup", 'e', sort_tabletup_n_dead_tup_callback},
+	{"writes_1m", "writes_1m", '1', sort_tabletup_writes_1m_callback},
+	{"writes_5m", "writes_5m", '5', sort_tabletup_writes_5m_callback},
+	{"writes_15m", "writes_15m", 'F', sort_tabletup_writes_15m_callback},
 	{NULL, NULL, 0, NULL}
 };
 
 /* Define view managers */
 struct view_manager tabletup_mgr = {
 	"tabletup", select_tabletup, read_tabletup, sort_tabletup, print_header,
-	print_tabletup, keyboard_callback, tabletup_order_list, tabletup_order_list
+	print_tabletup, keyboard_callback, tabletup_order_list, tabletup_order_list,
+	NULL, NULL, tabletup_name, TIER_RELATION
 };
 
 field_view	views_tabletup[] = {
@@ -135,24 +166,45 @@ field_view	views_tabletup[] = {
 
 int			tabletup_count;
 struct tabletup_t *tabletups;
+struct snapshot_clock tabletup_clock;
+struct stats_epoch tabletup_epoch;
+struct counter_set tabletup_counters =
+COUNTER_SET_INITIALIZER(TABLETUP_NCOUNTERS);
+struct history tabletup_history = HISTORY_INITIALIZER;
+
+#define TABLETUP_CURR(n, col) COUNTER_CURR(&tabletup_counters, col, (n)->slot)
+#define TABLETUP_DIFF(n, col) COUNTER_DIFF(&tabletup_counters, col, (n)->slot)
 
 static void
 tabletup_info(void)
 {
 	int			i;
+	int			reset = 0;
+	double		decay[EWMA_NAVG];
 	PGresult   *pgresult = NULL;
 
 	struct tabletup_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_TABLES);
+		pgresult = pg_exec(filter_query(QUERY_STAT_TABLES, FILTER_TABLES,
+										"relid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = tabletup_count;
 			tabletup_count = PQntuples(pgresult);
+			reset = stats_reset(&tabletup_epoch, pgresult, 9);
+			snapshot_clock_tick(&tabletup_clock);
+			ewma_decay(&tabletup_clock, decay);
+			history_advance(&tabletup_history);
+		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
 		}
 	}
 	else
@@ -175,6 +227,7 @@ tabletup_info(void)
 		tabletups = p;
 	}
 
+	counter_advance(&tabletup_counters);
 	for (i = 0; i < tabletup_count; i++)
 	{
 		n = malloc(sizeof(struct tabletup_t));
@@ -187,8 +240,23 @@ tabletup_info(void)
 			return;
 		}
 		n->relid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(tabletup, &head_tabletups, n);
-		if (p != NULL)
+		if (p == NULL)
+		{
+			n->slot = counter_slot(&tabletup_counters);
+			if (n->slot == -1)
+			{
+				error("malloc error");
+				RB_REMOVE(tabletup, &head_tabletups, n);
+				free(n);
+				tabletup_count = i;
+				break;
+			}
+			n->hist = history_slot(&tabletup_history);
+		}
+		else
 		{
 			free(n);
 			n = p;
@@ -196,27 +264,45 @@ tabletup_info(void)
 		strncpy(n->schemaname, PQgetvalue(pgresult, i, 1), NAMEDATALEN);
 		strncpy(n->relname, PQgetvalue(pgresult, i, 2), NAMEDATALEN);
 
-		n->n_tup_ins_old = n->n_tup_ins;
-		n->n_tup_ins = atoll(PQgetvalue(pgresult, i, 3));
-		n->n_tup_ins_diff = n->n_tup_ins - n->n_tup_ins_old;
-
-		n->n_tup_upd_old = n->n_tup_upd;
-		n->n_tup_upd = atoll(PQgetvalue(pgresult, i, 3));
-		n->n_tup_upd_diff = n->n_tup_upd - n->n_tup_upd_old;
-
-		n->n_tup_del_old = n->n_tup_del;
-		n->n_tup_del = atoll(PQgetvalue(pgresult, i, 4));
-		n->n_tup_del_diff = n->n_tup_del - n->n_tup_del_old;
-
-		n->n_tup_hot_upd_old = n->n_tup_hot_upd;
-		n->n_tup_hot_upd = atoll(PQgetvalue(pgresult, i, 5));
-		n->n_tup_hot_upd_diff = n->n_tup_hot_upd - n->n_tup_hot_upd_old;
-
-		n->n_live_tup = atoll(PQgetvalue(pgresult, i, 6));
-		n->n_dead_tup = atoll(PQgetvalue(pgresult, i, 7));
+		TABLETUP_CURR(n, TABLETUP_N_TUP_INS) =
+			atoll(PQgetvalue(pgresult, i, 3));
+		TABLETUP_CURR(n, TABLETUP_N_TUP_UPD) =
+			atoll(PQgetvalue(pgresult, i, 4));
+		TABLETUP_CURR(n, TABLETUP_N_TUP_DEL) =
+			atoll(PQgetvalue(pgresult, i, 5));
+		TABLETUP_CURR(n, TABLETUP_N_TUP_HOT_UPD) =
+			atoll(PQgetvalue(pgresult, i, 6));
+		TABLETUP_CURR(n, TABLETUP_N_LIVE_TUP) =
+			atoll(PQgetvalue(pgresult, i, 7));
+		TABLETUP_CURR(n, TABLETUP_N_DEAD_TUP) =
+			atoll(PQgetvalue(pgresult, i, 8));
+		if (p == NULL)
+		{
+			counter_rebase(&tabletup_counters, n->slot);
+			ewma_init(&n->write_avg);
+		}
 
 		memcpy(&tabletups[i], n, sizeof(struct tabletup_t));
 	}
+	if (reset)
+		counter_rebase(&tabletup_counters, -1);
+	counter_diff(&tabletup_counters);
+
+	for (i = 0; i < tabletup_count; i++)
+	{
+		n = tabletups[i].order.node;
+		ewma_update(&n->write_avg,
+					snapshot_rate(&tabletup_clock,
+								  TABLETUP_DIFF(n, TABLETUP_N_TUP_INS) +
+								  TABLETUP_DIFF(n, TABLETUP_N_TUP_UPD) +
+								  TABLETUP_DIFF(n, TABLETUP_N_TUP_DEL)),
+					decay, reset);
+		tabletups[i].write_avg = n->write_avg;
+		history_put(&tabletup_history, n->hist,
+					TABLETUP_DIFF(n, TABLETUP_N_TUP_INS) +
+					TABLETUP_DIFF(n, TABLETUP_N_TUP_UPD) +
+					TABLETUP_DIFF(n, TABLETUP_N_TUP_DEL));
+	}
 
 	if (pgresult != NULL)
 		PQclear(pgresult);
@@ -251,6 +337,8 @@ inittabletup(void)
 	tabletups = NULL;
 	tabletup_count = 0;
 
+	serve_allow_filtered(QUERY_STAT_TABLES, FILTER_TABLES, "relid");
+
 	for (v = views_tabletup; v->name != NULL; v++)
 		add_view(v);
 
@@ -265,6 +353,8 @@ print_tabletup(void)
 	int			cur = 0,
 				i;
 	int			end = dispstart + maxprint;
+	struct tabletup_t *n;
+	unsigned char levels[HISTORY_LEN];
 
 	if (end > num_disp)
 		end = num_disp;
@@ -275,18 +365,27 @@ print_tabletup(void)
 		{
 			if (cur >= dispstart && cur < end)
 			{
-				print_fld_str(FLD_TABLE_SCHEMA, tabletups[i].schemaname);
-				print_fld_str(FLD_TABLE_NAME, tabletups[i].relname);
+				n = &tabletups[i];
+				print_fld_str(FLD_TABLE_SCHEMA, n->schemaname);
+				print_fld_str(FLD_TABLE_NAME, n->relname);
 				print_fld_uint(FLD_TABLE_N_TUP_INS,
-							   tabletups[i].n_tup_ins_diff);
+							   TABLETUP_DIFF(n, TABLETUP_N_TUP_INS));
 				print_fld_uint(FLD_TABLE_N_TUP_UPD,
-							   tabletups[i].n_tup_upd_diff);
+							   TABLETUP_DIFF(n, TABLETUP_N_TUP_UPD));
 				print_fld_uint(FLD_TABLE_N_TUP_DEL,
-							   tabletups[i].n_tup_del_diff);
+							   TABLETUP_DIFF(n, TABLETUP_N_TUP_DEL));
+				print_fld_spark(FLD_TABLE_TREND, levels,
+								history_levels(&tabletup_history, n->hist,
+											   levels));
 				print_fld_uint(FLD_TABLE_N_TUP_HOT_UPD,
-							   tabletups[i].n_tup_hot_upd_diff);
-				print_fld_uint(FLD_TABLE_N_LIVE_TUP, tabletups[i].n_live_tup);
-				print_fld_uint(FLD_TABLE_N_DEAD_TUP, tabletups[i].n_dead_tup);
+							   TABLETUP_DIFF(n, TABLETUP_N_TUP_HOT_UPD));
+				print_fld_uint(FLD_TABLE_N_LIVE_TUP,
+							   TABLETUP_CURR(n, TABLETUP_N_LIVE_TUP));
+				print_fld_uint(FLD_TABLE_N_DEAD_TUP,
+							   TABLETUP_CURR(n, TABLETUP_N_DEAD_TUP));
+				print_fld_rate(FLD_TABLE_W_1M, n->write_avg.avg[EWMA_1M]);
+				print_fld_rate(FLD_TABLE_W_5M, n->write_avg.avg[EWMA_5M]);
+				print_fld_rate(FLD_TABLE_W_15M, n->write_avg.avg[EWMA_15M]);
 				end_line();
 			}
 			if (++cur >= end)
@@ -303,6 +402,14 @@ print_tabletup(void)
 	} while (0);
 }
 
+const char *
+tabletup_name(int i)
+{
+	if (i >= tabletup_count)
+		return NULL;
+	return tabletups[i].relname;
+}
+
 void
 sort_tabletup(void)
 {
@@ -322,80 +429,79 @@ sort_tabletup(void)
 	if (tabletup_count <= 0)
 		return;
 
-	mergesort(tabletups, tabletup_count, sizeof(struct tabletup_t),
-			  ordering->func);
+	sort_rows(tabletups, tabletup_count, sizeof(struct tabletup_t),
+			  offsetof(struct tabletup_t, order), ordering->func);
 }
 
-int
-sort_tabletup_n_dead_tup_callback(const void *v1, const void *v2)
+static int
+sort_tabletup_counter(const void *v1, const void *v2, int64_t c1, int64_t c2)
 {
-	struct tabletup_t *n1,
-			   *n2;
-
-	n1 = (struct tabletup_t *) v1;
-	n2 = (struct tabletup_t *) v2;
-
-	if (n1->n_dead_tup < n2->n_dead_tup)
+	if (c1 < c2)
 		return sortdir;
-	if (n1->n_dead_tup > n2->n_dead_tup)
+	if (c1 > c2)
 		return -sortdir;
 
 	return sort_tabletup_relname_callback(v1, v2);
 }
 
-int
-sort_tabletup_n_live_tup_callback(const void *v1, const void *v2)
+static int
+sort_tabletup_curr(const void *v1, const void *v2, int col)
 {
-	struct tabletup_t *n1,
-			   *n2;
+	const struct tabletup_t *n1 = v1;
+	const struct tabletup_t *n2 = v2;
 
-	n1 = (struct tabletup_t *) v1;
-	n2 = (struct tabletup_t *) v2;
+	return sort_tabletup_counter(v1, v2, TABLETUP_CURR(n1, col),
+								 TABLETUP_CURR(n2, col));
+}
 
-	if (n1->n_live_tup < n2->n_live_tup)
-		return sortdir;
-	if (n1->n_live_tup > n2->n_live_tup)
-		return -sortdir;
+static int
+sort_tabletup_diff(const void *v1, const void *v2, int col)
+{
+	const struct tabletup_t *n1 = v1;
+	const struct tabletup_t *n2 = v2;
 
-	return sort_tabletup_relname_callback(v1, v2);
+	return sort_tabletup_counter(v1, v2, TABLETUP_DIFF(n1, col),
+								 TABLETUP_DIFF(n2, col));
 }
 
 int
-sort_tabletup_n_tup_del_callback(const void *v1, const void *v2)
+sort_tabletup_n_dead_tup_callback(const void *v1, const void *v2)
 {
-	struct tabletup_t *n1,
-			   *n2;
-
-	n1 = (struct tabletup_t *) v1;
-	n2 = (struct tabletup_t *) v2;
+	return sort_tabletup_curr(v1, v2, TABLETUP_N_DEAD_TUP);
+}
 
-	if (n1->n_tup_del_diff < n2->n_tup_del_diff)
-		return sortdir;
-	if (n1->n_tup_del_diff > n2->n_tup_del_diff)
-		return -sortdir;
+int
+sort_tabletup_n_live_tup_callback(const void *v1, const void *v2)
+{
+	return sort_tabletup_curr(v1, v2, TABLETUP_N_LIVE_TUP);
+}
 
-	return sort_tabletup_relname_callback(v1, v2);
+int
+sort_tabletup_n_tup_del_callback(const void *v1, const void *v2)
+{
+	return sort_tabletup_diff(v1, v2, TABLETUP_N_TUP_DEL);
 }
 
 int
 sort_tabletup_n_tup_hot_upd_callback(const void *v1, const void *v2)
 {
-	struct tabletup_t *n1,
-			   *n2;
-
-	n1 = (struct tabletup_t *) v1;
-	n2 = (struct tabletup_t *) v2;
+	return sort_tabletup_diff(v1, v2, TABLETUP_N_TUP_HOT_UPD);
+}
 
-	if (n1->n_tup_hot_upd_diff < n2->n_tup_hot_upd_diff)
-		return sortdir;
-	if (n1->n_tup_hot_upd_diff > n2->n_tup_hot_upd_diff)
-		return -sortdir;
+int
+sort_tabletup_n_tup_ins_callback(const void *v1, const void *v2)
+{
+	return sort_tabletup_diff(v1, v2, TABLETUP_N_TUP_INS);
+}
 
-	return sort_tabletup_relname_callback(v1, v2);
+int
+sort_tabletup_n_tup_upd_callback(const void *v1, const void *v2)
+{
+	return sort_tabletup_diff(v1, v2, TABLETUP_N_TUP_UPD);
 }
 
 int
-sort_tabletup_n_tup_ins_callback(const void *v1, const void *v2)
+sort_tabletup_relname_callback(const void *v1, const void *v2)
 {
 	struct tabletup_t *n1,
 			   *n2;
@@ -403,16 +509,16 @@ sort_tabletup_n_tup_ins_callback(const void *v1, const void *v2)
 	n1 = (struct tabletup_t *) v1;
 	n2 = (struct tabletup_t *) v2;
 
-	if (n1->n_tup_ins_diff < n2->n_tup_ins_diff)
+	if (strcmp(n1->relname, n2->relname) < 0)
 		return sortdir;
-	if (n1->n_tup_ins_diff > n2->n_tup_ins_diff)
+	if (strcmp(n1->relname, n2->relname) > 0)
 		return -sortdir;
 
-	return sort_tabletup_relname_callback(v1, v2);
+	return strcmp(n1->schemaname, n2->schemaname) * sortdir;
 }
 
 int
-sort_tabletup_n_tup_upd_callback(const void *v1, const void *v2)
+sort_tabletup_schemaname_callback(const void *v1, const void *v2)
 {
 	struct tabletup_t *n1,
 			   *n2;
@@ -420,16 +526,16 @@ sort_tabletup_n_tup_upd_callback(const void *v1, const void *v2)
 	n1 = (struct tabletup_t *) v1;
 	n2 = (struct tabletup_t *) v2;
 
-	if (n1->n_tup_upd_diff < n2->n_tup_upd_diff)
+	if (strcmp(n1->schemaname, n2->schemaname) < 0)
 		return sortdir;
-	if (n1->n_tup_upd_diff > n2->n_tup_upd_diff)
+	if (strcmp(n1->schemaname, n2->schemaname) > 0)
 		return -sortdir;
 
-	return sort_tabletup_relname_callback(v1, v2);
+	return strcmp(n1->relname, n2->relname) * sortdir;
 }
 
-int
-sort_tabletup_relname_callback(const void *v1, const void *v2)
+static int
+sort_tabletup_writes(const void *v1, const void *v2, int avg)
 {
 	struct tabletup_t *n1,
 			   *n2;
@@ -437,27 +543,28 @@ sort_tabletup_relname_callback(const void *v1, const void *v2)
 	n1 = (struct tabletup_t *) v1;
 	n2 = (struct tabletup_t *) v2;
 
-	if (strcmp(n1->relname, n2->relname) < 0)
+	if (n1->write_avg.avg[avg] < n2->write_avg.avg[avg])
 		return sortdir;
-	if (strcmp(n1->relname, n2->relname) > 0)
+	if (n1->write_avg.avg[avg] > n2->write_avg.avg[avg])
 		return -sortdir;
 
-	return strcmp(n1->schemaname, n2->schemaname) * sortdir;
+	return sort_tabletup_relname_callback(v1, v2);
 }
 
 int
-sort_tabletup_schemaname_callback(const void *v1, const void *v2)
+sort_tabletup_writes_1m_callback(const void *v1, const void *v2)
 {
-	struct tabletup_t *n1,
-			   *n2;
-
-	n1 = (struct tabletup_t *) v1;
-	n2 = (struct tabletup_t *) v2;
+	return sort_tabletup_writes(v1, v2, EWMA_1M);
+}
 
-	if (strcmp(n1->schemaname, n2->schemaname) < 0)
-		return sortdir;
-	if (strcmp(n1->schemaname, n2->schemaname) > 0)
-		return -sortdir;
+int
+sort_tabletup_writes_5m_callback(const void *v1, const void *v2)
+{
+	return sort_tabletup_writes(v1, v2, EWMA_5M);
+}
 
-	return strcmp(n1->relname, n2->relname) * sortdir;
+int
+sort_tabletup_writes_15m_callback(const void *v1, const void *v2)
+{
+	return sort_tabletup_writes(v1, v2, EWMA_15M);
 }
@@ -11,17 +11,20 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include "filter.h"
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_TABLES \
 		"SELECT relid, schemaname, relname, last_vacuum, last_autovacuum,\n" \
 		"       vacuum_count, autovacuum_count\n" \
-		"FROM pg_stat_all_tables;"
+		"FROM pg_stat_all_tables"
 
 struct tablevac_t
 {
 	RB_ENTRY(tablevac_t) entry;
+	row_order	order;
 
 	long long	relid;
 	char		schemaname[NAMEDATALEN + 1];
@@ -36,6 +39,7 @@ struct tablevac_t
 
 int			tablevaccmp(struct tablevac_t *, struct tablevac_t *);
 static void tablevac_info(void);
+const char *tablevac_name(int);
 void		print_tablevac(void);
 int			read_tablevac(void);
 int			select_tablevac(void);
@@ -97,7 +101,8 @@ order_type	tablevac_order_list[] = {
 /* Define view managers */
 struct view_manager tablevac_mgr = {
 	"tablevac", select_tablevac, read_tablevac, sort_tablevac, print_header,
-	print_tablevac, keyboard_callback, tablevac_order_list, tablevac_order_list
+	print_tablevac, keyboard_callback, tablevac_order_list, tablevac_order_list,
+	NULL, NULL, tablevac_name, TIER_RELATION
 };
 
 field_view	views_tablevac[] = {
@@ -118,14 +123,21 @@ tablevac_info(void)
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_TABLES);
+		pgresult = pg_exec(filter_query(QUERY_STAT_TABLES, FILTER_TABLES,
+										"relid"));
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = tablevac_count;
 			tablevac_count = PQntuples(pgresult);
 		}
+		else
+		{
+			PQclear(pgresult);
+			disconnect_from_db();
+			return;
+		}
 	}
 	else
 	{
@@ -159,6 +171,8 @@ tablevac_info(void)
 			return;
 		}
 		n->relid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(tablevac, &head_tablevacs, n);
 		if (p != NULL)
 		{
@@ -210,6 +224,8 @@ inittablevac(void)
 	tablevacs = NULL;
 	tablevac_count = 0;
 
+	serve_allow_filtered(QUERY_STAT_TABLES, FILTER_TABLES, "relid");
+
 	for (v = views_tablevac; v->name != NULL; v++)
 		add_view(v);
 
@@ -260,6 +276,14 @@ print_tablevac(void)
 	} while (0);
 }
 
+const char *
+tablevac_name(int i)
+{
+	if (i >= tablevac_count)
+		return NULL;
+	return tablevacs[i].relname;
+}
+
 void
 sort_tablevac(void)
 {
@@ -279,8 +303,8 @@ sort_tablevac(void)
 	if (tablevac_count <= 0)
 		return;
 
-	mergesort(tablevacs, tablevac_count, sizeof(struct tablevac_t),
-			  ordering->func);
+	sort_rows(tablevacs, tablevac_count, sizeof(struct tablevac_t),
+			  offsetof(struct tablevac_t, order), ordering->func);
 }
 
 int
@@ -13,6 +13,7 @@
 
 #include "pg.h"
 #include "pg_systat.h"
+#include "serve.h"
 
 #define QUERY_STAT_DBXACT \
         "SELECT pg_stat_progress_vacuum.pid, nspname, relname, phase,\n" \
@@ -27,6 +28,7 @@
 struct vacuum_t
 {
 	RB_ENTRY(vacuum_t) entry;
+	row_order	order;
 	long long	pid;
 	char		nspname[NAMEDATALEN + 1];
 	char		relname[NAMEDATALEN + 1];
@@ -130,7 +132,8 @@ order_type	vacuum_order_list[] = {
 /* Define view managers */
 struct view_manager vacuum_mgr = {
 	"vacuum", select_vacuum, read_vacuum, sort_vacuum, print_header,
-	print_vacuum, keyboard_callback, vacuum_order_list, vacuum_order_list
+	print_vacuum, keyboard_callback, vacuum_order_list, vacuum_order_list, NULL,
+	NULL, NULL, TIER_PROGRESS
 };
 
 field_view	views_vacuum[] = {
@@ -146,14 +149,15 @@ vacuum_info(void)
 {
 	int			i;
 	PGresult   *pgresult = NULL;
+	const char *sqlstate;
 
 	struct vacuum_t *n,
 			   *p;
 
 	connect_to_db();
-	if (options.connection != NULL)
+	if (pg_connected())
 	{
-		pgresult = PQexec(options.connection, QUERY_STAT_DBXACT);
+		pgresult = pg_exec(QUERY_STAT_DBXACT);
 		if (PQresultStatus(pgresult) == PGRES_TUPLES_OK)
 		{
 			i = vacuum_count;
@@ -161,9 +165,10 @@ vacuum_info(void)
 		}
 		else
 		{
-			if (strcmp(PQresultErrorField(pgresult,
-										  PG_DIAG_SQLSTATE), "42P01") == 0)
+			sqlstate = PQresultErrorField(pgresult, PG_DIAG_SQLSTATE);
+			if (sqlstate != NULL && strcmp(sqlstate, "42P01") == 0)
 				error("PostgreSQL 9.6+ required for vacuum view");
+			PQclear(pgresult);
 			return;
 		}
 	}
@@ -199,6 +204,8 @@ vacuum_info(void)
 			return;
 		}
 		n->pid = atoll(PQgetvalue(pgresult, i, 0));
+		n->order.node = n;
+		n->order.rank = -1;
 		p = RB_INSERT(vacuum, &head_vacuums, n);
 		if (p != NULL)
 		{
@@ -251,6 +258,8 @@ initvacuum(void)
 	vacuums = NULL;
 	vacuum_count = 0;
 
+	serve_allow(QUERY_STAT_DBXACT);
+
 	for (v = views_vacuum; v->name != NULL; v++)
 		add_view(v);
 
@@ -324,7 +333,8 @@ sort_vacuum(void)
 	if (vacuum_count <= 0)
 		return;
 
-	mergesort(vacuums, vacuum_count, sizeof(struct vacuum_t), ordering->func);
+	sort_rows(vacuums, vacuum_count, sizeof(struct vacuum_t),
+			  offsetof(struct vacuum_t, order), ordering->func);
 }
 
 int